@@ -0,0 +1,238 @@
+/*
+  Copyright (c) 2010 Graham Daws <graham.daws@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#include <cassert>
+#include "ast.hpp"
+#include "eval.hpp"
+
+namespace cubescript{
+
+/**
+    Adds the operations made by eval() to a syntax tree. An expression node
+    is added, and linked to its parent, when the command is pushed. Its 
+    argument list is kept on a stack of pending arguments until the call, 
+    which moves the list to the tree's argument array. Inner expressions are
+    always called before the outer ones, so each list is copied only once.
+    Like program_compiler, the builder is used with the parser template 
+    from eval.hpp and so isn't derived from command_stack.
+*/
+class ast_builder
+{
+public:
+    ast_builder(ast & output)
+     :m_output(output)
+    {
+
+    }
+
+    std::size_t push_command()
+    {
+        std::size_t index = add(ast::EXPRESSION);
+        if(m_open.empty()) m_output.m_roots.push_back(index);
+        m_open.push_back(open_expression(index, m_pending.size()));
+        return m_open.size();
+    }
+
+    void push_argument_symbol(const char * id, std::size_t id_length)
+    {
+        add_string(ast::SYMBOL, id, id_length);
+    }
+
+    void push_argument()
+    {
+        add(ast::NIL);
+    }
+
+    void push_argument(bool value)
+    {
+        get(add(ast::BOOLEAN)).value.boolean = value;
+    }
+
+    void push_argument(int value)
+    {
+        get(add(ast::INTEGER)).value.integer = value;
+    }
+
+    void push_argument(float value)
+    {
+        get(add(ast::REAL)).value.real = value;
+    }
+
+    void push_argument(long long value)
+    {
+        get(add(ast::INTEGER)).value.integer = value;
+    }
+
+    void push_argument(double value)
+    {
+        get(add(ast::REAL)).value.real = value;
+    }
+
+    void push_argument(const char * value, std::size_t length)
+    {
+        add_string(ast::STRING, value, length);
+    }
+
+    std::string pop_string()
+    {
+        if(m_open.empty() || m_pending.size() == m_open.back().arguments)
+            throw command_error("pop_string called on an empty stack");
+        const ast::node & top = get(m_pending.back());
+        if(top.type != ast::STRING)
+            throw command_error("pop_string expected a string value");
+        m_pending.pop_back();
+        return std::string(m_output.string(top), top.value.string.length);
+    }
+
+    void call(std::size_t index)
+    {
+        assert(index == m_open.size());
+        close();
+    }
+
+    /**
+        Close the expressions left open by a parse error.
+    */
+    void finish()
+    {
+        while(!m_open.empty()) close();
+    }
+private:
+    struct open_expression
+    {
+        open_expression(std::size_t node, std::size_t arguments)
+         :node(node), arguments(arguments)
+        {
+
+        }
+
+        std::size_t node;
+
+        // Position of the expression's first argument in m_pending
+        std::size_t arguments;
+    };
+
+    ast::node & get(std::size_t index)
+    {
+        return m_output.m_nodes[index];
+    }
+
+    std::size_t add(ast::node_type type)
+    {
+        std::size_t index = m_output.m_nodes.size();
+        ast::node node;
+        node.type = type;
+        m_output.m_nodes.push_back(node);
+        if(!m_open.empty()) m_pending.push_back(index);
+        return index;
+    }
+
+    void add_string(ast::node_type type, const char * value, std::size_t length)
+    {
+        ast::node & node = get(add(type));
+        const std::string & source = m_output.m_source;
+        if(value >= source.data() && value + length <= source.data() + 
+           source.length())
+        {
+            node.value.string.offset = value - source.data();
+        }
+        else
+        {
+            node.value.string.offset = source.length() + 
+                m_output.m_strings.length();
+            m_output.m_strings.append(value, length);
+        }
+        node.value.string.length = length;
+    }
+
+    void close()
+    {
+        const open_expression & expression = m_open.back();
+        ast::node & node = get(expression.node);
+        node.value.arguments.first = m_output.m_arguments.size();
+        node.value.arguments.count = m_pending.size() - expression.arguments;
+        m_output.m_arguments.insert(m_output.m_arguments.end(), 
+            m_pending.begin() + expression.arguments, m_pending.end());
+        m_pending.resize(expression.arguments);
+        m_open.pop_back();
+    }
+
+    ast & m_output;
+    std::vector<open_expression> m_open;
+    std::vector<std::size_t> m_pending;
+};
+
+std::size_t ast::size()const
+{
+    return m_nodes.size();
+}
+
+const ast::node & ast::get_node(std::size_t index)const
+{
+    return m_nodes[index];
+}
+
+std::size_t ast::root_count()const
+{
+    return m_roots.size();
+}
+
+std::size_t ast::root(std::size_t index)const
+{
+    return m_roots[index];
+}
+
+std::size_t ast::argument(const node & expression, std::size_t index)const
+{
+    return m_arguments[expression.value.arguments.first + index];
+}
+
+const char * ast::string(const node & node)const
+{
+    std::size_t offset = node.value.string.offset;
+    if(offset < m_source.length()) return m_source.data() + offset;
+    return m_strings.data() + (offset - m_source.length());
+}
+
+const std::string & ast::source()const
+{
+    return m_source;
+}
+
+eval_status parse(const char * source_begin, const char * source_end,
+                  ast & output)
+{
+    output.m_nodes.clear();
+    output.m_arguments.clear();
+    output.m_roots.clear();
+    output.m_strings.clear();
+    output.m_source.assign(source_begin, source_end);
+
+    const char * source = output.m_source.data();
+    ast_builder builder(output);
+
+    eval_status status = try_eval(&source, source + output.m_source.length(),
+                                  builder);
+    builder.finish();
+    return status;
+}
+
+} //namespace cubescript
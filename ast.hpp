@@ -0,0 +1,130 @@
+/*
+  Copyright (c) 2010 Graham Daws <graham.daws@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#ifndef CUBESCRIPT_AST_HPP
+#define CUBESCRIPT_AST_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "cubescript.hpp"
+
+namespace cubescript{
+
+/**
+    Syntax tree of Cubescript code, stored flat. Nodes are kept in one array 
+    in the order the parser pushed them, and the arguments of an expression 
+    are a contiguous range in an array of node indices. Strings are offsets 
+    into a copy of the source code, so building the tree doesn't allocate 
+    per node; strings that don't appear in the source as they are (i.e. 
+    strings with escape sequences) are copied to a separate buffer.
+*/
+class ast
+{
+public:
+    enum node_type
+    {
+        EXPRESSION = 0,
+        SYMBOL,
+        NIL,
+        BOOLEAN,
+        INTEGER,
+        REAL,
+        STRING
+    };
+
+    struct node
+    {
+        node_type type;
+        union
+        {
+            bool boolean;
+            long long integer;
+            double real;
+            struct
+            {
+                std::size_t offset;
+                std::size_t length;
+            } string;
+            struct
+            {
+                std::size_t first;
+                std::size_t count;
+            } arguments;
+        } value;
+    };
+
+    /**
+        Return the number of nodes in the tree.
+    */
+    std::size_t size()const;
+
+    const node & get_node(std::size_t index)const;
+
+    /**
+        Return the number of top-level expressions.
+    */
+    std::size_t root_count()const;
+
+    /**
+        Return the node index of a top-level expression.
+    */
+    std::size_t root(std::size_t index)const;
+
+    /**
+        Return the node index of an argument of an EXPRESSION node. The
+        function being called is argument 0.
+    */
+    std::size_t argument(const node &, std::size_t index)const;
+
+    /**
+        Return a pointer to the string data of a SYMBOL or STRING node.
+    */
+    const char * string(const node &)const;
+
+    /**
+        The source code the tree was parsed from.
+    */
+    const std::string & source()const;
+private:
+    friend class ast_builder;
+    friend eval_status parse(const char *, const char *, ast &);
+
+    std::vector<node> m_nodes;
+    std::vector<std::size_t> m_arguments;
+    std::vector<std::size_t> m_roots;
+    std::string m_source;
+    std::string m_strings;
+};
+
+/**
+    Parse the input string as Cubescript code into a syntax tree. Any previous
+    contents of the output tree are replaced.
+
+    The tree holds every expression the parser started before it stopped, so
+    after a parse error the expressions that were cut off are still in the 
+    tree with the arguments read up to the error.
+*/
+eval_status parse(const char * source_begin, const char * source_end, ast &);
+
+} //namespace cubescript
+
+#endif
@@ -0,0 +1,417 @@
+/*
+  Copyright (c) 2010 Graham Daws <graham.daws@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#ifndef CUBESCRIPT_BINDING_HPP
+#define CUBESCRIPT_BINDING_HPP
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <sstream>
+#include <string>
+#include "native_command_stack.hpp"
+
+namespace cubescript{
+
+/**
+    A string argument or return value of a bound function that refers to 
+    characters owned by someone else instead of holding a copy. The string 
+    isn't null-terminated. An argument is valid until the function returns.
+*/
+struct string_ref
+{
+    string_ref()
+     :data(NULL), length(0){}
+    
+    string_ref(const char * data, std::size_t length)
+     :data(data), length(length){}
+    
+    const char * data;
+    std::size_t length;
+};
+
+namespace detail{
+
+/**
+    Function pointers are kept in the void pointer given to the command, so
+    that binding a function doesn't allocate.
+*/
+template<class Function>
+void * pack_function(Function function)
+{
+    typedef char function_fits_in_pointer[
+        sizeof(Function) <= sizeof(void *) ? 1 : -1];
+    
+    void * packed = NULL;
+    std::memcpy(&packed, &function, sizeof(function_fits_in_pointer) * 
+                sizeof(Function));
+    return packed;
+}
+
+template<class Function>
+Function unpack_function(void * packed)
+{
+    Function function;
+    std::memcpy(&function, &packed, sizeof(Function));
+    return function;
+}
+
+template<class T> struct argument_type{typedef T type;};
+template<class T> struct argument_type<const T &>{typedef T type;};
+
+inline void throw_bad_argument(int position, const char * expected, 
+                               const char * got)
+{
+    std::stringstream format;
+    format<<"bad argument #"<<position<<" ("<<expected<<" expected, got "
+          <<got<<")";
+    throw command_error(format.str());
+}
+
+/**
+    Conversion of the argument at a position, counting from 1, of a call to
+    a bound function on a native_command_stack.
+*/
+template<class T> struct native_argument;
+
+template<class T>
+struct native_number_argument
+{
+    static T get(native_command_stack & stack, std::size_t first, 
+                 std::size_t count, int position)
+    {
+        std::size_t index = first + position - 1;
+        
+        if(static_cast<std::size_t>(position) > count)
+            throw_bad_argument(position, "number", "no value");
+        
+        native_command_stack::value_type type = stack.type(index);
+        
+        if(type == native_command_stack::INTEGER) 
+            return static_cast<T>(stack.to_integer(index));
+        
+        if(type == native_command_stack::REAL)
+            return static_cast<T>(stack.to_real(index));
+        
+        // Strings are accepted if they're numbers, as in Lua
+        if(type == native_command_stack::STRING)
+        {
+            std::size_t length = 0;
+            const char * data = stack.to_string(index, length);
+            
+            char number[64];
+            if(length && length < sizeof(number))
+            {
+                std::memcpy(number, data, length);
+                number[length] = '\0';
+                
+                char * end = NULL;
+                double value = std::strtod(number, &end);
+                if(*end == '\0') return static_cast<T>(value);
+            }
+        }
+        
+        throw_bad_argument(position, "number", 
+            native_command_stack::type_name(type));
+        return T();
+    }
+};
+
+template<> struct native_argument<int>:native_number_argument<int>{};
+template<> struct native_argument<long long>
+    :native_number_argument<long long>{};
+template<> struct native_argument<float>:native_number_argument<float>{};
+template<> struct native_argument<double>:native_number_argument<double>{};
+
+template<>
+struct native_argument<bool>
+{
+    static bool get(native_command_stack & stack, std::size_t first, 
+                    std::size_t count, int position)
+    {
+        if(static_cast<std::size_t>(position) > count) return false;
+        return stack.to_boolean(first + position - 1);
+    }
+};
+
+template<>
+struct native_argument<string_ref>
+{
+    static string_ref get(native_command_stack & stack, std::size_t first,
+                          std::size_t count, int position)
+    {
+        if(static_cast<std::size_t>(position) > count)
+            throw_bad_argument(position, "string", "no value");
+        
+        std::size_t index = first + position - 1;
+        string_ref output;
+        output.data = stack.to_string(index, output.length);
+        
+        if(!output.data)
+            throw_bad_argument(position, "string", 
+                native_command_stack::type_name(stack.type(index)));
+        
+        return output;
+    }
+};
+
+template<>
+struct native_argument<std::string>
+{
+    static std::string get(native_command_stack & stack, std::size_t first,
+                           std::size_t count, int position)
+    {
+        string_ref input = 
+            native_argument<string_ref>::get(stack, first, count, position);
+        return std::string(input.data, input.length);
+    }
+};
+
+inline void push_native_result(native_command_stack & stack, bool value)
+{
+    stack.push_argument(value);
+}
+
+inline void push_native_result(native_command_stack & stack, int value)
+{
+    stack.push_argument(value);
+}
+
+inline void push_native_result(native_command_stack & stack, long long value)
+{
+    stack.push_argument(value);
+}
+
+inline void push_native_result(native_command_stack & stack, float value)
+{
+    stack.push_argument(value);
+}
+
+inline void push_native_result(native_command_stack & stack, double value)
+{
+    stack.push_argument(value);
+}
+
+inline void push_native_result(native_command_stack & stack, 
+                               const char * value)
+{
+    if(value) stack.push_argument(value, std::strlen(value));
+    else stack.push_argument();
+}
+
+inline void push_native_result(native_command_stack & stack, 
+                               const std::string & value)
+{
+    stack.push_argument(value.data(), value.length());
+}
+
+inline void push_native_result(native_command_stack & stack, 
+                               string_ref value)
+{
+    stack.push_argument(value.data, value.length);
+}
+
+/**
+    Calls a bound function with the arguments converted from the stack 
+    values. There is a specialization for each number of arguments, with and
+    without a return value.
+*/
+template<class Function> struct native_invoker;
+
+template<class R>
+struct native_invoker<R (*)()>
+{
+    static void call(native_command_stack & stack, std::size_t, std::size_t,
+                     R (*function)())
+    {
+        push_native_result(stack, function());
+    }
+};
+
+template<>
+struct native_invoker<void (*)()>
+{
+    static void call(native_command_stack &, std::size_t, std::size_t, 
+                     void (*function)())
+    {
+        function();
+    }
+};
+
+template<class R, class A1>
+struct native_invoker<R (*)(A1)>
+{
+    static void call(native_command_stack & stack, std::size_t first, 
+                     std::size_t count, R (*function)(A1))
+    {
+        typedef typename argument_type<A1>::type T1;
+        T1 a1 = native_argument<T1>::get(stack, first, count, 1);
+        push_native_result(stack, function(a1));
+    }
+};
+
+template<class A1>
+struct native_invoker<void (*)(A1)>
+{
+    static void call(native_command_stack & stack, std::size_t first, 
+                     std::size_t count, void (*function)(A1))
+    {
+        typedef typename argument_type<A1>::type T1;
+        T1 a1 = native_argument<T1>::get(stack, first, count, 1);
+        function(a1);
+    }
+};
+
+template<class R, class A1, class A2>
+struct native_invoker<R (*)(A1, A2)>
+{
+    static void call(native_command_stack & stack, std::size_t first, 
+                     std::size_t count, R (*function)(A1, A2))
+    {
+        typedef typename argument_type<A1>::type T1;
+        typedef typename argument_type<A2>::type T2;
+        T1 a1 = native_argument<T1>::get(stack, first, count, 1);
+        T2 a2 = native_argument<T2>::get(stack, first, count, 2);
+        push_native_result(stack, function(a1, a2));
+    }
+};
+
+template<class A1, class A2>
+struct native_invoker<void (*)(A1, A2)>
+{
+    static void call(native_command_stack & stack, std::size_t first, 
+                     std::size_t count, void (*function)(A1, A2))
+    {
+        typedef typename argument_type<A1>::type T1;
+        typedef typename argument_type<A2>::type T2;
+        T1 a1 = native_argument<T1>::get(stack, first, count, 1);
+        T2 a2 = native_argument<T2>::get(stack, first, count, 2);
+        function(a1, a2);
+    }
+};
+
+template<class R, class A1, class A2, class A3>
+struct native_invoker<R (*)(A1, A2, A3)>
+{
+    static void call(native_command_stack & stack, std::size_t first, 
+                     std::size_t count, R (*function)(A1, A2, A3))
+    {
+        typedef typename argument_type<A1>::type T1;
+        typedef typename argument_type<A2>::type T2;
+        typedef typename argument_type<A3>::type T3;
+        T1 a1 = native_argument<T1>::get(stack, first, count, 1);
+        T2 a2 = native_argument<T2>::get(stack, first, count, 2);
+        T3 a3 = native_argument<T3>::get(stack, first, count, 3);
+        push_native_result(stack, function(a1, a2, a3));
+    }
+};
+
+template<class A1, class A2, class A3>
+struct native_invoker<void (*)(A1, A2, A3)>
+{
+    static void call(native_command_stack & stack, std::size_t first, 
+                     std::size_t count, void (*function)(A1, A2, A3))
+    {
+        typedef typename argument_type<A1>::type T1;
+        typedef typename argument_type<A2>::type T2;
+        typedef typename argument_type<A3>::type T3;
+        T1 a1 = native_argument<T1>::get(stack, first, count, 1);
+        T2 a2 = native_argument<T2>::get(stack, first, count, 2);
+        T3 a3 = native_argument<T3>::get(stack, first, count, 3);
+        function(a1, a2, a3);
+    }
+};
+
+template<class R, class A1, class A2, class A3, class A4>
+struct native_invoker<R (*)(A1, A2, A3, A4)>
+{
+    static void call(native_command_stack & stack, std::size_t first, 
+                     std::size_t count, R (*function)(A1, A2, A3, A4))
+    {
+        typedef typename argument_type<A1>::type T1;
+        typedef typename argument_type<A2>::type T2;
+        typedef typename argument_type<A3>::type T3;
+        typedef typename argument_type<A4>::type T4;
+        T1 a1 = native_argument<T1>::get(stack, first, count, 1);
+        T2 a2 = native_argument<T2>::get(stack, first, count, 2);
+        T3 a3 = native_argument<T3>::get(stack, first, count, 3);
+        T4 a4 = native_argument<T4>::get(stack, first, count, 4);
+        push_native_result(stack, function(a1, a2, a3, a4));
+    }
+};
+
+template<class A1, class A2, class A3, class A4>
+struct native_invoker<void (*)(A1, A2, A3, A4)>
+{
+    static void call(native_command_stack & stack, std::size_t first, 
+                     std::size_t count, void (*function)(A1, A2, A3, A4))
+    {
+        typedef typename argument_type<A1>::type T1;
+        typedef typename argument_type<A2>::type T2;
+        typedef typename argument_type<A3>::type T3;
+        typedef typename argument_type<A4>::type T4;
+        T1 a1 = native_argument<T1>::get(stack, first, count, 1);
+        T2 a2 = native_argument<T2>::get(stack, first, count, 2);
+        T3 a3 = native_argument<T3>::get(stack, first, count, 3);
+        T4 a4 = native_argument<T4>::get(stack, first, count, 4);
+        function(a1, a2, a3, a4);
+    }
+};
+
+template<class Function>
+void native_command(native_command_stack & stack, std::size_t first, 
+                    std::size_t count, void * data)
+{
+    try
+    {
+        native_invoker<Function>::call(stack, first, count, 
+                                       unpack_function<Function>(data));
+    }
+    catch(const eval_error &)
+    {
+        throw;
+    }
+    catch(const std::exception & error)
+    {
+        throw command_error(error.what());
+    }
+}
+
+} //namespace detail
+
+/**
+    Set a command on a native_command_stack that calls a C++ function. The
+    argument and return value conversions are chosen at compile time from the
+    function's type. Supported types are bool, int, long long, float, double,
+    std::string and string_ref, and const char * for return values. Functions
+    can have up to four parameters.
+*/
+template<class Function>
+void bind(native_command_stack & stack, const char * name, Function function)
+{
+    stack.set_command(name, &detail::native_command<Function>, 
+                      detail::pack_function(function));
+}
+
+} //namespace cubescript
+
+#endif
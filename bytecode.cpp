@@ -0,0 +1,464 @@
+/*
+  Copyright (c) 2010 Graham Daws <graham.daws@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#include <cassert>
+#include "bytecode.hpp"
+#include "image.hpp"
+#include "eval.hpp"
+
+namespace cubescript{
+
+/**
+    Records the operations made by eval() as program instructions. The index
+    returned by push_command() is the nesting depth of the command; eval()
+    always calls the innermost command first, so the replay engine can keep
+    the real stack indices on a stack of its own.
+
+    The compiler has the same methods as command_stack, but isn't derived 
+    from it; the parser is instantiated for this class (see eval.hpp) so 
+    the methods are inlined into it.
+*/
+class program_compiler
+{
+public:
+    program_compiler(program & output)
+     :m_output(output), m_depth(0)
+    {
+
+    }
+
+    std::size_t push_command()
+    {
+        add(program::PUSH_COMMAND);
+        return ++m_depth;
+    }
+
+    void push_argument_symbol(const char * id, std::size_t id_length)
+    {
+        add_string(program::PUSH_ARGUMENT_SYMBOL, id, id_length);
+    }
+
+    void push_argument()
+    {
+        add(program::PUSH_ARGUMENT_NIL);
+    }
+
+    void push_argument(bool value)
+    {
+        add(program::PUSH_ARGUMENT_BOOL).operand.boolean = value;
+    }
+
+    void push_argument(int value)
+    {
+        add(program::PUSH_ARGUMENT_INT).operand.integer = value;
+    }
+
+    void push_argument(float value)
+    {
+        add(program::PUSH_ARGUMENT_REAL).operand.real = value;
+    }
+
+    void push_argument(long long value)
+    {
+        add(program::PUSH_ARGUMENT_LONG).operand.long_integer = value;
+    }
+
+    void push_argument(double value)
+    {
+        add(program::PUSH_ARGUMENT_DOUBLE).operand.double_real = value;
+    }
+
+    void push_argument(const char * value, std::size_t length)
+    {
+        add_string(program::PUSH_ARGUMENT_STRING, value, length);
+    }
+
+    std::string pop_string()
+    {
+        throw command_error("pop_string is not supported by the compiler");
+    }
+
+    void call(std::size_t index)
+    {
+        assert(index == m_depth);
+        add(program::CALL);
+        m_depth--;
+    }
+
+    void add_error(const std::string & message)
+    {
+        add_string(program::PARSE_ERROR, message.c_str(), message.length());
+    }
+
+    void add_incomplete()
+    {
+        add(program::PARSE_INCOMPLETE);
+    }
+private:
+    program::instruction & add(program::opcode op)
+    {
+        program::instruction instruction;
+        instruction.op = op;
+        m_output.m_instructions.push_back(instruction);
+        return m_output.m_instructions.back();
+    }
+
+    void add_string(program::opcode op, const char * value, std::size_t length)
+    {
+        program::instruction & instruction = add(op);
+        instruction.operand.string.offset = m_output.m_strings.length();
+        instruction.operand.string.length = length;
+        m_output.m_strings.append(value, length);
+        m_output.m_strings.append(1, '\0');
+    }
+
+    program & m_output;
+    std::size_t m_depth;
+};
+
+program::const_iterator program::begin()const
+{
+    return m_instructions.begin();
+}
+
+program::const_iterator program::end()const
+{
+    return m_instructions.end();
+}
+
+std::size_t program::size()const
+{
+    return m_instructions.size();
+}
+
+const char * program::string(const instruction & instruction)const
+{
+    return m_strings.data() + instruction.operand.string.offset;
+}
+
+const std::string & program::source()const
+{
+    return m_source;
+}
+
+std::size_t program::hash(const char * start, const char * end)
+{
+    // FNV-1a
+    std::size_t hash = static_cast<std::size_t>(14695981039346656037ULL);
+    for(const char * cursor = start; cursor != end; cursor++)
+    {
+        hash ^= static_cast<unsigned char>(*cursor);
+        hash *= static_cast<std::size_t>(1099511628211ULL);
+    }
+    return hash;
+}
+
+void compile(const char * source_begin, const char * source_end,
+             program & output)
+{
+    output.m_instructions.clear();
+    output.m_strings.clear();
+    output.m_source.clear();
+    
+    // Most code has fewer instructions than half its length, and string 
+    // operands are rarely longer than the source they were read from
+    std::size_t source_length = source_end - source_begin;
+    output.m_instructions.reserve(source_length / 2 + 2);
+    output.m_strings.reserve(source_length);
+    
+    compile_append(source_begin, source_end, output);
+}
+
+void compile_append(const char * source_begin, const char * source_end,
+                    program & output)
+{
+    output.m_source.append(source_begin, source_end);
+
+    program_compiler compiler(output);
+
+    eval_status status = try_eval(&source_begin, source_end, compiler);
+    
+    switch(status.error)
+    {
+        case eval_status::OK:
+            break;
+        case eval_status::INCOMPLETE:
+            compiler.add_incomplete();
+            break;
+        default:
+            compiler.add_error(status.message());
+    }
+}
+
+void replay(const program & code, command_stack & command)
+{
+    replay(code, code.begin(), code.end(), command);
+}
+
+void replay(const program & code, program::const_iterator first,
+            program::const_iterator last, command_stack & command)
+{
+    std::vector<std::size_t> call_index;
+
+    for(program::const_iterator iter = first; iter != last; iter++)
+    {
+        const program::instruction & instruction = *iter;
+
+        switch(instruction.op)
+        {
+            case program::PUSH_COMMAND:
+                call_index.push_back(command.push_command());
+                break;
+            case program::PUSH_ARGUMENT_SYMBOL:
+                command.push_argument_symbol(code.string(instruction),
+                    instruction.operand.string.length);
+                break;
+            case program::PUSH_ARGUMENT_NIL:
+                command.push_argument();
+                break;
+            case program::PUSH_ARGUMENT_BOOL:
+                command.push_argument(instruction.operand.boolean);
+                break;
+            case program::PUSH_ARGUMENT_INT:
+                command.push_argument(instruction.operand.integer);
+                break;
+            case program::PUSH_ARGUMENT_REAL:
+                command.push_argument(instruction.operand.real);
+                break;
+            case program::PUSH_ARGUMENT_LONG:
+                command.push_argument(instruction.operand.long_integer);
+                break;
+            case program::PUSH_ARGUMENT_DOUBLE:
+                command.push_argument(instruction.operand.double_real);
+                break;
+            case program::PUSH_ARGUMENT_STRING:
+                command.push_argument(code.string(instruction),
+                    instruction.operand.string.length);
+                break;
+            case program::CALL:
+            {
+                std::size_t index = call_index.back();
+                call_index.pop_back();
+                command.call(index);
+                break;
+            }
+            case program::PARSE_ERROR:
+                throw parse_error(code.string(instruction));
+            case program::PARSE_INCOMPLETE:
+                throw parse_incomplete();
+        }
+    }
+}
+
+void save(const program & code, std::string & output)
+{
+    image::write_size(code.m_instructions.size(), output);
+    
+    for(program::const_iterator iter = code.begin(); iter != code.end(); 
+        iter++)
+    {
+        const program::instruction & instruction = *iter;
+        
+        output += static_cast<char>(instruction.op);
+        
+        switch(instruction.op)
+        {
+            case program::PUSH_ARGUMENT_BOOL:
+                output += static_cast<char>(instruction.operand.boolean);
+                break;
+            case program::PUSH_ARGUMENT_INT:
+                image::write_raw(instruction.operand.integer, output);
+                break;
+            case program::PUSH_ARGUMENT_REAL:
+                image::write_raw(instruction.operand.real, output);
+                break;
+            case program::PUSH_ARGUMENT_LONG:
+                image::write_raw(instruction.operand.long_integer, output);
+                break;
+            case program::PUSH_ARGUMENT_DOUBLE:
+                image::write_raw(instruction.operand.double_real, output);
+                break;
+            case program::PUSH_ARGUMENT_SYMBOL:
+            case program::PUSH_ARGUMENT_STRING:
+            case program::PARSE_ERROR:
+                // The compiler adds the strings in instruction order, so the
+                // offsets can be worked out again from the lengths
+                image::write_size(instruction.operand.string.length, output);
+                break;
+            default:
+                break;
+        }
+    }
+    
+    image::write_size(code.m_strings.length(), output);
+    output.append(code.m_strings);
+}
+
+namespace{
+
+bool load_instructions(const char ** position, const char * end, 
+                       program::instruction * instruction, 
+                       program::instruction * last, 
+                       std::size_t & strings_length)
+{
+    std::size_t depth = 0;
+    strings_length = 0;
+    
+    for(; instruction != last; instruction++)
+    {
+        if(*position == end) return false;
+        
+        unsigned char op = static_cast<unsigned char>(*(*position)++);
+        if(op > program::PARSE_INCOMPLETE) return false;
+        instruction->op = static_cast<program::opcode>(op);
+        
+        bool valid = true;
+        
+        switch(instruction->op)
+        {
+            case program::PUSH_COMMAND:
+                depth++;
+                break;
+            case program::CALL:
+                valid = depth-- > 0;
+                break;
+            case program::PUSH_ARGUMENT_BOOL:
+            {
+                unsigned char value;
+                valid = image::read_raw(position, end, value) && value < 2;
+                instruction->operand.boolean = value;
+                break;
+            }
+            case program::PUSH_ARGUMENT_INT:
+                valid = image::read_raw(position, end, 
+                                        instruction->operand.integer);
+                break;
+            case program::PUSH_ARGUMENT_REAL:
+                valid = image::read_raw(position, end, 
+                                        instruction->operand.real);
+                break;
+            case program::PUSH_ARGUMENT_LONG:
+                valid = image::read_raw(position, end, 
+                                        instruction->operand.long_integer);
+                break;
+            case program::PUSH_ARGUMENT_DOUBLE:
+                valid = image::read_raw(position, end, 
+                                        instruction->operand.double_real);
+                break;
+            case program::PUSH_ARGUMENT_SYMBOL:
+            case program::PUSH_ARGUMENT_STRING:
+            case program::PARSE_ERROR:
+            {
+                // The strings follow the instructions, so their total 
+                // length is limited by the size of the rest of the image
+                std::size_t length;
+                std::size_t remaining = end - *position;
+                valid = image::read_size(position, end, length) && 
+                    strings_length <= remaining &&
+                    length < remaining - strings_length;
+                instruction->operand.string.offset = strings_length;
+                instruction->operand.string.length = length;
+                strings_length += length + 1;
+                break;
+            }
+            case program::PUSH_ARGUMENT_NIL:
+            case program::PARSE_INCOMPLETE:
+                break;
+        }
+        
+        if(!valid) return false;
+    }
+    
+    return true;
+}
+
+/**
+    Check that every string operand is followed by the terminator added by
+    the compiler.
+*/
+bool has_terminated_strings(const program & code, const std::string & strings)
+{
+    for(program::const_iterator iter = code.begin(); iter != code.end(); 
+        iter++)
+    {
+        switch(iter->op)
+        {
+            case program::PUSH_ARGUMENT_SYMBOL:
+            case program::PUSH_ARGUMENT_STRING:
+            case program::PARSE_ERROR:
+                if(strings[iter->operand.string.offset + 
+                           iter->operand.string.length] != '\0')
+                    return false;
+                break;
+            default:
+                break;
+        }
+    }
+    return true;
+}
+
+} //anonymous namespace
+
+bool load(const char ** position, const char * end, program & output)
+{
+    output.m_instructions.clear();
+    output.m_strings.clear();
+    output.m_source.clear();
+    
+    const char * cursor = *position;
+    
+    // Every instruction takes at least one byte, which limits the size of
+    // the allocation made for a corrupt count
+    std::size_t count;
+    if(!image::read_size(&cursor, end, count) || 
+       count > static_cast<std::size_t>(end - cursor)) return false;
+    
+    output.m_instructions.resize(count);
+    
+    std::size_t expected_strings_length;
+    std::size_t strings_length;
+    
+    if(!count || load_instructions(&cursor, end, &output.m_instructions[0], 
+        &output.m_instructions[0] + count, expected_strings_length))
+    {
+        if(!count) expected_strings_length = 0;
+        
+        if(image::read_size(&cursor, end, strings_length) && 
+           strings_length == expected_strings_length &&
+           strings_length <= static_cast<std::size_t>(end - cursor))
+        {
+            output.m_strings.assign(cursor, strings_length);
+            cursor += strings_length;
+            
+            if(has_terminated_strings(output, output.m_strings))
+            {
+                *position = cursor;
+                return true;
+            }
+        }
+    }
+    
+    output.m_instructions.clear();
+    output.m_strings.clear();
+    return false;
+}
+
+} //namespace cubescript
@@ -0,0 +1,163 @@
+/*
+  Copyright (c) 2010 Graham Daws <graham.daws@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#ifndef CUBESCRIPT_BYTECODE_HPP
+#define CUBESCRIPT_BYTECODE_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "cubescript.hpp"
+
+namespace cubescript{
+
+/**
+    Cubescript code compiled into a stream of command_stack operations.
+    Replaying a program makes the same sequence of calls on a command_stack
+    object as eval() would make on the source code, but without lexing the
+    source code again.
+
+    Parse errors are recorded in the instruction stream at the point they were
+    found, so a replay runs the function calls that came before the error, and
+    then throws the same exception that eval() would have thrown.
+*/
+class program
+{
+public:
+    enum opcode
+    {
+        PUSH_COMMAND = 0,
+        PUSH_ARGUMENT_SYMBOL,
+        PUSH_ARGUMENT_NIL,
+        PUSH_ARGUMENT_BOOL,
+        PUSH_ARGUMENT_INT,
+        PUSH_ARGUMENT_REAL,
+        PUSH_ARGUMENT_LONG,
+        PUSH_ARGUMENT_DOUBLE,
+        PUSH_ARGUMENT_STRING,
+        CALL,
+        PARSE_ERROR,
+        PARSE_INCOMPLETE
+    };
+
+    struct instruction
+    {
+        opcode op;
+        union
+        {
+            bool boolean;
+            int integer;
+            float real;
+            long long long_integer;
+            double double_real;
+            struct
+            {
+                std::size_t offset;
+                std::size_t length;
+            } string;
+        } operand;
+    };
+
+    typedef std::vector<instruction>::const_iterator const_iterator;
+
+    const_iterator begin()const;
+    const_iterator end()const;
+    std::size_t size()const;
+
+    /**
+        Return a pointer to the string data referenced by a
+        PUSH_ARGUMENT_SYMBOL, PUSH_ARGUMENT_STRING or PARSE_ERROR instruction.
+    */
+    const char * string(const instruction &)const;
+
+    /**
+        The source code the program was compiled from.
+    */
+    const std::string & source()const;
+
+    /**
+        Hash function used for looking up compiled programs by source code.
+    */
+    static std::size_t hash(const char * start, const char * end);
+private:
+    friend class program_compiler;
+    friend void compile(const char *, const char *, program &);
+    friend void compile_append(const char *, const char *, program &);
+    friend void save(const program &, std::string &);
+    friend bool load(const char **, const char *, program &);
+
+    std::vector<instruction> m_instructions;
+    std::string m_strings;
+    std::string m_source;
+};
+
+/**
+    Compile the input string as Cubescript code. Any previous contents of the
+    output program are replaced.
+*/
+void compile(const char * source_begin, const char * source_end, program &);
+
+/**
+    Compile the input string as Cubescript code, adding the instructions to 
+    the end of the program and the source code to the end of the program's 
+    source. The input is parsed on its own, as it would be by compile().
+*/
+void compile_append(const char * source_begin, const char * source_end, 
+                    program &);
+
+/**
+    Run a compiled program against a command_stack object. The effect on the
+    command_stack is identical to calling eval() on the source code the program
+    was compiled from.
+
+    Errors in the command stack operations and recorded parse errors are thrown
+    as exceptions derived from the eval_error class.
+*/
+void replay(const program &, command_stack &);
+
+/**
+    Run the instructions of a compiled program from first up to, but not 
+    including, last. The range has to start and end between root 
+    expressions, e.g. at the boundaries of code added by compile_append().
+*/
+void replay(const program &, program::const_iterator first, 
+            program::const_iterator last, command_stack &);
+
+/**
+    Append a binary image of the program to the output string. Numbers are
+    stored as they are in memory, so the image can only be read back on the
+    same platform. The source code isn't saved: a loaded program's source()
+    is empty.
+*/
+void save(const program &, std::string & output);
+
+/**
+    Read a program image written by save(), starting at *position, and move
+    the position to the end of the image. Any previous contents of the output
+    program are replaced. Returns false if the data is truncated or the 
+    instructions are not valid, in which case the output program is left 
+    empty.
+*/
+bool load(const char ** position, const char * end, program &);
+
+} //namespace cubescript
+
+#endif
@@ -19,31 +19,13 @@
   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
   THE SOFTWARE.
 */
-#include <cstdio>
-#include <cassert>
-#include <vector>
-#include <string>
 #include <sstream>
-#include "cubescript.hpp"
+#include "eval.hpp"
 
 namespace cubescript{
 
 namespace expression{
-enum token_id
-{
-    ERROR = 0,
-    WHITESPACE,
-    CHAR,
-    END_ROOT_EXPRESSION,
-    START_EXPRESSION,
-    END_EXPRESSION,
-    START_SYMBOL,
-    START_END_STRING,
-    START_MULTILINE_STRING,
-    END_MULTILINE_STRING,
-    START_COMMENT
-};
-static const token_id symbols[] = 
+const token_id symbols[256] = 
     {ERROR, ERROR, ERROR, ERROR, ERROR, ERROR, ERROR, ERROR, 
     ERROR, WHITESPACE, END_ROOT_EXPRESSION, ERROR, ERROR, END_ROOT_EXPRESSION, ERROR, ERROR, 
     ERROR, ERROR, ERROR, ERROR, ERROR, ERROR, ERROR, ERROR, 
@@ -78,380 +60,110 @@ static const token_id symbols[] =
     ERROR, ERROR, ERROR, ERROR, ERROR, ERROR, ERROR, ERROR};
 } //namespace expression
 
-enum word_type{
-    WORD_INTEGER = 0,
-    WORD_REAL    = 1,
-    WORD_STRING  = 2
-};
+void eval_word(const char ** source_begin, 
+               const char * source_end, command_stack & command)
+{
+    eval_word<command_stack>(source_begin, source_end, command);
+}
 
+void eval_string(const char ** source_begin, 
+                 const char * source_end, command_stack & command)
+{
+    eval_string<command_stack>(source_begin, source_end, command);
+}
 
-static void throw_unexpected(char c, const char * where)
+void eval_symbol(const char ** source_begin, 
+                 const char * source_end,
+                 command_stack & command)
 {
-    char buf[2];
-    buf[0] = c;
-    buf[1] = '\0';
-    
-    const char * invalid_character = buf;
-    
-    // Non-printable characters
-    std::string hex_representation;
-    if(c < 40 || c > 176)
-    {
-        std::stringstream format;
-        format<<"\\x"<<std::hex<<static_cast<int>(c);
-        hex_representation = format.str();
-        invalid_character = hex_representation.c_str();
-    }
-    
-    switch(c)
-    {
-        case '\0': invalid_character = "\\0"; break;
-        case '\a': invalid_character = "\\a"; break;
-        case '\b': invalid_character = "\\b"; break;
-        case '\t': invalid_character = "\\t"; break;
-        case '\n': invalid_character = "\\n"; break;
-        case '\f': invalid_character = "\\f"; break;
-        case '\r': invalid_character = "\\r"; break;
-        case '\"': invalid_character = "\\\""; break;
-        default:;
-    }
-    
-    std::stringstream format;
-    format<<"unexpected '"<<invalid_character<<"' in "<<where;
-    throw parse_error(format.str());
+    eval_symbol<command_stack>(source_begin, source_end, command);
 }
 
-void eval_word(const char ** source_begin, 
-               const char * source_end, command_stack & command)
+void eval_comment(const char ** source_begin, 
+                  const char * source_end,
+                  command_stack & command)
 {
-    const char * start = *source_begin;
-    word_type type = WORD_INTEGER;
-    
-    for(const char * cursor = start; cursor != source_end; cursor++)
-    {
-        char c = *cursor;
-        expression::token_id token_id = 
-            expression::symbols[static_cast<std::size_t>(c)];
-        
-        if(token_id != expression::CHAR && c != '/')
-        {
-            *source_begin = cursor - 1;
-            std::size_t length = cursor - start;
-            
-            if(token_id != expression::ERROR && cursor != start) 
-            {
-                switch(type)
-                {
-                    case WORD_INTEGER:
-                    {
-                        float n;
-                        std::sscanf(start, "%f", &n);
-                        command.push_argument(static_cast<int>(n));
-                        break;
-                    }
-                    case WORD_REAL:
-                    {
-                        float n;
-                        std::sscanf(start, "%f", &n);
-                        command.push_argument(n);
-                        break;
-                    }
-                    case WORD_STRING:
-                        command.push_argument(start, length);
-                        break;
-                }
-                
-                return;
-            }
-            else
-            {
-                *source_begin = cursor;
-                throw_unexpected(c, "word");
-            }
-        }
-        
-        if(type != WORD_STRING && !(c >= '0' && c <= '9') && c != '-' &&
-          (cursor == *source_begin || c != 'e'))
-        {
-            if(c == '.') type = WORD_REAL;
-            else type = WORD_STRING;
-        }
-    }
-    
-    *source_begin = source_end;
-    throw parse_incomplete();
+    eval_comment<command_stack>(source_begin, source_end, command);
 }
 
-static std::string decode_string(const char ** begin, const char * end, 
-                              const std::vector<const char *> & escape_sequence)
+parser::parser(std::size_t max_depth)
+ :m_max_depth(max_depth)
 {
-    const char * start = *begin;
-    
-    std::string result;
-    result.reserve(end - start);
-    
-    result.append(start, escape_sequence[0]);
+    m_frames.reserve(INITIAL_FRAMES);
+}
+
+eval_status parser::parse(const char ** source_begin, 
+                          const char * source_end, 
+                          command_stack & command)
+{
+    eval_status status;
+    const char * resume = NULL;
     
-    typedef std::vector<const char *>::const_iterator iterator;
-    for(iterator iter = escape_sequence.begin(); iter != escape_sequence.end();
-        iter++)
+    try
     {
-        assert(*iter != end);
-        
-        const char * escape = *iter;
+        bool success = true;
         
-        switch(*(escape + 1))
+        if(!m_frames.empty())
         {
-            case '\"': result.append(1, '\"'); break; 
-            case '\\': result.append(1, '\\'); break; 
-            case 'n':  result.append(1, '\n'); break; 
-            case 'r':  result.append(1, '\r'); break; 
-            case 't':  result.append(1, '\t'); break; 
-            case 'f':  result.append(1, '\f'); break; 
-            case 'b':  result.append(1, '\b'); break;
+            success = run(*source_begin, source_begin, source_end, command, 
+                          status, &resume, false);
         }
         
-        const char * sub_end = end;
-        if(iter + 1 != escape_sequence.end())
-            sub_end = *(iter + 1);
-        
-        result.append(escape + 2, sub_end);
-    }
-    
-    return result;
-}
-
-void eval_string(const char ** source_begin, 
-                 const char * source_end, command_stack & command)
-{
-    assert(**source_begin == '"');
-    const char * start = (*source_begin) + 1;
-    *source_begin = start;
-    
-    std::vector<const char *> escape_sequence;
-    
-    for(const char * cursor = start; cursor != source_end; cursor++)
-    {
-        char c = *cursor;
-        switch(c)
+        while(success && *source_begin < source_end)
         {
-            case '"':
-                if(escape_sequence.size())
-                {
-                    std::string string = decode_string(source_begin, cursor,
-                                                       escape_sequence);
-                    command.push_argument(string.c_str(), string.length());
-                }
-                else
-                {
-                    std::size_t length = cursor - start;
-                    command.push_argument(start, length);
-                }
-                
-                *source_begin = cursor;
-                return;
-            case '\\':
-            case '^':
-                escape_sequence.push_back(cursor);
-                cursor++;
-                break;
-            case '\r':
-            case '\n':
-                *source_begin = cursor;
-               throw parse_error("unfinished string");
-            default:break;
+            success = push_frame(frame::EXPRESSION, *source_begin, command, 
+                                 status) &&
+                      run(*source_begin, source_begin, source_end, command, 
+                          status, &resume, false);
         }
-    }
-    
-    *source_begin = source_end;
-    throw parse_incomplete();
-}
-
-static
-void eval_interpolation_symbol(const char ** source_begin, 
-                               const char * source_end, command_stack & command)
-{
-    const char * start = *source_begin;
-    const char * cursor = start;
-    
-    for(; cursor != source_end; cursor++)
-    {
-        expression::token_id token_id = 
-            expression::symbols[static_cast<std::size_t>(*cursor)];
         
-        if(token_id != expression::CHAR)
+        if(!success)
         {
-            if(token_id != expression::ERROR) break;
-            else
+            // The code can be continued with more input unless it ended in an
+            // interpolated expression, where the end is a closing bracket.
+            if(status.error == eval_status::INCOMPLETE && 
+               m_interpolations.empty())
             {
-                *source_begin = cursor;
-                throw_unexpected(*cursor, "interpolation symbol");
+                *source_begin = resume;
             }
+            else reset();
         }
     }
+    catch(...)
+    {
+        reset();
+        throw;
+    }
     
-    std::size_t length = cursor - start;
-    command.push_argument_symbol(start, length);
-    
-    *source_begin = cursor - 1;
+    return status;
 }
 
-static 
-void eval_interpolation_string(const char ** begin, const char * end,
-                               const std::vector<const char *> & interpolations, 
-                               command_stack & command)
+void parser::reset()
 {
-    const char * start = *begin;
-    
-    std::size_t cmd_index = command.push_command();
-    command.push_argument_symbol("@", 1);
-    
-    std::size_t length = interpolations[0] - start;
-    if(length) command.push_argument(start, length);
-    
-    typedef std::vector<const char *>::const_iterator iterator;
-    for(iterator iter = interpolations.begin(); iter != interpolations.end();
-        iter++)
-    {
-        const char * cursor = *iter;
-        
-        for(; *cursor == '@' && cursor != end; cursor++);
-        
-        if(*cursor == '(') eval_expression(&cursor, end, command, true);
-        else eval_interpolation_symbol(&cursor, end, command);
-        
-        if(cursor + 1 < end)
-        {
-            const char * sub_end = end;
-            if(iter + 1 != interpolations.end())
-                sub_end = *(iter + 1);
-            
-            cursor++;
-            length = sub_end - cursor;
-            if(length) command.push_argument(cursor, length);
-        }
-    }
-    
-    command.call(cmd_index);
+    m_frames.clear();
+    m_interpolations.clear();
 }
 
-void eval_multiline_string(const char ** source_begin,
-                           const char * source_end,
-                           command_stack & command)
+std::size_t parser::depth()const
 {
-    assert(**source_begin == '[');
-    const char * start = (*source_begin) + 1;
-    *source_begin = start;
-    
-    std::vector<const char *> interpolations;
-    int nested = 1;
-    
-    for(const char * cursor = start; cursor != source_end; cursor++)
-    {
-        char c = *cursor;
-        
-        switch(c)
-        {
-            case '[':
-                nested++;
-                break;
-            case ']':
-                if(--nested == 0)
-                {
-                    if(interpolations.size())
-                    {
-                        eval_interpolation_string(
-                            source_begin, 
-                            cursor,
-                            interpolations,
-                            command);
-                    }
-                    else 
-                    {
-                        std::size_t length = cursor - start;
-                        command.push_argument(start, length);
-                    }
-                    
-                    *source_begin = cursor;
-                    return;
-                }
-                break;
-            case '@':
-            {
-                const char * first_at = cursor;
-                for(; *cursor == '@' && cursor != source_end; cursor++);
-                if(cursor - first_at >= nested)
-                    interpolations.push_back(first_at);
-                cursor--;
-                break;
-            }
-            default:;
-        }
-    }
-    
-    *source_begin = source_end;
-    throw parse_incomplete();
+    return m_frames.size();
 }
 
-void eval_symbol(const char ** source_begin, 
-                 const char * source_end,
-                 command_stack & command)
+std::size_t parser::max_depth()const
 {
-    const char * start = *source_begin;
-    if(*start == '$') *source_begin = ++start;
-    
-    for(const char * cursor = start; cursor != source_end; cursor++)
-    {
-        expression::token_id token_id = 
-            expression::symbols[static_cast<std::size_t>(*cursor)];
-        
-        if(token_id != expression::CHAR)
-        {
-            *source_begin = cursor - 1;
-            if(token_id != expression::ERROR)
-            {
-                std::size_t length = cursor - start;
-                command.push_argument_symbol(start, length);
-                return;
-            }
-            else
-            {
-                *source_begin = cursor;
-                throw_unexpected(*cursor, "symbol");
-            }
-        }
-    }
-    
-    *source_begin = source_end;
-    
-    throw parse_incomplete();
+    return m_max_depth;
 }
 
-void eval_comment(const char ** source_begin, 
-                  const char * source_end,
-                  command_stack & command)
+void parser::set_max_depth(std::size_t max_depth)
 {
-    assert(**source_begin == '/' || **source_begin == '#');
-    const char * start = (*source_begin) + 1;
-    *source_begin = start;
-    
-    start++; // Ignore second slash character
-    
-    for(const char * cursor = start; cursor != source_end; cursor++)
-    {
-        expression::token_id token_id = 
-            expression::symbols[static_cast<std::size_t>(*cursor)];
-        
-        if(token_id == expression::END_ROOT_EXPRESSION)
-        {
-            *source_begin = cursor - 1;
-            return;
-        }
-    }
-    
-    *source_begin = source_end;
-    
-    throw parse_incomplete();
+    m_max_depth = max_depth;
+}
+
+void eval_multiline_string(const char ** source_begin,
+                           const char * source_end,
+                           command_stack & command)
+{
+    eval_multiline_string<command_stack>(source_begin, source_end, command);
 }
 
 void eval_expression(const char ** source_begin, 
@@ -459,100 +171,85 @@ void eval_expression(const char ** source_begin,
                      command_stack & command,
                      bool is_sub_expression)
 {
-    const char * start = *source_begin;
+    eval_expression<command_stack>(source_begin, source_end, command, 
+                                   is_sub_expression);
+}
+
+eval_status try_eval(const char ** source_begin, 
+                     const char * source_end, 
+                     command_stack & stack)
+{
+    return try_eval<command_stack>(source_begin, source_end, stack);
+}
+
+void eval(const char ** source_begin, 
+          const char * source_end, 
+          command_stack & stack)
+{
+    eval<command_stack>(source_begin, source_end, stack);
+}
+
+eval_status::eval_status()
+ :error(OK), position(NULL), character('\0'), context(NULL)
+{
     
-    if(is_sub_expression)
+}
+
+std::string eval_status::message()const
+{
+    switch(error)
     {
-        assert(*start == '(');
-        start++;
+        case OK: return "";
+        case INCOMPLETE: return "unterminated syntax";
+        case UNFINISHED_STRING: return "unfinished string";
+        case NESTING_TOO_DEEP: return "expressions nested too deeply";
+        default:;
     }
     
-    std::size_t call_index = command.push_command();
+    char c = character;
+    
+    char buf[2];
+    buf[0] = c;
+    buf[1] = '\0';
     
-    bool first_argument = true;
+    const char * invalid_character = buf;
     
-    for(const char * cursor = start; cursor != source_end; cursor++)
+    // Non-printable characters
+    std::string hex_representation;
+    if(c < 40 || c > 176)
     {
-        char c = *cursor;
-        expression::token_id token_id = 
-            expression::symbols[static_cast<std::size_t>(c)];
-        
-        switch(token_id)
-        {
-            case expression::WHITESPACE:
-                // Do nothing
-                break;
-            case expression::END_EXPRESSION:
-            {
-                *source_begin = cursor;
-                if(!is_sub_expression) throw_unexpected(')', "expression");
-                command.call(call_index);
-                return;
-            }
-            case expression::END_ROOT_EXPRESSION:
-            {
-                if(is_sub_expression)
-                {
-                    if(c == ';') throw_unexpected(';', "expression");
-                    break; // Allow new lines in sub expressions
-                }
-                
-                *source_begin = cursor + 1;
-                command.call(call_index);
-                return;
-            }
-            case expression::START_EXPRESSION:
-            {
-                eval_expression(&cursor, source_end, command, true);
-                first_argument = false;
-                break;
-            }
-            case expression::START_SYMBOL:
-            {
-                eval_symbol(&cursor, source_end, command);
-                first_argument = false;
-                break;
-            }
-            case expression::START_END_STRING:
-            {
-                eval_string(&cursor, source_end, command);
-                first_argument = false;
-                break;
-            }
-            case expression::START_MULTILINE_STRING:
-            {
-                eval_multiline_string(&cursor, source_end, command);
-                first_argument = false;
-                break;
-            }
-            case expression::CHAR:
-            {
-                if(!first_argument) eval_word(&cursor, source_end, command);
-                else eval_symbol(&cursor, source_end, command);
-                first_argument = false;
-                break;
-            }
-            case expression::START_COMMENT:
-            {
-                eval_comment(&cursor, source_end, command);
-                break;
-            }
-            case expression::ERROR:
-            default:
-                *source_begin = cursor;
-                throw_unexpected(c, "expression");
-        }
+        std::stringstream format;
+        format<<"\\x"<<std::hex<<static_cast<int>(c);
+        hex_representation = format.str();
+        invalid_character = hex_representation.c_str();
     }
     
-    throw parse_incomplete();
+    switch(c)
+    {
+        case '\0': invalid_character = "\\0"; break;
+        case '\a': invalid_character = "\\a"; break;
+        case '\b': invalid_character = "\\b"; break;
+        case '\t': invalid_character = "\\t"; break;
+        case '\n': invalid_character = "\\n"; break;
+        case '\f': invalid_character = "\\f"; break;
+        case '\r': invalid_character = "\\r"; break;
+        case '\"': invalid_character = "\\\""; break;
+        default:;
+    }
+    
+    std::stringstream format;
+    format<<"unexpected '"<<invalid_character<<"' in "<<context;
+    return format.str();
 }
 
-void eval(const char ** source_begin, 
-          const char * source_end, 
-          command_stack & stack)
+void eval_status::throw_exception()const
 {
-    while(*source_begin < source_end)
-        eval_expression(source_begin, source_end, stack);
+    switch(error)
+    {
+        case OK: return;
+        case INCOMPLETE: throw parse_incomplete();
+        default: throw parse_error(message());
+    }
 }
 
 eval_error::eval_error(const std::string & what)
@@ -581,34 +278,151 @@ command_error::command_error(const std::string & what)
 
 bool is_complete_code(const char * start, const char * end)
 {
-    class null_command_stack:public command_stack
-    {
-    public:
-        virtual std::size_t push_command(){return 0;}
-        virtual void push_argument_symbol(const char *, std::size_t){}
-        virtual void push_argument(){}
-        virtual void push_argument(bool){}
-        virtual void push_argument(int){}
-        virtual void push_argument(float){}
-        virtual void push_argument(const char *, std::size_t){}
-        virtual std::string pop_string(){return "";}
-        virtual void call(std::size_t){}
-    };
+    code_scanner scanner;
+    return scanner.feed(start, end);
+}
+
+code_scanner::code_scanner()
+{
+    reset();
+}
+
+void code_scanner::reset()
+{
+    m_state = EXPRESSION;
+    m_depth = 0;
+    m_multiline_nesting = 0;
+    m_first_argument = true;
+    m_end_of_expression = true;
+    m_error = false;
+}
+
+bool code_scanner::is_complete()const
+{
+    return m_error || (m_state == EXPRESSION && m_depth == 0 && 
+        m_end_of_expression);
+}
+
+bool code_scanner::feed(const char * start, const char * end)
+{
+    // The state transitions follow the control flow of eval_expression and the
+    // token functions it calls
     
-    try
-    {
-        null_command_stack null_command;
-        eval(&start, end, null_command);
-    }
-    catch(parse_incomplete)
-    {
-        return false;
-    }
-    catch(eval_error)
+    for(const char * cursor = start; cursor != end && !m_error; cursor++)
     {
-        // Let other types of errors be caught by the real evaluator
+        char c = *cursor;
+        expression::token_id token_id = 
+            expression::symbols[static_cast<unsigned char>(c)];
+        
+        m_end_of_expression = false;
+        
+        switch(m_state)
+        {
+            case SYMBOL:
+            case WORD:
+                if(token_id == expression::CHAR || (m_state == WORD && c == '/')) 
+                    break;
+                if(token_id == expression::ERROR)
+                {
+                    m_error = true;
+                    break;
+                }
+                m_state = EXPRESSION;
+                // Fall through to handle the character that ended the token
+            case EXPRESSION:
+                switch(token_id)
+                {
+                    case expression::WHITESPACE:
+                        break;
+                    case expression::END_EXPRESSION:
+                        if(m_depth == 0) m_error = true;
+                        else m_depth--;
+                        m_first_argument = false;
+                        break;
+                    case expression::END_ROOT_EXPRESSION:
+                        if(m_depth)
+                        {
+                            if(c == ';') m_error = true;
+                            break;
+                        }
+                        m_first_argument = true;
+                        m_end_of_expression = true;
+                        break;
+                    case expression::START_EXPRESSION:
+                        m_depth++;
+                        m_first_argument = true;
+                        break;
+                    case expression::START_SYMBOL:
+                        m_state = SYMBOL;
+                        m_first_argument = false;
+                        break;
+                    case expression::START_END_STRING:
+                        m_state = STRING;
+                        m_first_argument = false;
+                        break;
+                    case expression::START_MULTILINE_STRING:
+                        m_state = MULTILINE_STRING;
+                        m_multiline_nesting = 1;
+                        m_first_argument = false;
+                        break;
+                    case expression::CHAR:
+                        m_state = (m_first_argument ? SYMBOL : WORD);
+                        m_first_argument = false;
+                        break;
+                    case expression::START_COMMENT:
+                        m_state = COMMENT_START;
+                        break;
+                    default:
+                        m_error = true;
+                }
+                break;
+            case STRING:
+                cursor = scan::string_special(cursor, end);
+                if(cursor == end)
+                {
+                    cursor--;
+                    break;
+                }
+                switch(*cursor)
+                {
+                    case '"': m_state = EXPRESSION; break;
+                    case '\\':
+                    case '^': m_state = STRING_ESCAPE; break;
+                    default: m_error = true; // New line in string
+                }
+                break;
+            case STRING_ESCAPE:
+                m_state = STRING;
+                break;
+            case MULTILINE_STRING:
+                cursor = scan::multiline_special(cursor, end);
+                if(cursor == end)
+                {
+                    cursor--;
+                    break;
+                }
+                if(*cursor == '[') m_multiline_nesting++;
+                else if(*cursor == ']' && --m_multiline_nesting == 0)
+                    m_state = EXPRESSION;
+                break;
+            case COMMENT_START:
+                // The character after the comment symbol is skipped
+                m_state = COMMENT;
+                break;
+            case COMMENT:
+                cursor = scan::comment_end(cursor, end);
+                if(cursor == end)
+                {
+                    cursor--;
+                    break;
+                }
+                m_state = EXPRESSION;
+                cursor--; // Let the expression state handle the end of line
+                break;
+        }
     }
-    return true;
+    
+    return is_complete();
 }
 
 } //namespace cubescript
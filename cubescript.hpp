@@ -24,6 +24,7 @@
 
 #include <cstddef>
 #include <string>
+#include <vector>
 #include <stdexcept>
 
 namespace cubescript{
@@ -34,7 +35,8 @@ namespace cubescript{
     represented is left up to the implementation of a derived class. The
     cubescript::eval function uses the command_stack class to construct and
     invoke a function call without caring what host language or environment
-    it's working on.
+    it's working on. The templates in eval.hpp accept any class with the same
+    methods, for calling the methods without virtual dispatch.
     
     Any of the methods in this class may throw an eval_error exception.
 */
@@ -78,6 +80,18 @@ public:
     */
     virtual void push_argument(float)=0;
     
+    /**
+        Push a 64-bit integer value at the top of the stack. The parser uses 
+        this for integer literals outside the range of int.
+    */
+    virtual void push_argument(long long)=0;
+    
+    /**
+        Push a double precision real value at the top of the stack. The parser
+        uses this for real number literals.
+    */
+    virtual void push_argument(double)=0;
+    
     /**
         Push a string value at the top of the stack
     */
@@ -118,6 +132,59 @@ void eval_expression(const char **, const char *, command_stack &,
 */
 bool is_complete_code(const char * start, const char * end);
 
+/**
+    Incremental version of is_complete_code(). Input is fed in chunks, as it is
+    read from a file or terminal, and each byte is scanned only once, so 
+    checking the code after every new line costs time proportional to the size 
+    of the line rather than the size of the code read so far.
+    
+    The scanner only tracks the syntax needed to find where expressions end; 
+    it doesn't evaluate anything. When an error is found the code is reported 
+    as complete, so that eval() can be called to report the error.
+*/
+class code_scanner
+{
+public:
+    code_scanner();
+    
+    /**
+        Scan the next chunk of input.
+        
+        @return The value of is_complete() after scanning the chunk.
+    */
+    bool feed(const char * start, const char * end);
+    
+    /**
+        Return true if all the input fed since the last reset is complete
+        code, ending at the end of a root expression, or if it has an error.
+    */
+    bool is_complete()const;
+    
+    /**
+        Start scanning a new piece of code.
+    */
+    void reset();
+private:
+    enum state
+    {
+        EXPRESSION = 0,
+        SYMBOL,
+        WORD,
+        STRING,
+        STRING_ESCAPE,
+        MULTILINE_STRING,
+        COMMENT_START,
+        COMMENT
+    };
+    
+    state m_state;
+    std::size_t m_depth;
+    std::size_t m_multiline_nesting;
+    bool m_first_argument;
+    bool m_end_of_expression;
+    bool m_error;
+};
+
 /**
     Evaluate the input string as Cubescript code. Each expression in the code
     is turned into a function call and applied to the command_stack object. 
@@ -129,6 +196,157 @@ bool is_complete_code(const char * start, const char * end);
 */
 void eval(const char **, const char *, command_stack &);
 
+/**
+    The result of a call to try_eval(). Parse errors are reported as a value
+    instead of being thrown, so callers that expect to see incomplete or
+    invalid code often (i.e. interactive input) don't pay for an exception.
+*/
+class eval_status
+{
+public:
+    enum error_kind
+    {
+        OK = 0,
+        INCOMPLETE,
+        UNEXPECTED_CHARACTER,
+        UNFINISHED_STRING,
+        NESTING_TOO_DEEP
+    };
+    
+    eval_status();
+    
+    /**
+        Return the error message that eval() would use for the parse_error
+        exception, or an empty string if there was no error.
+    */
+    std::string message()const;
+    
+    /**
+        Throw the exception that eval() would have thrown for this error.
+    */
+    void throw_exception()const;
+    
+    error_kind error;
+    
+    /**
+        Position in the source code where the error was found.
+    */
+    const char * position;
+    
+    /**
+        The unexpected character or the character that ended a string.
+    */
+    char character;
+    
+    /**
+        Name of the syntax element that was being parsed when an unexpected
+        character was found.
+    */
+    const char * context;
+};
+
+/**
+    Evaluate the input string as Cubescript code, with the same effect on the
+    command_stack object and source pointer as eval(). Parse errors are
+    returned in the status object; errors in the command stack operations 
+    are still thrown as exceptions. Code nested deeper than
+    parser::DEFAULT_MAX_DEPTH is reported as a NESTING_TOO_DEEP error.
+*/
+eval_status try_eval(const char **, const char *, command_stack &);
+
+/**
+    Cubescript parser that keeps unfinished expressions on a stack of its own
+    instead of the native call stack. The nesting depth is bounded by a limit
+    set on the parser, and a parse that runs out of input can be continued
+    when more input is available.
+    
+    eval() and try_eval() use a parser with the default depth limit.
+*/
+class parser
+{
+public:
+    static const std::size_t DEFAULT_MAX_DEPTH = 1024;
+    
+    parser(std::size_t max_depth = DEFAULT_MAX_DEPTH);
+    
+    /**
+        Evaluate the input string as Cubescript code, applying each expression
+        to the command_stack object in the same way as eval().
+        
+        If the input ends in the middle of an expression the status is
+        INCOMPLETE and the source pointer is moved to the start of the
+        unfinished token. The next call continues the expression, using the
+        input from that point onwards followed by any new input. Arguments
+        already pushed for the unfinished expression stay on the command
+        stack.
+        
+        The parser is reset after a parse error, after an exception is thrown
+        by the command stack, and when an interpolated expression is cut off
+        by the end of its multiline string (which more input can't complete).
+        depth() returns 0 in all of these cases.
+    */
+    eval_status parse(const char **, const char *, command_stack &);
+    
+    /**
+        Discard any unfinished expressions.
+    */
+    void reset();
+    
+    /**
+        Return the number of unfinished expressions.
+    */
+    std::size_t depth()const;
+    
+    std::size_t max_depth()const;
+    void set_max_depth(std::size_t);
+private:
+    template<class Stack> 
+    friend void eval_multiline_string(const char **, const char *, Stack &);
+    template<class Stack>
+    friend void eval_expression(const char **, const char *, Stack &, bool);
+    template<class Stack>
+    friend eval_status try_eval(const char **, const char *, Stack &);
+    
+    static const std::size_t INITIAL_FRAMES = 16;
+    
+    struct frame
+    {
+        enum frame_kind
+        {
+            EXPRESSION = 0,
+            SUB_EXPRESSION,
+            INTERPOLATION
+        };
+        
+        frame_kind kind;
+        bool first_argument;
+        std::size_t call_index;
+        
+        // Position of the frame's interpolations in m_interpolations. While
+        // the frame is on top of the stack, the last element is the closing
+        // bracket of the multiline string.
+        std::size_t first_interpolation;
+        std::size_t next_interpolation;
+    };
+    
+    // Defined in eval.hpp
+    template<class Stack>
+    bool push_frame(frame::frame_kind, const char *, Stack &, eval_status &);
+    template<class Stack>
+    bool eval_multiline_string(const char **, const char *, Stack &,
+                               eval_status &);
+    template<class Stack>
+    void end_interpolation(frame &, const char *, const char *, Stack &);
+    static bool suspend(frame &, bool, const char *, const char **);
+    template<class Stack>
+    bool run(const char *, const char **, const char *, Stack &, 
+             eval_status &, const char **, bool);
+    
+    std::vector<frame> m_frames;
+    std::vector<const char *> m_interpolations;
+    std::size_t m_max_depth;
+};
+
 class eval_error:public std::runtime_error
 {
 public:
@@ -23,16 +23,6 @@
 local env = {}
 setmetatable(env, {__index = _G})
 
--- Private utility functions
-
-local function parse_array(input_string)
-    local result = {}
-    for value in string.gmatch(input_string, "[%w_]+") do
-       result[#result + 1] = value 
-    end
-    return result
-end
-
 -- Values
 
 env["false"] = function() return false end
@@ -43,14 +33,20 @@ env["_false"] = env["false"]
 env["_true"] = env["true"]
 env["_nil"] = env["nil"]
 
+-- The arithmetic, comparison and logic commands are C functions
+-- (lua_operators.cpp) that handle numbers and strings without allocating.
+-- They call the Lua functions given here for other types of arguments.
+
+local operator = cubescript.operator
+
 -- Comparison
 
-env["="] = function(a, b) return a == b end
-env["!="] = function(a, b) return a ~= b end
-env["<"] = function(a, b) return a < b end
-env["<="] = function(a, b) return a <= b end
-env[">"] = function(a, b) return a > b end
-env[">="] = function(a, b) return a >= b end
+env["="] = operator("=")
+env["!="] = operator("!=")
+env["<"] = operator("<", function(a, b) return a < b end)
+env["<="] = operator("<=", function(a, b) return a <= b end)
+env[">"] = operator(">", function(a, b) return a > b end)
+env[">="] = operator(">=", function(a, b) return a >= b end)
 
 env["equal"] = env["="]
 env["not_equal"] = env["!="]
@@ -61,9 +57,9 @@ env["greater_than_or_equal"] = env[">="]
 
 -- Boolean logic
 
-env["!"] = function(a) return not a end
-env["||"] = function(a, b) return a or b end
-env["&&"] = function(a, b) return a and b end
+env["!"] = operator("!")
+env["||"] = operator("||")
+env["&&"] = operator("&&")
 
 env["_not"] = env["!"]
 env["_or"] = env["||"]
@@ -81,13 +77,17 @@ local function generic_arithmetic(binary_function)
     end
 end
 
-env["+"] = generic_arithmetic(function(x, y) return x + (y or 0) end)
-env["-"] = generic_arithmetic(function(x, y) return x - (y or 2*x) end)
-env["*"] = generic_arithmetic(function(x, y) return x * (y or 1) end)
-env["div"] = generic_arithmetic(function(x, y) return x / (y or 1) end)
-env["mod"] = function(x, y) return x % y end
-env["max"] = math.max
-env["min"] = math.min
+env["+"] = operator("+", 
+    generic_arithmetic(function(x, y) return x + (y or 0) end))
+env["-"] = operator("-",
+    generic_arithmetic(function(x, y) return x - (y or 2*x) end))
+env["*"] = operator("*",
+    generic_arithmetic(function(x, y) return x * (y or 1) end))
+env["div"] = operator("div",
+    generic_arithmetic(function(x, y) return x / (y or 1) end))
+env["mod"] = operator("mod", function(x, y) return x % y end)
+env["max"] = operator("max", math.max)
+env["min"] = operator("min", math.min)
 env["rnd"] = function(n) return math.random(0, n) end
 
 env["add"] = env["+"]
@@ -100,94 +100,93 @@ env["array"] = function(...)
     return arg
 end
 
+-- List strings are parsed once into a list object (lua_list.cpp), which is
+-- cached for each string while it is in use. List objects index like arrays.
+
+local list = cubescript.list
+
 env["len"] = function(object) return #object end
-env["listlen"] = env["len"]
+
+env["listlen"] = function(object)
+    if type(object) == "string" then return #list(object) end
+    return #object
+end
 
 env["at"] = function(object, index)
     
     if type(object) == "string" then
-        return parse_array(object)[index]
+        return list(object)[index]
     end
     
     return object[index]
 end
 
--- String
-
-local function implode(pieces, glue)
-    glue = glue or ""
-    local output = ""
-    for i = 1, #pieces do
-        if i > 1 then
-            output = output .. glue
-        end
-        output = output .. tostring(pieces[i])
+env["listfind"] = function(object, value)
+    
+    if type(object) == "string" then
+        return list(object):find(value)
     end
-    return output
-end
-
-env["@"] = function(...)
-    return implode(arg)
-end
-
-env["substr"] = function(s, start, length)
-    if length == 0 then return "" end
-    return string.sub(s, start, start + length - 1)
+    
+    for i = 1, #object do
+        if object[i] == value then return i end
+    end
+    
+    return -1
 end
 
-env["strstr"] = function(s, substring)
-   local position = string.find(s, substring, 1, true)
-   if not position then return -1 end
-   return position - 1
+env["sortlist"] = function(object)
+    
+    if type(object) ~= "table" then
+        return list(object):sorted()
+    end
+    
+    local sorted = {unpack(object)}
+    table.sort(sorted)
+    return sorted
 end
 
-env["strreplace"] = function(s, find, replacement)
-
-    local output = ""
+-- A list string or list object with a Lua array of elements (or the other
+-- way round) is handled in Lua, indexing the list object like an array. The
+-- result is the same kind as the object.
+env["listdel"] = function(object, elements)
     
-    local find_length = #find
+    local is_list = type(object) ~= "table"
     
-    local start_position = 1
-    local insert_position = string.find(s, find, 1, true)
-
-    while insert_position do
-        
-        output = output .. 
-                 string.sub(s, start_position, insert_position - 1) ..
-                 replacement
-        
-        start_position = insert_position + find_length
-        insert_position = string.find(s, find, start_position, true)
+    if is_list and type(elements) ~= "table" then
+        return list(object):remove(elements)
     end
     
-    output = output .. string.sub(s, start_position)
+    if is_list then object = list(object) end
+    if type(elements) ~= "table" then elements = list(elements) end
     
+    local removed = {}
+    for i = 1, #elements do removed[elements[i]] = true end
+    
+    local output = {}
+    for i = 1, #object do
+        if not removed[object[i]] then output[#output + 1] = object[i] end
+    end
+    
+    if is_list then return table.concat(output, " ") end
     return output
 end
 
-env["format"] = function(s, ...)
-    local output = string.gsub(s, "%%[%w_]+", function(id)
-        id = string.sub(id, 2)
-        local index = tonumber(id)
-        if index and arg[index] then
-            return arg[index]
-        else
-            if arg[1] and type(arg[1]) == "table" then
-                return arg[1][id] or ""
-            else
-                return ""
-            end
-        end
-    end)
-    return output
-end
+-- String
+
+-- The string commands are implemented in C++ (lua_string_library.cpp)
+
+env["@"] = cubescript.concatword
+env["substr"] = cubescript.substr
+env["strstr"] = cubescript.strstr
+env["strreplace"] = cubescript.strreplace
+env["format"] = cubescript.format
 
 env["strlen"] = string.len
 env["strcmp"] = env["="]
 env["strcat"] = env["@"]
 env["concatword"] = env["@"]
-env["concat"] = function(...) return implode(arg, " ") end
-env["implode"] = implode
+env["concat"] = cubescript.concat
+env["implode"] = cubescript.implode
 
 env["def"] = function(name, value)
    _G[name] = value
@@ -198,51 +197,407 @@ env["current_location"] = function()
     return "stdin"
 end
 
-local generate_expression_code, generate_code
+-- Optimisations made when function bodies are compiled (see
+-- lua_code_options in to_lua.hpp). Changes apply to bodies compiled
+-- afterwards; bodies already in the function cache keep their code.
+env["compiler_options"] = {
+    fold_constants = true,
+    eliminate_dead_branches = true,
+    hoist_globals = false,
+    inline_constants = true
+}
 
-local function make_function(parameters, body)
+-- Compiled code can be saved in the env.compile_cache_dir directory, so that
+-- later runs load it instead of compiling the source again: compiled .conf
+-- files (see compile_file) and the Lua bytecode of compiled function bodies.
+-- An entry is named by the hash and length of its source together with
+-- everything else the compiled code depends on, so an edited file or a new
+-- code generator uses a new entry and stale entries are never read; they can
+-- be deleted at any time. Lua doesn't verify bytecode, so the directory
+-- mustn't be writable by untrusted users. nil disables the cache.
+
+env["compile_cache_dir"] = nil
+
+local compile_cache = {
+    file_hits = 0,
+    file_misses = 0,
+    function_hits = 0,
+    function_misses = 0,
+    write_errors = 0
+}
+
+local function compile_cache_path(hash_source, suffix)
+    return string.format("%s/%s-%i%s", env.compile_cache_dir,
+        cubescript.hash(hash_source), #hash_source, suffix)
+end
+
+local function compile_cache_read(path)
+    local file = io.open(path, "rb")
+    if not file then return nil end
+    local data = file:read("*a")
+    file:close()
+    return data
+end
+
+-- The entry is written to a temporary file and renamed, so that another
+-- process reading the cache never sees a partly written entry.
+local function compile_cache_write(path, data)
+    local temporary_path = path .. "." .. cubescript.hash(tostring({}))
+    local file = io.open(temporary_path, "wb")
+    if file and file:write(data) and file:close() and 
+       os.rename(temporary_path, path) then
+        return
+    end
+    os.remove(temporary_path)
+    compile_cache.write_errors = compile_cache.write_errors + 1
+end
+
+local function compiler_options_key()
+    local options = {}
+    for name, value in pairs(env.compiler_options) do
+        options[#options + 1] = name .. "=" .. tostring(value)
+    end
+    table.sort(options)
+    return table.concat(options, " ")
+end
+
+env["compile_cache_stats"] = function()
+    return {
+        file_hits = compile_cache.file_hits,
+        file_misses = compile_cache.file_misses,
+        function_hits = compile_cache.function_hits,
+        function_misses = compile_cache.function_misses,
+        write_errors = compile_cache.write_errors
+    }
+end
+
+local function generate_function_code(parameters, body)
+    local lua_code, error_message = cubescript.to_lua(body, parameters,
+        env.compiler_options)
+    if not lua_code then error(error_message) end
+    return lua_code
+end
+
+-- Function bodies are kept in a least recently used cache, so that a body
+-- run many times (e.g. an if statement inside a loop) is only compiled once.
+-- The key includes the location for the chunk name used in error messages.
+
+local function_cache = {
+    entries = {},
+    size = 0,
+    newest = nil,
+    oldest = nil,
+    hits = 0,
+    misses = 0,
+    evictions = 0
+}
+
+local function function_cache_unlink(node)
     
-    if type(body) ~= "string" or (parameter and not body) then
-        return function() return body or parameter end
+    if node.newer then node.newer.older = node.older 
+    else function_cache.newest = node.older end
+    
+    if node.older then node.older.newer = node.newer 
+    else function_cache.oldest = node.newer end
+    
+    node.newer = nil
+    node.older = nil
+end
+
+local function function_cache_insert(node)
+    
+    node.older = function_cache.newest
+    
+    if function_cache.newest then function_cache.newest.newer = node end
+    function_cache.newest = node
+    
+    if not function_cache.oldest then function_cache.oldest = node end
+end
+
+local function function_cache_trim()
+    while function_cache.size > math.max(env.function_cache_capacity, 0) do
+        local oldest = function_cache.oldest
+        function_cache_unlink(oldest)
+        function_cache.entries[oldest.key] = nil
+        function_cache.size = function_cache.size - 1
+        function_cache.evictions = function_cache.evictions + 1
     end
+end
+
+local function function_cache_get(key)
     
-    local ast = {
-        {arguments = {
-                {value = "func", is_variable = true}, 
-                {value = parameters},
-                {value = body}
-            }
-        }
+    function_cache_trim()
+    
+    local node = function_cache.entries[key]
+    
+    if not node then
+        function_cache.misses = function_cache.misses + 1
+        return nil
+    end
+    
+    function_cache.hits = function_cache.hits + 1
+    
+    if node ~= function_cache.newest then
+        function_cache_unlink(node)
+        function_cache_insert(node)
+    end
+    
+    return node.value
+end
+
+local function function_cache_put(key, value)
+    
+    local node = {key = key, value = value}
+    function_cache.entries[key] = node
+    function_cache_insert(node)
+    function_cache.size = function_cache.size + 1
+    
+    function_cache_trim()
+end
+
+env["function_cache_capacity"] = 256
+
+env["function_cache_stats"] = function()
+    return {
+        size = function_cache.size,
+        hits = function_cache.hits,
+        misses = function_cache.misses,
+        evictions = function_cache.evictions
     }
+end
+
+-- Bodies start out interpreted: the source is compiled into a
+-- compiled_program (see cubescript.compile), and each call replays it with
+-- cubescript.eval, which is cheaper than generating and loading Lua code for
+-- a body that only runs a few times. The program is kept in the body's record
+-- in the function cache until the body is promoted. A body called more than
+-- env.function_tier_threshold times is compiled, and from then on
+-- make_function returns the compiled function. env.function_tiers() lists
+-- the cached bodies with their tier, the number of functions made from them
+-- (uses) and the number of interpreted calls (calls). Bodies using commands that
+-- the code generator translates into Lua syntax are always compiled, because
+-- the Lua code behaves differently from the command: def declares a local,
+-- (< 1 2 3) compares every argument, if tests its condition without
+-- evaluating it as code and runs its branches in the function's scope.
+
+env["function_tier_threshold"] = 8
+
+local compiled_only_names = {
+    ["def"] = true,
+    ["return"] = true,
+    ["_return"] = true,
+    ["loop"] = true,
+    ["func"] = true,
+    ["if"] = true,
+    ["_if"] = true,
+    ["&&"] = true,
+    ["||"] = true,
+    ["_and"] = true,
+    ["_or"] = true,
+    ["!"] = true,
+    ["_not"] = true,
+    ["="] = true,
+    ["!="] = true,
+    ["<"] = true,
+    ["<="] = true,
+    [">"] = true,
+    [">="] = true,
+    ["equal"] = true,
+    ["not_equal"] = true,
+    ["less_than"] = true,
+    ["less_than_or_equal"] = true,
+    ["greater_than"] = true,
+    ["greater_than_or_equal"] = true,
+    ["+"] = true,
+    ["-"] = true,
+    ["*"] = true,
+    ["add"] = true,
+    ["sub"] = true,
+    ["mul"] = true,
+    ["div"] = true
+}
+
+-- A body with a parse error is compiled too: cubescript.eval raises the
+-- error, but the code generator translates the expressions read up to it.
+local function make_interpretable(record)
+    for name in string.gmatch(record.body, "[^%s%[%]%(%);\"]+") do
+        if compiled_only_names[name] then return false end
+    end
+    local program, parse_error = cubescript.compile(record.source)
+    if parse_error then return false end
+    record.program = program
+    return true
+end
+
+local function compile_function_body(record)
     
-    local lua_code = generate_code(ast)
+    local chunk_name = "function defined at " .. record.location
+    
+    local cache_path
+    if env.compile_cache_dir then
+        
+        cache_path = compile_cache_path(table.concat({
+            cubescript.lua_code_version(), compiler_options_key(), 
+            chunk_name, record.parameters, record.body}, "\0"), ".luac")
+        
+        -- Only binary chunks are loaded, starting with the escape character
+        local bytecode = compile_cache_read(cache_path)
+        local create_lua_function = bytecode and 
+            string.byte(bytecode) == 27 and 
+            loadstring(bytecode, chunk_name)
+        
+        if create_lua_function then
+            compile_cache.function_hits = compile_cache.function_hits + 1
+            record.create_lua_function = create_lua_function
+            record.tier = "compiled"
+            record.program = nil
+            return
+        end
+        
+        compile_cache.function_misses = compile_cache.function_misses + 1
+    end
+    
+    local lua_code = generate_function_code(record.parameters, record.body) .. "\n"
     
     local create_lua_function, error_message = loadstring("return " .. lua_code,
-        "function defined at " .. env.current_location())
+        chunk_name)
     if not create_lua_function then error(error_message) end
     
-    local func = create_lua_function()
+    if cache_path then
+        compile_cache_write(cache_path, string.dump(create_lua_function))
+    end
+    
+    record.create_lua_function = create_lua_function
+    record.tier = "compiled"
+    record.program = nil
+end
+
+local function create_compiled_function(record)
+    local func = record.create_lua_function()
     setfenv(func, env)
     return func
 end
 
+-- Parameters are bound in a scope table that falls back to env for other
+-- names. A parameter without an argument is nil, as it is in compiled code.
+local function create_interpreted_function(record)
+    
+    local parameter_names = {}
+    local is_parameter = {}
+    for name in string.gmatch(record.parameters, "[^%s]+") do
+        parameter_names[#parameter_names + 1] = name
+        is_parameter[name] = true
+    end
+    
+    local scope_metatable = {
+        __index = function(_, name)
+            if not is_parameter[name] then return env[name] end
+        end
+    }
+    
+    local compiled_function
+    
+    return function(...)
+        
+        if compiled_function then return compiled_function(...) end
+        
+        record.calls = record.calls + 1
+        
+        if record.tier == "interpreted" and 
+           record.calls > env.function_tier_threshold then
+            compile_function_body(record)
+        end
+        
+        if record.tier == "compiled" then
+            compiled_function = create_compiled_function(record)
+            return compiled_function(...)
+        end
+        
+        local scope = env
+        if #parameter_names > 0 then
+            scope = setmetatable({}, scope_metatable)
+            local arguments = {...}
+            for i, name in ipairs(parameter_names) do
+                rawset(scope, name, arguments[i])
+            end
+        end
+        
+        local error_message = cubescript.eval(record.program, scope)
+        if error_message then error(error_message, 0) end
+    end
+end
+
+local function make_function(parameters, body)
+    
+    if type(body) ~= "string" or (parameter and not body) then
+        return function() return body or parameter end
+    end
+    
+    local location = env.current_location()
+    
+    local parameter_list = parameters
+    if type(parameters) == "table" then
+        parameter_list = table.concat(parameters, " ")
+    end
+    parameter_list = tostring(parameter_list)
+    
+    local key = location .. "\0" .. parameter_list .. "\0" .. body
+    
+    local record = function_cache_get(key)
+    
+    if not record then
+        
+        record = {
+            location = location,
+            parameters = parameter_list,
+            body = body,
+            source = body .. "\n",
+            tier = "interpreted",
+            uses = 0,
+            calls = 0
+        }
+        
+        if env.function_tier_threshold <= 0 or 
+           not make_interpretable(record) then
+            compile_function_body(record)
+        end
+        
+        function_cache_put(key, record)
+    end
+    
+    record.uses = record.uses + 1
+    
+    if record.tier == "compiled" then
+        return create_compiled_function(record)
+    end
+    
+    return create_interpreted_function(record)
+end
+
+env["function_tiers"] = function()
+    local tiers = {}
+    local node = function_cache.newest
+    while node do
+        local record = node.value
+        tiers[#tiers + 1] = {
+            location = record.location,
+            parameters = record.parameters,
+            body = record.body,
+            tier = record.tier,
+            uses = record.uses,
+            calls = record.calls
+        }
+        node = node.older
+    end
+    return tiers
+end
+
 env["func"] = function(parameters, body)
     return make_function(parameters, body)
 end
 
 env["to_lua"] = function(parameters, body)
-
-    local ast = {
-        {arguments = {
-                {value = "func", is_variable = true}, 
-                {value = parameters},
-                {value = body}
-            }
-        }
-    }
-    
-    local lua_code = generate_code(ast)
-    return lua_code
+    return generate_function_code(parameters, body) .. "\n"
 end
 
 env["call"] = function(func, ...)
@@ -266,30 +621,40 @@ env["loop"] = function(counter_name, times, body)
     end
 end
 
-local function compatible_name(name)
+env["looplist"] = function(element_name, object, body)
     
-    local translate = {
-        ["false"]  = "_false",
-        ["true"]   = "_true",
-        ["nil"]    = "_nil",
-        ["="]      = "equal",
-        ["!="]     = "not_equal",
-        ["<"]      = "less_than",
-        ["<="]     = "less_than_or_equal",
-        [">"]      = "greater_than",
-        [">="]     = "greater_than_or_equal",
-        ["!"]      = "_not",
-        ["||"]     = "_or",
-        ["&&"]     = "_and",
-        ["+"]      = "add",
-        ["-"]      = "sub",
-        ["*"]      = "mul",
-        ["if"]     = "_if",
-        ["return"] = "_return",
-        ["@"]      = "strcat"
-    }
+    if type(object) == "string" then object = list(object) end
     
-    name = translate[name] or name
+    local body_function = make_function(element_name, body)
+    for i = 1, #object do
+        body_function(object[i])
+    end
+end
+
+local compatible_names = {
+    ["false"]  = "_false",
+    ["true"]   = "_true",
+    ["nil"]    = "_nil",
+    ["="]      = "equal",
+    ["!="]     = "not_equal",
+    ["<"]      = "less_than",
+    ["<="]     = "less_than_or_equal",
+    [">"]      = "greater_than",
+    [">="]     = "greater_than_or_equal",
+    ["!"]      = "_not",
+    ["||"]     = "_or",
+    ["&&"]     = "_and",
+    ["+"]      = "add",
+    ["-"]      = "sub",
+    ["*"]      = "mul",
+    ["if"]     = "_if",
+    ["return"] = "_return",
+    ["@"]      = "strcat"
+}
+
+local function compatible_name(name)
+    
+    name = compatible_names[name] or name
     
     if string.match(name, "[^%w_.]") then
          error("invalid name '" ..name .. "'")
@@ -300,331 +665,118 @@ end
 
 env["compatible_name"] = compatible_name
 
-local function create_ast(output)
-    
-    local node = output
-    local parent = {}
-    
-    return cubescript.command_stack({
-        
-        push_command = function()
-            node[#node + 1] = {arguments = {}}
-            parent[#parent + 1] = node
-            node = node[#node].arguments
-        end,
-        
-        push_argument_symbol = function(id)
-            node[#node + 1] = {value = id, is_variable = true}
-        end,
-        
-        push_argument = function(value)
-            node[#node + 1] = {value = value}
-        end,
-        
-        pop_string = function()
-            local value = node[#node].value
-            node[#node] = nil
-            return value
-        end,
-        
-        call = function(index)
-            node = parent[#parent]
-            parent[#parent] = nil
-        end
-    })
-end
+env["lua"] = dofile
 
-function generate_expression_code(input)
+-- The location is read from a table that exec_file updates before running
+-- each expression, so there is one location function for the whole file.
+local function execute_cubescript(filename)
     
-    local function generate_argument_code(input, index)
-        assert(input.arguments[index])
-        input.arguments[index].parent = input
-        -- FIXME .parent must always be reset to nil to avoid mem leak
-        local output = generate_expression_code(input.arguments[index])
-        input.arguments[index].parent = nil
-        return output
-    end
+    local location = {line = 1}
     
-    local function print_value(value)
-        if type(value) == "string" then
-            
-            value = string.gsub(value, "[%c\\\\\"]", function(char)
-                return "\\" .. string.byte(char)
-            end)
-            
-            return "\"" .. value .. "\""
-        else
-            return value
-        end
-    end
-    
-    if not input.arguments and input.value then
-        if input.is_variable then
-            return input.value
-        else
-            return print_value(input.value)
-        end
-    end
+    local old_current_location = env.current_location
     
-    for key, arg in pairs(input.arguments) do
-        if arg.is_variable then
-            input.arguments[key].value = compatible_name(arg.value)
-        end
+    env.current_location = function()
+        return filename .. ":" .. location.line
     end
     
-    local function native_value(v)
-        return function() return v end
-    end
+    local completed, error_message, line_number = cubescript.exec_file(
+        filename, env, location)
     
-    local function function_call(input)
-        local output = generate_argument_code(input, 1) .. "("
-        for i = 2, #input.arguments do
-            if i > 2 then output = output .. "," end
-            output = output .. generate_argument_code(input, i)
-        end
-        output = output .. ")"
-        return output
-    end
+    env.current_location = old_current_location
     
-    local function not_enough_args(input, n)
-        return #input.arguments -1 < n
-    end
+    if completed == nil then error(error_message) end
     
-    local function define_variable(input)
-        if input.parent or not_enough_args(input, 2) then
-            return function_call(input)
-        end
-        local output = "local "
-        output = output .. input.arguments[2].value
-        output = output .. "="
-        output = output .. generate_argument_code(input, 3)
-        return output
-    end
-    
-    local function arthmetic_operation(operator)
-        return function(input)
-        
-            if not_enough_args(input, 2) or not input.parent then
-                return function_call(input)
-            end
-            
-            local output = "("
-            output = output .. generate_argument_code(input, 2)
-            for i = 3, #input.arguments do
-               output = output .. " " .. operator .. " " 
-                        .. generate_argument_code(input, i)
-            end
-            output = output .. ")"
-            return output 
-        end
+    if not completed then
+        error({string.format("%s:%i: %s", 
+            filename, line_number, error_message)}, 0)
     end
+end
+
+-- The file is mapped into memory rather than read into a Lua string, and
+-- unmapped once it's compiled.
+local function map_cubescript_file(filename)
     
-    local function comparison_operation(operator)
-        return function(input)
-            
-            if not_enough_args(input, 2) or not input.parent then
-                return function_call(input)
-            end
-            
-            local output = "("
-            output = output .. generate_argument_code(input, 2)
-            output = output .. " " .. operator .. " " 
-                     .. generate_argument_code(input, 3)
-            for i = 4, #input.arguments do
-                output = output .. " and " 
-                    .. generate_argument_code(input, i) .. " " .. operator
-                    .. " " .. generate_argument_code(input, 2)
-            end
-            output = output .. ")"
-            return output
-        end
-    end
+    local code, error_message = cubescript.map_file(filename)
+    if not code then error(error_message) end
     
-    local function logic_operation(operator)
-        return function(input)
-            if not_enough_args(input, 2) or not input.parent then
-                return function_call(input)
-            end
-            return generate_argument_code(input, 2) 
-                .. " " .. operator .. " " .. generate_argument_code(input, 3)
-        end
-    end
+    return code
+end
+
+-- The compiled file is looked up by the hash of the source code, and saved
+-- on a miss. The image format version is checked by load_compiled_file.
+local function compile_cubescript_file(code)
     
-    local function not_operation(input)
-        if not_enough_args(input, 1) or not input.parent then
-            return function_call(input)
-        end
-        return "not " .. generate_argument_code(input, 2)
+    if not env.compile_cache_dir then
+        return cubescript.compile_file(code, env.exec_threads)
     end
     
-    local function return_statement(input)
-        if input.parent then
-            return "error(\"invalid return statement\")"
-        end
-        local output = "do return "
-        if input.arguments[2] then
-            output = output .. generate_argument_code(input, 2)
-        end
-        output = output .. " end"
-        return output
-    end
+    local cache_path = compile_cache_path(code, ".csfc")
     
-    local function if_statement(input)
-        
-        if input.parent or not_enough_args(input, 2) then
-            return function_call(input)
-        end
-        
-        local output = "if " 
-            .. generate_argument_code(input, 2) .. " then\n" 
-            .. generate_code(input.arguments[3].value)
-        
-        if input.arguments[4] then
-            output = output .. "else\n" 
-                     .. generate_code(input.arguments[4].value)
-        end
-        
-        output = output .. "end"
-        return output
-    end
+    local image = compile_cache_read(cache_path)
+    local chunks = image and cubescript.load_compiled_file(image)
     
-    local function loop(input)
-        
-        if not input.arguments[2].value or input.arguments[2].is_variable then
-           return function_call(input) 
-        end
-        
-        local output = "for " .. input.arguments[2].value 
-        output = output .. " = 0, " .. input.arguments[3].value .. " do\n"
-        output = output .. generate_code(input.arguments[4].value)
-        output = output .. "end"
-        return output
+    if chunks then
+        compile_cache.file_hits = compile_cache.file_hits + 1
+        return chunks
     end
     
-    function define_function(input)
-    
-        if not_enough_args(input, 2) or input.arguments[2].is_variable then
-            return function_call(input)
-        end
-        
-        local output = "function("
-        
-        local parameters = parse_array(input.arguments[2].value)
-        local first = true
-        for _, name in pairs(parameters) do
-            if not first then
-                output = output .. ","
-            else
-                first = false
-            end
-            output = output .. name
-        end
-        
-        output = output .. ")\n"
-        output = output .. generate_code(input.arguments[3].value)
-        output = output .. "end"
-        
-        return output
-    end
-    
-    local templates = {
-        _true = native_value("true"),
-        _false = native_value("false"),
-        _nil = native_value("nil"),
-        def = define_variable,
-        add = arthmetic_operation("+"),
-        sub = arthmetic_operation("-"),
-        mul = arthmetic_operation("*"),
-        div = arthmetic_operation("/"),
-        equal = comparison_operation("=="),
-        not_equal = comparison_operation("~="),
-        less_than = comparison_operation("<"),
-        less_than_or_equal = comparison_operation("<="),
-        greater_than = comparison_operation(">"),
-        greater_than_or_equal = comparison_operation(">="),
-        _not = not_operation,
-        _or = logic_operation("or"),
-        _and = logic_operation("and"),        
-        _return = return_statement,
-        _if = if_statement,
-        loop = loop,
-        func = define_function
-    }
+    compile_cache.file_misses = compile_cache.file_misses + 1
     
-    return (templates[input.arguments[1].value] or function_call)(input)
-end
-
-function generate_code(input)
-    
-    if type(input) == "string" then
-        local tree = {}
-        input = input .. "\n"
-        cubescript.eval(input, create_ast(tree))
-        return generate_code(tree)
-    end
+    chunks = cubescript.compile_file(code, env.exec_threads)
+    compile_cache_write(cache_path, chunks:save())
     
-    local output = ""
-    for _, value in pairs(input) do
-        if #value.arguments > 0 then
-            output = output .. generate_expression_code(value) .. "\n"
-        end
-    end
-    return output
+    return chunks
 end
 
-env["lua"] = dofile
-
-local function execute_cubescript(filename)
-    
-    local file = io.open(filename)
-    if not file then
-        error("could not open file '" .. filename .. "'")
-    end
+-- Parse the whole file on a pool of threads, or load it from the compile
+-- cache, and then run the compiled chunks in order. The chunks are the same
+-- pieces of code that execute_cubescript evaluates one at a time.
+local function execute_cubescript_parallel(filename)
     
-    local expression = ""
-    local line_number = 1
-    local line_number_expression_start = 1
+    local code = map_cubescript_file(filename)
+    local chunks = compile_cubescript_file(code)
+    code:close()
     
     local old_current_location = env.current_location
     
-    local function cleanup()
-        env.current_location = old_current_location
-        file:close()
-    end
+    local first_line, last_line
     
-    for line in file:lines() do
+    env.current_location = function()
+        return filename .. ":" .. first_line
+    end
     
-        expression = expression .. line .. "\n"
+    for i = 1, chunks:size() do
         
-        if cubescript.is_complete_expression(expression) then
-            
-            env.current_location = function()
-                return filename .. ":" .. line_number_expression_start
-            end
-            
-            local error_message = cubescript.eval(expression, env)
+        first_line, last_line = chunks:lines(i)
+        
+        local error_message = chunks:eval(i, env)
+        
+        if error_message then
             
-            if error_message then
-                
-                cleanup()
-                
-                error({string.format("%s:%i: %s", 
-                    filename, line_number, error_message)}, 0)
-            end
+            env.current_location = old_current_location
             
-            expression = ""
-            line_number_expression_start = line_number + 1
+            error({string.format("%s:%i: %s", 
+                filename, last_line, error_message)}, 0)
         end
-        
-        line_number = line_number + 1
     end
     
-    cleanup()
+    env.current_location = old_current_location
 end
 
+-- Number of threads used to parse .conf files: 1 evaluates the file line by
+-- line as it's read, 0 uses one thread per processor. Files are always
+-- compiled whole when the compile cache is enabled.
+env["exec_threads"] = 1
+
 env["exec_type"] = {
     lua = dofile,
-    conf = execute_cubescript
+    conf = function(filename)
+        if env.exec_threads == 1 and not env.compile_cache_dir then
+            return execute_cubescript(filename)
+        else
+            return execute_cubescript_parallel(filename)
+        end
+    end
 }
 
 env["exec_search_paths"] = {}
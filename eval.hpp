@@ -0,0 +1,981 @@
+/*
+  Copyright (c) 2010 Graham Daws <graham.daws@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#ifndef CUBESCRIPT_EVAL_HPP
+#define CUBESCRIPT_EVAL_HPP
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <cmath>
+#include <vector>
+#include <string>
+#include "cubescript.hpp"
+#include "scan.hpp"
+
+namespace cubescript{
+
+/*
+    Statically dispatched versions of the eval functions declared in 
+    cubescript.hpp. The functions in this file are templates on the type of
+    command stack and call its methods directly, so the stack operations can
+    be inlined into the parser loop. The functions declared in cubescript.hpp
+    are the instantiation of these templates for the command_stack class.
+    
+    The Stack type needs the same methods as command_stack, but it doesn't
+    have to be derived from it. Calls to the virtual methods of a derived
+    class are only inlined where the compiler can tell the object's type, so
+    a class written for use with these templates (e.g. program_compiler in
+    bytecode.cpp) is best left underived, with non-virtual methods.
+    
+    Calls with a command_stack reference argument still resolve to the 
+    compiled functions declared in cubescript.hpp.
+*/
+
+namespace expression{
+enum token_id
+{
+    ERROR = 0,
+    WHITESPACE,
+    CHAR,
+    END_ROOT_EXPRESSION,
+    START_EXPRESSION,
+    END_EXPRESSION,
+    START_SYMBOL,
+    START_END_STRING,
+    START_MULTILINE_STRING,
+    END_MULTILINE_STRING,
+    START_COMMENT
+};
+extern const token_id symbols[256];
+} //namespace expression
+
+namespace detail{
+
+enum word_type{
+    WORD_INTEGER = 0,
+    WORD_REAL    = 1,
+    WORD_STRING  = 2
+};
+
+inline bool unexpected(const char * position, const char * where, 
+                       eval_status & status)
+{
+    status.error = eval_status::UNEXPECTED_CHARACTER;
+    status.position = position;
+    status.character = *position;
+    status.context = where;
+    return false;
+}
+
+inline bool incomplete(const char * position, eval_status & status)
+{
+    status.error = eval_status::INCOMPLETE;
+    status.position = position;
+    return false;
+}
+
+inline bool unfinished_string(const char * position, eval_status & status)
+{
+    status.error = eval_status::UNFINISHED_STRING;
+    status.position = position;
+    status.character = *position;
+    return false;
+}
+
+inline void throw_if_error(const eval_status & status)
+{
+    if(status.error != eval_status::OK) status.throw_exception();
+}
+
+/**
+    The parts of a decimal number, read using the same syntax as the %f
+    conversion of scanf, but without reading beyond the end of the input.
+*/
+struct decimal_number
+{
+    bool negative;
+    unsigned long long mantissa;
+    int exponent;
+    bool inexact; // More significant digits than the mantissa can hold
+    bool is_integer; // No fraction or exponent part
+    const char * end;
+};
+
+const int MAX_MANTISSA_DIGITS = 19;
+
+inline bool read_decimal(const char * start, const char * end, 
+                         decimal_number & number)
+{
+    const char * cursor = start;
+    
+    number.negative = false;
+    number.mantissa = 0;
+    number.exponent = 0;
+    number.inexact = false;
+    number.is_integer = true;
+    
+    if(cursor != end && *cursor == '-')
+    {
+        number.negative = true;
+        cursor++;
+    }
+    
+    bool any_digits = false;
+    int digits = 0;
+    
+    for(; cursor != end && *cursor >= '0' && *cursor <= '9'; cursor++)
+    {
+        any_digits = true;
+        int digit = *cursor - '0';
+        
+        if(digits < MAX_MANTISSA_DIGITS)
+        {
+            number.mantissa = number.mantissa * 10 + digit;
+            if(number.mantissa) digits++;
+        }
+        else
+        {
+            number.exponent++;
+            if(digit) number.inexact = true;
+        }
+    }
+    
+    if(cursor != end && *cursor == '.')
+    {
+        number.is_integer = false;
+        cursor++;
+        
+        for(; cursor != end && *cursor >= '0' && *cursor <= '9'; cursor++)
+        {
+            any_digits = true;
+            int digit = *cursor - '0';
+            
+            if(digits < MAX_MANTISSA_DIGITS)
+            {
+                number.mantissa = number.mantissa * 10 + digit;
+                number.exponent--;
+                if(number.mantissa) digits++;
+            }
+            else if(digit) number.inexact = true;
+        }
+    }
+    
+    if(!any_digits) return false;
+    
+    if(cursor != end && (*cursor == 'e' || *cursor == 'E'))
+    {
+        const char * exponent_start = cursor + 1;
+        bool negative_exponent = false;
+        
+        if(exponent_start != end && 
+           (*exponent_start == '-' || *exponent_start == '+'))
+        {
+            negative_exponent = *exponent_start == '-';
+            exponent_start++;
+        }
+        
+        if(exponent_start != end && 
+           *exponent_start >= '0' && *exponent_start <= '9')
+        {
+            int exponent = 0;
+            
+            for(cursor = exponent_start; 
+                cursor != end && *cursor >= '0' && *cursor <= '9'; cursor++)
+            {
+                if(exponent < 100000) exponent = exponent * 10 + *cursor - '0';
+            }
+            
+            number.exponent += (negative_exponent ? -exponent : exponent);
+            number.is_integer = false;
+        }
+    }
+    
+    number.end = cursor;
+    return true;
+}
+
+inline double decimal_to_double(const char * start, 
+                                const decimal_number & number)
+{
+    static const double powers_of_ten[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    
+    // Both operands are exactly representable so the result is correctly 
+    // rounded
+    if(!number.inexact && number.mantissa <= (1ULL << 53) && 
+       number.exponent >= -22 && number.exponent <= 22)
+    {
+        double value = static_cast<double>(number.mantissa);
+        
+        if(number.exponent < 0) value /= powers_of_ten[-number.exponent];
+        else value *= powers_of_ten[number.exponent];
+        
+        return number.negative ? -value : value;
+    }
+    
+    // Uncommon case: strtod needs a null-terminated copy of the number
+    std::size_t length = number.end - start;
+    char buffer[64];
+    std::string long_buffer;
+    const char * c_str = buffer;
+    
+    if(length < sizeof(buffer))
+    {
+        std::memcpy(buffer, start, length);
+        buffer[length] = '\0';
+    }
+    else
+    {
+        long_buffer.assign(start, length);
+        c_str = long_buffer.c_str();
+    }
+    
+    return std::strtod(c_str, NULL);
+}
+
+template<class Stack>
+void push_integer(long long value, Stack & command)
+{
+    if(value >= INT_MIN && value <= INT_MAX)
+        command.push_argument(static_cast<int>(value));
+    else command.push_argument(value);
+}
+
+template<class Stack>
+bool push_number(const char * start, const char * end, 
+                 bool is_real, Stack & command)
+{
+    decimal_number number;
+    if(!read_decimal(start, end, number)) return false;
+    
+    if(!is_real && number.is_integer && !number.inexact && 
+       number.exponent == 0)
+    {
+        unsigned long long max_magnitude = static_cast<unsigned long long>(
+            LLONG_MAX) + (number.negative ? 1 : 0);
+        
+        if(number.mantissa <= max_magnitude)
+        {
+            long long value = number.negative ? 
+                -static_cast<long long>(number.mantissa - 1) - 1 : 
+                static_cast<long long>(number.mantissa);
+            push_integer(value, command);
+            return true;
+        }
+    }
+    
+    double value = decimal_to_double(start, number);
+    
+    if(!is_real && value == std::floor(value) && 
+       value >= -9223372036854775808.0 && value < 9223372036854775808.0)
+    {
+        push_integer(static_cast<long long>(value), command);
+    }
+    else command.push_argument(value);
+    
+    return true;
+}
+
+template<class Stack>
+bool eval_word(const char ** source_begin, const char * source_end, 
+               Stack & command, eval_status & status)
+{
+    const char * start = *source_begin;
+    word_type type = WORD_INTEGER;
+    
+    for(const char * cursor = start; cursor != source_end; cursor++)
+    {
+        char c = *cursor;
+        expression::token_id token_id = 
+            expression::symbols[static_cast<unsigned char>(c)];
+        
+        if(token_id != expression::CHAR && c != '/')
+        {
+            *source_begin = cursor - 1;
+            std::size_t length = cursor - start;
+            
+            if(token_id != expression::ERROR && cursor != start) 
+            {
+                switch(type)
+                {
+                    case WORD_INTEGER:
+                    case WORD_REAL:
+                        if(push_number(start, cursor, type == WORD_REAL, 
+                                       command)) break;
+                        // Not a number (e.g. "-" or ".")
+                        command.push_argument(start, length);
+                        break;
+                    case WORD_STRING:
+                        command.push_argument(start, length);
+                        break;
+                }
+                
+                return true;
+            }
+            else
+            {
+                *source_begin = cursor;
+                return unexpected(cursor, "word", status);
+            }
+        }
+        
+        if(type != WORD_STRING && !(c >= '0' && c <= '9') && c != '-' &&
+          (cursor == *source_begin || c != 'e'))
+        {
+            if(c == '.') type = WORD_REAL;
+            else type = WORD_STRING;
+        }
+    }
+    
+    *source_begin = source_end;
+    return incomplete(source_end, status);
+}
+
+inline std::string decode_string(const char ** begin, const char * end, 
+                              const std::vector<const char *> & escape_sequence)
+{
+    const char * start = *begin;
+    
+    std::string result;
+    result.reserve(end - start);
+    
+    result.append(start, escape_sequence[0]);
+    
+    typedef std::vector<const char *>::const_iterator iterator;
+    for(iterator iter = escape_sequence.begin(); iter != escape_sequence.end();
+        iter++)
+    {
+        assert(*iter != end);
+        
+        const char * escape = *iter;
+        
+        switch(*(escape + 1))
+        {
+            case '\"': result.append(1, '\"'); break; 
+            case '\\': result.append(1, '\\'); break; 
+            case 'n':  result.append(1, '\n'); break; 
+            case 'r':  result.append(1, '\r'); break; 
+            case 't':  result.append(1, '\t'); break; 
+            case 'f':  result.append(1, '\f'); break; 
+            case 'b':  result.append(1, '\b'); break;
+        }
+        
+        const char * sub_end = end;
+        if(iter + 1 != escape_sequence.end())
+            sub_end = *(iter + 1);
+        
+        result.append(escape + 2, sub_end);
+    }
+    
+    return result;
+}
+
+template<class Stack>
+bool eval_string(const char ** source_begin, const char * source_end, 
+                 Stack & command, eval_status & status)
+{
+    assert(**source_begin == '"');
+    const char * start = (*source_begin) + 1;
+    *source_begin = start;
+    
+    std::vector<const char *> escape_sequence;
+    
+    for(const char * cursor = scan::string_special(start, source_end);
+        cursor != source_end; 
+        cursor = scan::string_special(cursor + 1, source_end))
+    {
+        char c = *cursor;
+        switch(c)
+        {
+            case '"':
+                if(escape_sequence.size())
+                {
+                    std::string string = decode_string(source_begin, cursor,
+                                                       escape_sequence);
+                    command.push_argument(string.c_str(), string.length());
+                }
+                else
+                {
+                    std::size_t length = cursor - start;
+                    command.push_argument(start, length);
+                }
+                
+                *source_begin = cursor;
+                return true;
+            case '\\':
+            case '^':
+                escape_sequence.push_back(cursor);
+                if(cursor + 1 != source_end) cursor++;
+                break;
+            case '\r':
+            case '\n':
+                *source_begin = cursor;
+                return unfinished_string(cursor, status);
+            default:break;
+        }
+    }
+    
+    *source_begin = source_end;
+    return incomplete(source_end, status);
+}
+
+template<class Stack>
+bool eval_interpolation_symbol(const char ** source_begin, 
+                               const char * source_end, 
+                               Stack & command,
+                               eval_status & status)
+{
+    const char * start = *source_begin;
+    const char * cursor = start;
+    
+    for(; cursor != source_end; cursor++)
+    {
+        expression::token_id token_id = 
+            expression::symbols[static_cast<unsigned char>(*cursor)];
+        
+        if(token_id != expression::CHAR)
+        {
+            if(token_id != expression::ERROR) break;
+            else
+            {
+                *source_begin = cursor;
+                return unexpected(cursor, "interpolation symbol", status);
+            }
+        }
+    }
+    
+    std::size_t length = cursor - start;
+    command.push_argument_symbol(start, length);
+    
+    *source_begin = cursor - 1;
+    return true;
+}
+
+template<class Stack>
+bool eval_symbol(const char ** source_begin, const char * source_end,
+                 Stack & command, eval_status & status)
+{
+    const char * start = *source_begin;
+    if(*start == '$') *source_begin = ++start;
+    
+    for(const char * cursor = start; cursor != source_end; cursor++)
+    {
+        expression::token_id token_id = 
+            expression::symbols[static_cast<unsigned char>(*cursor)];
+        
+        if(token_id != expression::CHAR)
+        {
+            *source_begin = cursor - 1;
+            if(token_id != expression::ERROR)
+            {
+                std::size_t length = cursor - start;
+                command.push_argument_symbol(start, length);
+                return true;
+            }
+            else
+            {
+                *source_begin = cursor;
+                return unexpected(cursor, "symbol", status);
+            }
+        }
+    }
+    
+    *source_begin = source_end;
+    return incomplete(source_end, status);
+}
+
+inline bool eval_comment(const char ** source_begin, const char * source_end,
+                         eval_status & status)
+{
+    assert(**source_begin == '/' || **source_begin == '#');
+    const char * start = (*source_begin) + 1;
+    *source_begin = start;
+    
+    if(start != source_end) start++; // Ignore second slash character
+    
+    const char * cursor = scan::comment_end(start, source_end);
+    if(cursor != source_end)
+    {
+        *source_begin = cursor - 1;
+        return true;
+    }
+    
+    *source_begin = source_end;
+    return incomplete(source_end, status);
+}
+
+} //namespace detail
+
+template<class Stack>
+bool parser::push_frame(frame::frame_kind kind, const char * position,
+                        Stack & command, eval_status & status)
+{
+    if(m_frames.size() >= m_max_depth)
+    {
+        status.error = eval_status::NESTING_TOO_DEEP;
+        status.position = position;
+        return false;
+    }
+    
+    frame new_frame;
+    new_frame.kind = kind;
+    new_frame.first_argument = true;
+    new_frame.call_index = command.push_command();
+    
+    m_frames.push_back(new_frame);
+    return true;
+}
+
+template<class Stack>
+bool parser::eval_multiline_string(const char ** source_begin,
+                                   const char * source_end,
+                                   Stack & command,
+                                   eval_status & status)
+{
+    assert(**source_begin == '[');
+    const char * start = (*source_begin) + 1;
+    *source_begin = start;
+    
+    std::size_t first_interpolation = m_interpolations.size();
+    int nested = 1;
+    
+    for(const char * cursor = scan::multiline_special(start, source_end);
+        cursor != source_end; 
+        cursor = scan::multiline_special(cursor + 1, source_end))
+    {
+        char c = *cursor;
+        
+        switch(c)
+        {
+            case '[':
+                nested++;
+                break;
+            case ']':
+                if(--nested == 0)
+                {
+                    if(m_interpolations.size() == first_interpolation)
+                    {
+                        std::size_t length = cursor - start;
+                        command.push_argument(start, length);
+                        *source_begin = cursor;
+                        return true;
+                    }
+                    
+                    m_interpolations.push_back(cursor);
+                    
+                    if(!push_frame(frame::INTERPOLATION, start - 1, command, 
+                                   status))
+                    {
+                        m_interpolations.resize(first_interpolation);
+                        return false;
+                    }
+                    
+                    // The interpolation frame is evaluated by run()
+                    frame & current = m_frames.back();
+                    current.first_interpolation = first_interpolation;
+                    current.next_interpolation = first_interpolation;
+                    
+                    command.push_argument_symbol("@", 1);
+                    
+                    std::size_t length = 
+                        m_interpolations[first_interpolation] - start;
+                    if(length) command.push_argument(start, length);
+                    
+                    return true;
+                }
+                break;
+            case '@':
+            {
+                const char * first_at = cursor;
+                for(; cursor != source_end && *cursor == '@'; cursor++);
+                if(cursor - first_at >= nested)
+                    m_interpolations.push_back(first_at);
+                cursor--;
+                break;
+            }
+            default:;
+        }
+    }
+    
+    m_interpolations.resize(first_interpolation);
+    *source_begin = source_end;
+    return detail::incomplete(source_end, status);
+}
+
+template<class Stack>
+void parser::end_interpolation(frame & current, const char * cursor, 
+                               const char * end, Stack & command)
+{
+    std::size_t next = current.next_interpolation + 1;
+    
+    // Skip interpolations that were read as part of a symbol name
+    std::size_t last = m_interpolations.size() - 1;
+    
+    while(next != last && 
+          m_interpolations[next] <= cursor) next++;
+    
+    if(cursor + 1 < end)
+    {
+        cursor++;
+        std::size_t length = m_interpolations[next] - cursor;
+        if(length) command.push_argument(cursor, length);
+    }
+    
+    current.next_interpolation = next;
+}
+
+inline bool parser::suspend(frame & current, bool first_argument, 
+                     const char * token, const char ** resume)
+{
+    current.first_argument = first_argument;
+    *resume = token;
+    return false;
+}
+
+template<class Stack>
+bool parser::run(const char * cursor,
+                 const char ** source_begin, 
+                 const char * source_end,
+                 Stack & command,
+                 eval_status & status,
+                 const char ** resume,
+                 bool single_expression)
+{
+    // Code in an interpolated expression ends at the closing bracket of the
+    // multiline string
+    const char * end = m_interpolations.empty() ? 
+        source_end : m_interpolations.back();
+    
+    frame * current = &m_frames.back();
+    bool first_argument = current->first_argument;
+    bool interpolating = current->kind == frame::INTERPOLATION;
+    
+    while(true)
+    {
+        if(interpolating)
+        {
+            if(current->next_interpolation == m_interpolations.size() - 1)
+            {
+                const char * closing = end;
+                std::size_t first = current->first_interpolation;
+                
+                command.call(current->call_index);
+                m_frames.pop_back();
+                
+                m_interpolations.resize(first);
+                end = first ? m_interpolations[first - 1] : source_end;
+                
+                if(m_frames.empty())
+                {
+                    *source_begin = closing;
+                    return true;
+                }
+                
+                current = &m_frames.back();
+                first_argument = false;
+                interpolating = false;
+                cursor = closing + 1;
+                continue;
+            }
+            
+            const char * part = m_interpolations[current->next_interpolation];
+            for(; part != end && *part == '@'; part++);
+            
+            if(part != end && *part == '(')
+            {
+                if(!push_frame(frame::SUB_EXPRESSION, part, command, status))
+                    return false;
+                current = &m_frames.back();
+                first_argument = true;
+                interpolating = false;
+                cursor = part + 1;
+                continue;
+            }
+            
+            if(!detail::eval_interpolation_symbol(&part, end, command, status))
+                return false;
+            
+            end_interpolation(*current, part, end, command);
+            continue;
+        }
+        
+        if(cursor == end)
+        {
+            detail::incomplete(end, status);
+            return suspend(*current, first_argument, cursor, resume);
+        }
+        
+        char c = *cursor;
+        const char * token = cursor;
+        
+        switch(expression::symbols[static_cast<unsigned char>(c)])
+        {
+            case expression::WHITESPACE:
+                // Do nothing
+                break;
+            case expression::END_EXPRESSION:
+            {
+                if(current->kind == frame::EXPRESSION)
+                {
+                    *source_begin = cursor;
+                    return detail::unexpected(cursor, "expression", status);
+                }
+                
+                if(m_frames.size() == 1) *source_begin = cursor;
+                
+                command.call(current->call_index);
+                m_frames.pop_back();
+                
+                if(m_frames.empty()) return true;
+                
+                current = &m_frames.back();
+                if(current->kind == frame::INTERPOLATION)
+                {
+                    interpolating = true;
+                    end_interpolation(*current, cursor, end, command);
+                    continue;
+                }
+                
+                first_argument = false;
+                break;
+            }
+            case expression::END_ROOT_EXPRESSION:
+            {
+                if(current->kind != frame::EXPRESSION)
+                {
+                    if(c == ';') 
+                        return detail::unexpected(cursor, "expression", status);
+                    break; // Allow new lines in sub expressions
+                }
+                
+                *source_begin = cursor + 1;
+                command.call(current->call_index);
+                
+                if(single_expression || cursor + 1 == source_end)
+                {
+                    m_frames.pop_back();
+                    return true;
+                }
+                
+                // Reuse the frame for the next expression
+                current->call_index = command.push_command();
+                first_argument = true;
+                break;
+            }
+            case expression::START_EXPRESSION:
+            {
+                if(!push_frame(frame::SUB_EXPRESSION, cursor, command, status))
+                    return false;
+                current = &m_frames.back();
+                first_argument = true;
+                break;
+            }
+            case expression::START_SYMBOL:
+            {
+                if(!detail::eval_symbol(&token, end, command, status))
+                    return suspend(*current, first_argument, cursor, resume);
+                cursor = token;
+                first_argument = false;
+                break;
+            }
+            case expression::START_END_STRING:
+            {
+                if(!detail::eval_string(&token, end, command, status))
+                    return suspend(*current, first_argument, cursor, resume);
+                cursor = token;
+                first_argument = false;
+                break;
+            }
+            case expression::START_MULTILINE_STRING:
+            {
+                if(!eval_multiline_string(&token, end, command, status))
+                    return suspend(*current, first_argument, cursor, resume);
+                
+                if(m_frames.back().kind == frame::INTERPOLATION)
+                {
+                    current = &m_frames.back();
+                    interpolating = true;
+                    end = m_interpolations.back();
+                    continue;
+                }
+                
+                cursor = token;
+                first_argument = false;
+                break;
+            }
+            case expression::CHAR:
+            {
+                bool success = first_argument ? 
+                    detail::eval_symbol(&token, end, command, status) :
+                    detail::eval_word(&token, end, command, status);
+                
+                if(!success) 
+                    return suspend(*current, first_argument, cursor, resume);
+                
+                cursor = token;
+                first_argument = false;
+                break;
+            }
+            case expression::START_COMMENT:
+            {
+                if(!detail::eval_comment(&token, end, status))
+                    return suspend(*current, first_argument, cursor, resume);
+                cursor = token;
+                break;
+            }
+            case expression::ERROR:
+            default:
+                if(m_frames.size() == 1) *source_begin = cursor;
+                return detail::unexpected(cursor, "expression", status);
+        }
+        
+        cursor++;
+    }
+}
+
+template<class Stack>
+void eval_word(const char ** source_begin, const char * source_end, 
+               Stack & command)
+{
+    eval_status status;
+    detail::eval_word(source_begin, source_end, command, status);
+    detail::throw_if_error(status);
+}
+
+template<class Stack>
+void eval_string(const char ** source_begin, const char * source_end, 
+                 Stack & command)
+{
+    eval_status status;
+    detail::eval_string(source_begin, source_end, command, status);
+    detail::throw_if_error(status);
+}
+
+template<class Stack>
+void eval_symbol(const char ** source_begin, const char * source_end, 
+                 Stack & command)
+{
+    eval_status status;
+    detail::eval_symbol(source_begin, source_end, command, status);
+    detail::throw_if_error(status);
+}
+
+template<class Stack>
+void eval_comment(const char ** source_begin, const char * source_end, 
+                  Stack &)
+{
+    eval_status status;
+    detail::eval_comment(source_begin, source_end, status);
+    detail::throw_if_error(status);
+}
+
+template<class Stack>
+void eval_multiline_string(const char ** source_begin,
+                           const char * source_end,
+                           Stack & command)
+{
+    parser state;
+    eval_status status;
+    const char * resume;
+    
+    if(state.eval_multiline_string(source_begin, source_end, command, 
+                                   status) && state.depth())
+    {
+        state.run(*source_begin, source_begin, source_end, command, status, 
+                  &resume, true);
+    }
+    
+    detail::throw_if_error(status);
+}
+
+template<class Stack>
+void eval_expression(const char ** source_begin, 
+                     const char * source_end,
+                     Stack & command,
+                     bool is_sub_expression)
+{
+    parser state;
+    eval_status status;
+    const char * resume;
+    
+    const char * start = *source_begin;
+    
+    if(is_sub_expression)
+    {
+        assert(*start == '(');
+        start++;
+    }
+    
+    parser::frame::frame_kind kind = is_sub_expression ? 
+        parser::frame::SUB_EXPRESSION : parser::frame::EXPRESSION;
+    
+    if(state.push_frame(kind, *source_begin, command, status))
+        state.run(start, source_begin, source_end, command, status, &resume, 
+                  true);
+    
+    detail::throw_if_error(status);
+}
+
+template<class Stack>
+void eval_expression(const char ** source_begin, 
+                     const char * source_end,
+                     Stack & command)
+{
+    eval_expression(source_begin, source_end, command, false);
+}
+
+template<class Stack>
+eval_status try_eval(const char ** source_begin, 
+                     const char * source_end, 
+                     Stack & stack)
+{
+    parser state;
+    eval_status status;
+    const char * resume;
+    
+    while(*source_begin < source_end)
+    {
+        if(!state.push_frame(parser::frame::EXPRESSION, *source_begin, stack, 
+                             status) ||
+           !state.run(*source_begin, source_begin, source_end, stack, status, 
+                      &resume, false))
+        {
+            break;
+        }
+    }
+    
+    return status;
+}
+
+template<class Stack>
+void eval(const char ** source_begin, 
+          const char * source_end, 
+          Stack & stack)
+{
+    detail::throw_if_error(try_eval(source_begin, source_end, stack));
+}
+
+} //namespace cubescript
+
+#endif
@@ -0,0 +1,94 @@
+/*
+  Copyright (c) 2010 Graham Daws <graham.daws@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#ifndef CUBESCRIPT_IMAGE_HPP
+#define CUBESCRIPT_IMAGE_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+namespace cubescript{
+namespace image{
+
+/**
+    Functions for writing and reading the binary images of compiled code (see
+    save() in bytecode.hpp). Each read function moves the position past the
+    value read, and returns false, without moving it, if the data ends first.
+*/
+
+/**
+    Write an unsigned number as a variable length sequence of bytes, 7 bits
+    at a time starting from the lowest bits, with the high bit set on every
+    byte but the last.
+*/
+inline void write_size(std::size_t value, std::string & output)
+{
+    while(value >= 0x80)
+    {
+        output += static_cast<char>((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    output += static_cast<char>(value);
+}
+
+inline bool read_size(const char ** position, const char * end, 
+                      std::size_t & value)
+{
+    const char * cursor = *position;
+    std::size_t result = 0;
+    for(unsigned int shift = 0; cursor != end; shift += 7)
+    {
+        if(shift >= sizeof(std::size_t) * 8) return false;
+        unsigned char byte = static_cast<unsigned char>(*cursor++);
+        result |= static_cast<std::size_t>(byte & 0x7f) << shift;
+        if(!(byte & 0x80))
+        {
+            value = result;
+            *position = cursor;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+    Write a value as it is in memory.
+*/
+template<typename T>
+void write_raw(const T & value, std::string & output)
+{
+    output.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template<typename T>
+bool read_raw(const char ** position, const char * end, T & value)
+{
+    if(static_cast<std::size_t>(end - *position) < sizeof(T)) return false;
+    std::memcpy(&value, *position, sizeof(T));
+    *position += sizeof(T);
+    return true;
+}
+
+} //namespace image
+} //namespace cubescript
+
+#endif
@@ -0,0 +1,405 @@
+/*
+  Copyright (c) 2010 Graham Daws <graham.daws@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#ifndef CUBESCRIPT_LUA_BINDING_HPP
+#define CUBESCRIPT_LUA_BINDING_HPP
+
+#include <exception>
+#include <string>
+#include <lua.hpp>
+#include "binding.hpp"
+
+namespace cubescript{
+namespace detail{
+
+/**
+    Conversion of a Lua function argument. All the arguments are checked 
+    before any are converted, so that a Lua error raised by a failed check 
+    can't skip the destructor of a converted argument.
+*/
+template<class T> struct lua_argument;
+
+template<class T>
+struct lua_number_argument
+{
+    static void check(lua_State * L, int index)
+    {
+        if(!lua_isnumber(L, index)) luaL_typerror(L, index, "number");
+    }
+    
+    static T get(lua_State * L, int index)
+    {
+        return static_cast<T>(lua_tonumber(L, index));
+    }
+};
+
+template<> struct lua_argument<long long>:lua_number_argument<long long>{};
+template<> struct lua_argument<float>:lua_number_argument<float>{};
+template<> struct lua_argument<double>:lua_number_argument<double>{};
+
+template<>
+struct lua_argument<int>:lua_number_argument<int>
+{
+    static int get(lua_State * L, int index)
+    {
+        return lua_tointeger(L, index);
+    }
+};
+
+template<>
+struct lua_argument<bool>
+{
+    static void check(lua_State *, int){}
+    
+    static bool get(lua_State * L, int index)
+    {
+        return lua_toboolean(L, index);
+    }
+};
+
+template<>
+struct lua_argument<string_ref>
+{
+    static void check(lua_State * L, int index)
+    {
+        if(!lua_isstring(L, index)) luaL_typerror(L, index, "string");
+    }
+    
+    static string_ref get(lua_State * L, int index)
+    {
+        string_ref output;
+        output.data = lua_tolstring(L, index, &output.length);
+        return output;
+    }
+};
+
+template<>
+struct lua_argument<std::string>
+{
+    static void check(lua_State * L, int index)
+    {
+        lua_argument<string_ref>::check(L, index);
+    }
+    
+    static std::string get(lua_State * L, int index)
+    {
+        string_ref input = lua_argument<string_ref>::get(L, index);
+        return std::string(input.data, input.length);
+    }
+};
+
+inline void push_lua_result(lua_State * L, bool value)
+{
+    lua_pushboolean(L, value);
+}
+
+inline void push_lua_result(lua_State * L, int value)
+{
+    lua_pushinteger(L, value);
+}
+
+inline void push_lua_result(lua_State * L, long long value)
+{
+    lua_pushnumber(L, static_cast<lua_Number>(value));
+}
+
+inline void push_lua_result(lua_State * L, float value)
+{
+    lua_pushnumber(L, value);
+}
+
+inline void push_lua_result(lua_State * L, double value)
+{
+    lua_pushnumber(L, value);
+}
+
+inline void push_lua_result(lua_State * L, const char * value)
+{
+    if(value) lua_pushstring(L, value);
+    else lua_pushnil(L);
+}
+
+inline void push_lua_result(lua_State * L, const std::string & value)
+{
+    lua_pushlstring(L, value.data(), value.length());
+}
+
+inline void push_lua_result(lua_State * L, string_ref value)
+{
+    lua_pushlstring(L, value.data, value.length);
+}
+
+/**
+    Calls a bound function with the arguments converted from the Lua stack.
+    There is a specialization for each number of arguments, with and without
+    a return value. The call method returns the number of return values.
+*/
+template<class Function> struct lua_invoker;
+
+template<class R>
+struct lua_invoker<R (*)()>
+{
+    static void check(lua_State *){}
+    
+    static int call(lua_State * L, R (*function)())
+    {
+        push_lua_result(L, function());
+        return 1;
+    }
+};
+
+template<>
+struct lua_invoker<void (*)()>
+{
+    static void check(lua_State *){}
+    
+    static int call(lua_State *, void (*function)())
+    {
+        function();
+        return 0;
+    }
+};
+
+template<class R, class A1>
+struct lua_invoker<R (*)(A1)>
+{
+    typedef typename argument_type<A1>::type T1;
+    
+    static void check(lua_State * L)
+    {
+        lua_argument<T1>::check(L, 1);
+    }
+    
+    static int call(lua_State * L, R (*function)(A1))
+    {
+        T1 a1 = lua_argument<T1>::get(L, 1);
+        push_lua_result(L, function(a1));
+        return 1;
+    }
+};
+
+template<class A1>
+struct lua_invoker<void (*)(A1)>
+{
+    typedef typename argument_type<A1>::type T1;
+    
+    static void check(lua_State * L)
+    {
+        lua_argument<T1>::check(L, 1);
+    }
+    
+    static int call(lua_State * L, void (*function)(A1))
+    {
+        T1 a1 = lua_argument<T1>::get(L, 1);
+        function(a1);
+        return 0;
+    }
+};
+
+template<class R, class A1, class A2>
+struct lua_invoker<R (*)(A1, A2)>
+{
+    typedef typename argument_type<A1>::type T1;
+    typedef typename argument_type<A2>::type T2;
+    
+    static void check(lua_State * L)
+    {
+        lua_argument<T1>::check(L, 1);
+        lua_argument<T2>::check(L, 2);
+    }
+    
+    static int call(lua_State * L, R (*function)(A1, A2))
+    {
+        T1 a1 = lua_argument<T1>::get(L, 1);
+        T2 a2 = lua_argument<T2>::get(L, 2);
+        push_lua_result(L, function(a1, a2));
+        return 1;
+    }
+};
+
+template<class A1, class A2>
+struct lua_invoker<void (*)(A1, A2)>
+{
+    typedef typename argument_type<A1>::type T1;
+    typedef typename argument_type<A2>::type T2;
+    
+    static void check(lua_State * L)
+    {
+        lua_argument<T1>::check(L, 1);
+        lua_argument<T2>::check(L, 2);
+    }
+    
+    static int call(lua_State * L, void (*function)(A1, A2))
+    {
+        T1 a1 = lua_argument<T1>::get(L, 1);
+        T2 a2 = lua_argument<T2>::get(L, 2);
+        function(a1, a2);
+        return 0;
+    }
+};
+
+template<class R, class A1, class A2, class A3>
+struct lua_invoker<R (*)(A1, A2, A3)>
+{
+    typedef typename argument_type<A1>::type T1;
+    typedef typename argument_type<A2>::type T2;
+    typedef typename argument_type<A3>::type T3;
+    
+    static void check(lua_State * L)
+    {
+        lua_argument<T1>::check(L, 1);
+        lua_argument<T2>::check(L, 2);
+        lua_argument<T3>::check(L, 3);
+    }
+    
+    static int call(lua_State * L, R (*function)(A1, A2, A3))
+    {
+        T1 a1 = lua_argument<T1>::get(L, 1);
+        T2 a2 = lua_argument<T2>::get(L, 2);
+        T3 a3 = lua_argument<T3>::get(L, 3);
+        push_lua_result(L, function(a1, a2, a3));
+        return 1;
+    }
+};
+
+template<class A1, class A2, class A3>
+struct lua_invoker<void (*)(A1, A2, A3)>
+{
+    typedef typename argument_type<A1>::type T1;
+    typedef typename argument_type<A2>::type T2;
+    typedef typename argument_type<A3>::type T3;
+    
+    static void check(lua_State * L)
+    {
+        lua_argument<T1>::check(L, 1);
+        lua_argument<T2>::check(L, 2);
+        lua_argument<T3>::check(L, 3);
+    }
+    
+    static int call(lua_State * L, void (*function)(A1, A2, A3))
+    {
+        T1 a1 = lua_argument<T1>::get(L, 1);
+        T2 a2 = lua_argument<T2>::get(L, 2);
+        T3 a3 = lua_argument<T3>::get(L, 3);
+        function(a1, a2, a3);
+        return 0;
+    }
+};
+
+template<class R, class A1, class A2, class A3, class A4>
+struct lua_invoker<R (*)(A1, A2, A3, A4)>
+{
+    typedef typename argument_type<A1>::type T1;
+    typedef typename argument_type<A2>::type T2;
+    typedef typename argument_type<A3>::type T3;
+    typedef typename argument_type<A4>::type T4;
+    
+    static void check(lua_State * L)
+    {
+        lua_argument<T1>::check(L, 1);
+        lua_argument<T2>::check(L, 2);
+        lua_argument<T3>::check(L, 3);
+        lua_argument<T4>::check(L, 4);
+    }
+    
+    static int call(lua_State * L, R (*function)(A1, A2, A3, A4))
+    {
+        T1 a1 = lua_argument<T1>::get(L, 1);
+        T2 a2 = lua_argument<T2>::get(L, 2);
+        T3 a3 = lua_argument<T3>::get(L, 3);
+        T4 a4 = lua_argument<T4>::get(L, 4);
+        push_lua_result(L, function(a1, a2, a3, a4));
+        return 1;
+    }
+};
+
+template<class A1, class A2, class A3, class A4>
+struct lua_invoker<void (*)(A1, A2, A3, A4)>
+{
+    typedef typename argument_type<A1>::type T1;
+    typedef typename argument_type<A2>::type T2;
+    typedef typename argument_type<A3>::type T3;
+    typedef typename argument_type<A4>::type T4;
+    
+    static void check(lua_State * L)
+    {
+        lua_argument<T1>::check(L, 1);
+        lua_argument<T2>::check(L, 2);
+        lua_argument<T3>::check(L, 3);
+        lua_argument<T4>::check(L, 4);
+    }
+    
+    static int call(lua_State * L, void (*function)(A1, A2, A3, A4))
+    {
+        T1 a1 = lua_argument<T1>::get(L, 1);
+        T2 a2 = lua_argument<T2>::get(L, 2);
+        T3 a3 = lua_argument<T3>::get(L, 3);
+        T4 a4 = lua_argument<T4>::get(L, 4);
+        function(a1, a2, a3, a4);
+        return 0;
+    }
+};
+
+template<class Function>
+int lua_command(lua_State * L)
+{
+    lua_invoker<Function>::check(L);
+    
+    Function function = unpack_function<Function>(
+        lua_touserdata(L, lua_upvalueindex(1)));
+    
+    // C++ exceptions must not pass through the Lua interpreter. The error is
+    // raised after leaving the catch block, as lua_error doesn't return.
+    try
+    {
+        return lua_invoker<Function>::call(L, function);
+    }
+    catch(const std::exception & error)
+    {
+        lua_pushstring(L, error.what());
+    }
+    
+    return lua_error(L);
+}
+
+} //namespace detail
+
+/**
+    Set a field of a Lua table (i.e. the environment table of a
+    lua_command_stack) to a Lua function that calls a C++ function. The 
+    argument and return value conversions are the same as for the 
+    native_command_stack version of bind (declared in binding.hpp).
+*/
+template<class Function>
+void bind(lua_State * L, int table_index, const char * name, 
+          Function function)
+{
+    if(table_index < 0 && table_index > LUA_REGISTRYINDEX)
+        table_index = lua_gettop(L) + table_index + 1;
+    
+    lua_pushlightuserdata(L, detail::pack_function(function));
+    lua_pushcclosure(L, &detail::lua_command<Function>, 1);
+    lua_setfield(L, table_index, name);
+}
+
+} //namespace cubescript
+
+#endif
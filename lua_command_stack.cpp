@@ -20,6 +20,7 @@
   THE SOFTWARE.
 */
 #include "lua_command_stack.hpp"
+#include "eval.hpp"
 #include "lua/pcall.hpp"
 #include <sstream>
 #include <iostream>
@@ -29,7 +30,9 @@ namespace cubescript{
 lua_command_stack::lua_command_stack(lua_State * state, int table_index)
  :m_state(state), m_table_index(table_index)
 {
-    
+    // Symbol lookups push values before indexing the table
+    if(table_index < 0 && table_index > LUA_REGISTRYINDEX)
+        m_table_index = lua_gettop(state) + table_index + 1;
 }
 
 std::size_t lua_command_stack::push_command()
@@ -40,13 +43,29 @@ std::size_t lua_command_stack::push_command()
 void lua_command_stack::push_argument_symbol(const char * value, 
                                              std::size_t length)
 {
+    const char * end_of_string = value + length;
+    
+    if(value == end_of_string)
+    {
+        lua_pushvalue(m_state, m_table_index);
+        return;
+    }
+    
     const char * start = value;
     const char * end = start;
-    const char * end_of_string = start + length;
+    for(; end != end_of_string && *end !='.'; end++);
+    
+    if(end - start == 0)
+        throw parse_error("invalid id given for lua index operator");
     
-    lua_pushvalue(m_state, m_table_index);
+    // The first key is looked up directly in the table, which saves copying
+    // the table for the common case of a name without sub keys.
+    lua_pushlstring(m_state, start, end - start);
+    lua_gettable(m_state, m_table_index);
     
-    while(end < end_of_string)
+    start = end + 1;
+    
+    while(start < end_of_string)
     {
         if(lua_type(m_state, -1) == LUA_TNIL)
         {
@@ -58,7 +77,7 @@ void lua_command_stack::push_argument_symbol(const char * value,
             throw command_error(format.str());
         }
         
-        for(; end != end_of_string && *end !='.'; end++);
+        for(end = start; end != end_of_string && *end !='.'; end++);
         
         if(end - start == 0)
             throw parse_error("invalid id given for lua index operator");
@@ -68,7 +87,6 @@ void lua_command_stack::push_argument_symbol(const char * value,
         lua_replace(m_state, -2);
         
         start = end + 1;
-        end = start;
     }
 }
 
@@ -92,6 +110,16 @@ void lua_command_stack::push_argument(float value)
     lua_pushnumber(m_state, value);
 }
 
+void lua_command_stack::push_argument(long long value)
+{
+    lua_pushnumber(m_state, static_cast<lua_Number>(value));
+}
+
+void lua_command_stack::push_argument(double value)
+{
+    lua_pushnumber(m_state, value);
+}
+
 void lua_command_stack::push_argument(const char * value, std::size_t length)
 {
     lua_pushlstring(m_state, value, length);
@@ -175,12 +203,15 @@ void lua_command_stack::call(std::size_t index)
         return;
     }
     
+    // The error handler goes in the function's slot, so that moving it in
+    // and out of the stack only shifts the arguments and return values, not
+    // the unfinished expressions below the function.
     lua_pushcfunction(m_state, on_runtime_error);
-    lua_insert(m_state, 1);
+    lua_insert(m_state, index);
     
-    int status = lua_pcall(m_state, top - index, LUA_MULTRET, 1);
+    int status = lua_pcall(m_state, top - index, LUA_MULTRET, index);
     
-    lua_remove(m_state, 1);
+    lua_remove(m_state, index);
     
     if(status != 0)
     {
@@ -208,34 +239,88 @@ namespace lua{
 
 int eval(lua_State * L)
 {
-    std::size_t source_length;
-    const char * source = luaL_checklstring(L, 1, &source_length);
+    std::size_t source_length = 0;
+    const char * source = NULL;
+    compiled_program * code = NULL;
+    
+    bool is_compiled_program = false;
+    if(lua_type(L, 1) == LUA_TUSERDATA && lua_getmetatable(L, 1))
+    {
+        luaL_getmetatable(L, compiled_program::CLASS_NAME);
+        is_compiled_program = lua_rawequal(L, -1, -2);
+        lua_pop(L, 2);
+    }
+    
+    if(is_compiled_program)
+        code = reinterpret_cast<compiled_program *>(lua_touserdata(L, 1));
+    else source = mapped_file::check_source(L, 1, &source_length);
 
     lua_command_stack lua_command(L, 2);
     command_stack * command = &lua_command;
+    proxy_command_stack * proxy = NULL;
     
     if(lua_type(L, 2) != LUA_TTABLE)
     {
-        command = reinterpret_cast<proxy_command_stack *>(
+        proxy = reinterpret_cast<proxy_command_stack *>(
             luaL_checkudata(L, 2, proxy_command_stack::CLASS_NAME));
+        command = proxy;
     }
     
     int bottom = lua_gettop(L);
     lua_pushnil(L);
     
+    // The commands called may try to close the file
+    mapped_file::reader reading(L, 1);
+    
     try
     {
-        eval(&source, source + source_length, *command);
+        if(code) replay(code->get_program(), *command);
+        else
+        {
+            // Static dispatch to lua_command_stack when the environment is a
+            // table
+            eval_status status = command == &lua_command ?
+                try_eval(&source, source + source_length, lua_command) :
+                try_eval(&source, source + source_length, *command);
+            if(status.error != eval_status::OK)
+            {
+                lua_pushstring(L, status.message().c_str());
+                lua_replace(L, bottom + 1);
+            }
+        }
     }
     catch(const eval_error & error)
     {
         lua_pushstring(L, error.what());
         lua_replace(L, bottom + 1);
     }
-
+    
+    if(proxy) proxy->discard();
+    
     return lua_gettop(L) - bottom;
 }
 
+int eval_file(lua_State * L)
+{
+    lua_settop(L, 2);
+    
+    if(mapped_file::create(L) != 1) return 2;
+    
+    mapped_file * file = reinterpret_cast<mapped_file *>(
+        lua_touserdata(L, -1));
+    
+    // The mapped file replaces the filename argument
+    lua_replace(L, 1);
+    
+    int results = eval(L);
+    
+    // Unmap the file now instead of leaving it to the garbage collector, 
+    // which doesn't know the size of the mapping
+    file->m_file.close();
+    
+    return results;
+}
+
 int is_complete_code(lua_State * L)
 {
     std::size_t code_length;
@@ -245,13 +330,617 @@ int is_complete_code(lua_State * L)
     return 1;
 }
 
+/*
+    Read a boolean field of an options table, keeping the default value if
+    the field is nil.
+*/
+static void get_option(lua_State * L, int table, const char * name, 
+                       bool & value)
+{
+    lua_getfield(L, table, name);
+    if(!lua_isnil(L, -1)) value = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+}
+
+int to_lua(lua_State * L)
+{
+    luaL_checktype(L, 1, LUA_TSTRING);
+    std::size_t source_length;
+    const char * source = lua_tolstring(L, 1, &source_length);
+    
+    std::size_t parameters_length = 0;
+    const char * parameters = NULL;
+    if(!lua_isnoneornil(L, 2))
+        parameters = luaL_checklstring(L, 2, &parameters_length);
+    
+    lua_code_options options;
+    if(!lua_isnoneornil(L, 3))
+    {
+        luaL_checktype(L, 3, LUA_TTABLE);
+        get_option(L, 3, "fold_constants", options.fold_constants);
+        get_option(L, 3, "eliminate_dead_branches", 
+                   options.eliminate_dead_branches);
+        get_option(L, 3, "hoist_globals", options.hoist_globals);
+        get_option(L, 3, "inline_constants", options.inline_constants);
+    }
+    
+    std::string output;
+    
+    try
+    {
+        if(parameters)
+        {
+            generate_lua_function(parameters, parameters + parameters_length,
+                                  source, source + source_length, output,
+                                  options);
+        }
+        else generate_lua_code(source, source + source_length, output, 
+                               options);
+    }
+    catch(const eval_error & error)
+    {
+        lua_pushnil(L);
+        lua_pushstring(L, error.what());
+        return 2;
+    }
+    
+    lua_pushlstring(L, output.data(), output.length());
+    return 1;
+}
+
+int lua_code_version(lua_State * L)
+{
+    lua_pushinteger(L, LUA_CODE_VERSION);
+    return 1;
+}
+
+int source_hash(lua_State * L)
+{
+    std::size_t source_length;
+    const char * source = mapped_file::check_source(L, 1, &source_length);
+    std::ostringstream output;
+    output<<std::hex<<program::hash(source, source + source_length);
+    std::string hash = output.str();
+    lua_pushlstring(L, hash.data(), hash.length());
+    return 1;
+}
+
+code_scanner::code_scanner()
+{
+    
+}
+
+code_scanner::~code_scanner()
+{
+    
+}
+
+int code_scanner::__gc(lua_State * L)
+{
+    reinterpret_cast<code_scanner *>(
+        luaL_checkudata(L, 1, CLASS_NAME))->~code_scanner();
+    return 0;
+}
+
+int code_scanner::feed(lua_State * L)
+{
+    code_scanner * object = reinterpret_cast<code_scanner *>(
+        luaL_checkudata(L, 1, CLASS_NAME));
+    std::size_t code_length;
+    const char * code = luaL_checklstring(L, 2, &code_length);
+    lua_pushboolean(L, object->m_scanner.feed(code, code + code_length));
+    return 1;
+}
+
+int code_scanner::is_complete(lua_State * L)
+{
+    code_scanner * object = reinterpret_cast<code_scanner *>(
+        luaL_checkudata(L, 1, CLASS_NAME));
+    lua_pushboolean(L, object->m_scanner.is_complete());
+    return 1;
+}
+
+int code_scanner::reset(lua_State * L)
+{
+    reinterpret_cast<code_scanner *>(
+        luaL_checkudata(L, 1, CLASS_NAME))->m_scanner.reset();
+    return 0;
+}
+
+const char * code_scanner::CLASS_NAME = "code_scanner";
+
+int code_scanner::register_metatable(lua_State * L)
+{
+    luaL_newmetatable(L, CLASS_NAME);
+    luaL_Reg functions[] = {
+        {"__gc", &code_scanner::__gc},
+        {"feed", &code_scanner::feed},
+        {"is_complete", &code_scanner::is_complete},
+        {"reset", &code_scanner::reset},
+        {NULL, NULL}
+    };
+    luaL_register(L, NULL, functions);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+    lua_pop(L, 1);
+    return 0;
+}
+
+int code_scanner::create(lua_State * L)
+{
+    new (lua_newuserdata(L, sizeof(code_scanner))) code_scanner();
+    luaL_getmetatable(L, CLASS_NAME);
+    lua_setmetatable(L, -2);
+    return 1;
+}
+
+compiled_program::compiled_program()
+{
+    
+}
+
+compiled_program::~compiled_program()
+{
+    
+}
+
+const program & compiled_program::get_program()const
+{
+    return m_program;
+}
+
+int compiled_program::__gc(lua_State * L)
+{
+    reinterpret_cast<compiled_program *>(
+        luaL_checkudata(L, 1, CLASS_NAME))->~compiled_program();
+    return 0;
+}
+
+const char * compiled_program::CLASS_NAME = "compiled_program";
+
+int compiled_program::register_metatable(lua_State * L)
+{
+    luaL_newmetatable(L, CLASS_NAME);
+    luaL_Reg functions[] = {
+        {"__gc", &compiled_program::__gc},
+        {NULL, NULL}
+    };
+    luaL_register(L, NULL, functions);
+    lua_pop(L, 1);
+    return 0;
+}
+
+int compiled_program::create(lua_State * L)
+{
+    std::size_t source_length;
+    const char * source = mapped_file::check_source(L, 1, &source_length);
+    
+    compiled_program * object = new (lua_newuserdata(L, 
+        sizeof(compiled_program))) compiled_program();
+    
+    luaL_getmetatable(L, CLASS_NAME);
+    lua_setmetatable(L, -2);
+    
+    mapped_file::reader reading(L, 1);
+    compile(source, source + source_length, object->m_program);
+    
+    // A parse error is always the last instruction
+    const program & code = object->m_program;
+    if(!code.size()) return 1;
+    const program::instruction & last = *(code.end() - 1);
+    
+    switch(last.op)
+    {
+        case program::PARSE_ERROR:
+            lua_pushlstring(L, code.string(last), last.operand.string.length);
+            return 2;
+        case program::PARSE_INCOMPLETE:
+            lua_pushstring(L, parse_incomplete().what());
+            return 2;
+        default:
+            return 1;
+    }
+}
+
+mapped_file::mapped_file()
+ :m_readers(0)
+{
+    
+}
+
+mapped_file::~mapped_file()
+{
+    
+}
+
+int mapped_file::__gc(lua_State * L)
+{
+    reinterpret_cast<mapped_file *>(
+        luaL_checkudata(L, 1, CLASS_NAME))->~mapped_file();
+    return 0;
+}
+
+int mapped_file::__len(lua_State * L)
+{
+    lua_pushinteger(L, reinterpret_cast<mapped_file *>(
+        luaL_checkudata(L, 1, CLASS_NAME))->m_file.size());
+    return 1;
+}
+
+int mapped_file::close(lua_State * L)
+{
+    mapped_file * object = reinterpret_cast<mapped_file *>(
+        luaL_checkudata(L, 1, CLASS_NAME));
+    if(object->m_readers) 
+        return luaL_error(L, "attempt to close a mapped file being read");
+    object->m_file.close();
+    return 0;
+}
+
+mapped_file::reader::reader(lua_State * L, int index)
+ :m_file(NULL)
+{
+    if(lua_type(L, index) != LUA_TUSERDATA || !lua_getmetatable(L, index)) 
+        return;
+    
+    luaL_getmetatable(L, CLASS_NAME);
+    if(lua_rawequal(L, -1, -2))
+    {
+        m_file = reinterpret_cast<mapped_file *>(lua_touserdata(L, index));
+        m_file->m_readers++;
+    }
+    lua_pop(L, 2);
+}
+
+mapped_file::reader::~reader()
+{
+    if(m_file) m_file->m_readers--;
+}
+
+const char * mapped_file::check_source(lua_State * L, int index, 
+                                       std::size_t * length)
+{
+    if(lua_type(L, index) == LUA_TUSERDATA)
+    {
+        const ::cubescript::mapped_file & file = reinterpret_cast<
+            mapped_file *>(luaL_checkudata(L, index, CLASS_NAME))->m_file;
+        *length = file.size();
+        return file.begin();
+    }
+    return luaL_checklstring(L, index, length);
+}
+
+const char * mapped_file::CLASS_NAME = "mapped_file";
+
+int mapped_file::register_metatable(lua_State * L)
+{
+    luaL_newmetatable(L, CLASS_NAME);
+    luaL_Reg functions[] = {
+        {"__gc", &mapped_file::__gc},
+        {"__len", &mapped_file::__len},
+        {"close", &mapped_file::close},
+        {NULL, NULL}
+    };
+    luaL_register(L, NULL, functions);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+    lua_pop(L, 1);
+    return 0;
+}
+
+int mapped_file::create(lua_State * L)
+{
+    const char * filename = luaL_checkstring(L, 1);
+    
+    mapped_file * object = new (lua_newuserdata(L, 
+        sizeof(mapped_file))) mapped_file();
+    
+    luaL_getmetatable(L, CLASS_NAME);
+    lua_setmetatable(L, -2);
+    
+    if(!object->m_file.open(filename))
+    {
+        lua_pushnil(L);
+        lua_pushfstring(L, "could not open file '%s'", filename);
+        return 2;
+    }
+    
+    return 1;
+}
+
+compiled_file::compiled_file()
+{
+    
+}
+
+compiled_file::~compiled_file()
+{
+    
+}
+
+int compiled_file::__gc(lua_State * L)
+{
+    reinterpret_cast<compiled_file *>(
+        luaL_checkudata(L, 1, CLASS_NAME))->~compiled_file();
+    return 0;
+}
+
+std::size_t compiled_file::check_chunk(lua_State * L)
+{
+    const ::cubescript::compiled_file & file = reinterpret_cast<
+        compiled_file *>(luaL_checkudata(L, 1, CLASS_NAME))->m_file;
+    lua_Integer index = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, index >= 1 && 
+        static_cast<std::size_t>(index) <= file.size(), 2, 
+        "chunk index out of range");
+    return index - 1;
+}
+
+int compiled_file::size(lua_State * L)
+{
+    lua_pushinteger(L, reinterpret_cast<compiled_file *>(
+        luaL_checkudata(L, 1, CLASS_NAME))->m_file.size());
+    return 1;
+}
+
+int compiled_file::lines(lua_State * L)
+{
+    std::size_t index = check_chunk(L);
+    const ::cubescript::compiled_file & file = reinterpret_cast<
+        compiled_file *>(lua_touserdata(L, 1))->m_file;
+    lua_pushinteger(L, file.first_line(index));
+    lua_pushinteger(L, file.last_line(index));
+    return 2;
+}
+
+int compiled_file::eval(lua_State * L)
+{
+    std::size_t index = check_chunk(L);
+    const ::cubescript::compiled_file & file = reinterpret_cast<
+        compiled_file *>(lua_touserdata(L, 1))->m_file;
+    luaL_checktype(L, 3, LUA_TTABLE);
+    
+    lua_command_stack lua_command(L, 3);
+    
+    int bottom = lua_gettop(L);
+    lua_pushnil(L);
+    
+    try
+    {
+        file.replay(index, lua_command);
+    }
+    catch(const eval_error & error)
+    {
+        lua_pushstring(L, error.what());
+        lua_replace(L, bottom + 1);
+    }
+    
+    return lua_gettop(L) - bottom;
+}
+
+int compiled_file::save(lua_State * L)
+{
+    const ::cubescript::compiled_file & file = reinterpret_cast<
+        compiled_file *>(luaL_checkudata(L, 1, CLASS_NAME))->m_file;
+    std::string image;
+    ::cubescript::save(file, image);
+    lua_pushlstring(L, image.data(), image.length());
+    return 1;
+}
+
+const char * compiled_file::CLASS_NAME = "compiled_file";
+
+int compiled_file::register_metatable(lua_State * L)
+{
+    luaL_newmetatable(L, CLASS_NAME);
+    luaL_Reg functions[] = {
+        {"__gc", &compiled_file::__gc},
+        {"size", &compiled_file::size},
+        {"lines", &compiled_file::lines},
+        {"eval", &compiled_file::eval},
+        {"save", &compiled_file::save},
+        {NULL, NULL}
+    };
+    luaL_register(L, NULL, functions);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+    lua_pop(L, 1);
+    return 0;
+}
+
+int compiled_file::create(lua_State * L)
+{
+    std::size_t source_length;
+    const char * source = mapped_file::check_source(L, 1, &source_length);
+    lua_Integer threads = luaL_optinteger(L, 2, 0);
+    luaL_argcheck(L, threads >= 0, 2, "negative number of threads");
+    
+    compiled_file * object = new (lua_newuserdata(L, 
+        sizeof(compiled_file))) compiled_file();
+    
+    luaL_getmetatable(L, CLASS_NAME);
+    lua_setmetatable(L, -2);
+    
+    mapped_file::reader reading(L, 1);
+    compile_file(source, source + source_length, object->m_file, threads);
+    
+    return 1;
+}
+
+int compiled_file::load(lua_State * L)
+{
+    std::size_t image_length;
+    const char * image = luaL_checklstring(L, 1, &image_length);
+    
+    compiled_file * object = new (lua_newuserdata(L, 
+        sizeof(compiled_file))) compiled_file();
+    
+    luaL_getmetatable(L, CLASS_NAME);
+    lua_setmetatable(L, -2);
+    
+    if(!::cubescript::load(image, image + image_length, object->m_file))
+        return 0;
+    
+    return 1;
+}
+
+ast::ast()
+{
+    
+}
+
+ast::~ast()
+{
+    
+}
+
+int ast::__gc(lua_State * L)
+{
+    reinterpret_cast<ast *>(luaL_checkudata(L, 1, CLASS_NAME))->~ast();
+    return 0;
+}
+
+const ::cubescript::ast::node & ast::check_node(lua_State * L, int narg)
+{
+    const ::cubescript::ast & tree = reinterpret_cast<ast *>(
+        luaL_checkudata(L, 1, CLASS_NAME))->m_ast;
+    lua_Integer index = luaL_checkinteger(L, narg);
+    luaL_argcheck(L, index >= 1 && 
+        static_cast<std::size_t>(index) <= tree.size(), narg, 
+        "node index out of range");
+    return tree.get_node(index - 1);
+}
+
+int ast::root_count(lua_State * L)
+{
+    lua_pushinteger(L, reinterpret_cast<ast *>(
+        luaL_checkudata(L, 1, CLASS_NAME))->m_ast.root_count());
+    return 1;
+}
+
+int ast::root(lua_State * L)
+{
+    const ::cubescript::ast & tree = reinterpret_cast<ast *>(
+        luaL_checkudata(L, 1, CLASS_NAME))->m_ast;
+    lua_Integer index = luaL_checkinteger(L, 2);
+    if(index < 1 || static_cast<std::size_t>(index) > tree.root_count())
+        return 0;
+    lua_pushinteger(L, tree.root(index - 1) + 1);
+    return 1;
+}
+
+int ast::argument_count(lua_State * L)
+{
+    const ::cubescript::ast::node & node = check_node(L, 2);
+    lua_pushinteger(L, node.type == ::cubescript::ast::EXPRESSION ? 
+        node.value.arguments.count : 0);
+    return 1;
+}
+
+int ast::argument(lua_State * L)
+{
+    const ::cubescript::ast::node & node = check_node(L, 2);
+    lua_Integer index = luaL_checkinteger(L, 3);
+    if(node.type != ::cubescript::ast::EXPRESSION || index < 1 || 
+       static_cast<std::size_t>(index) > node.value.arguments.count)
+        return 0;
+    const ::cubescript::ast & tree = reinterpret_cast<ast *>(
+        lua_touserdata(L, 1))->m_ast;
+    lua_pushinteger(L, tree.argument(node, index - 1) + 1);
+    return 1;
+}
+
+int ast::is_expression(lua_State * L)
+{
+    lua_pushboolean(L, check_node(L, 2).type == ::cubescript::ast::EXPRESSION);
+    return 1;
+}
+
+int ast::is_symbol(lua_State * L)
+{
+    lua_pushboolean(L, check_node(L, 2).type == ::cubescript::ast::SYMBOL);
+    return 1;
+}
+
+int ast::value(lua_State * L)
+{
+    const ::cubescript::ast::node & node = check_node(L, 2);
+    const ::cubescript::ast & tree = reinterpret_cast<ast *>(
+        lua_touserdata(L, 1))->m_ast;
+    switch(node.type)
+    {
+        case ::cubescript::ast::SYMBOL:
+        case ::cubescript::ast::STRING:
+            lua_pushlstring(L, tree.string(node), node.value.string.length);
+            break;
+        case ::cubescript::ast::BOOLEAN:
+            lua_pushboolean(L, node.value.boolean);
+            break;
+        case ::cubescript::ast::INTEGER:
+            lua_pushnumber(L, static_cast<lua_Number>(node.value.integer));
+            break;
+        case ::cubescript::ast::REAL:
+            lua_pushnumber(L, node.value.real);
+            break;
+        default:
+            lua_pushnil(L);
+    }
+    return 1;
+}
+
+const char * ast::CLASS_NAME = "ast";
+
+int ast::register_metatable(lua_State * L)
+{
+    luaL_newmetatable(L, CLASS_NAME);
+    luaL_Reg functions[] = {
+        {"__gc", &ast::__gc},
+        {"root_count", &ast::root_count},
+        {"root", &ast::root},
+        {"argument_count", &ast::argument_count},
+        {"argument", &ast::argument},
+        {"is_expression", &ast::is_expression},
+        {"is_symbol", &ast::is_symbol},
+        {"value", &ast::value},
+        {NULL, NULL}
+    };
+    luaL_register(L, NULL, functions);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+    lua_pop(L, 1);
+    return 0;
+}
+
+int ast::create(lua_State * L)
+{
+    std::size_t source_length;
+    const char * source = luaL_checklstring(L, 1, &source_length);
+    
+    ast * object = new (lua_newuserdata(L, sizeof(ast))) ast();
+    
+    luaL_getmetatable(L, CLASS_NAME);
+    lua_setmetatable(L, -2);
+    
+    eval_status status = parse(source, source + source_length, 
+                               object->m_ast);
+    
+    if(status.error == eval_status::OK) return 1;
+    
+    std::string message = status.message();
+    lua_pushlstring(L, message.c_str(), message.length());
+    return 2;
+}
+
 proxy_command_stack::proxy_command_stack(lua_State * L)
  :m_state(L),
   m_push_command(LUA_NOREF),
   m_push_argument_symbol(LUA_NOREF),
   m_push_argument(LUA_NOREF),
   m_pop_string(LUA_NOREF),
-  m_call(LUA_NOREF)
+  m_call(LUA_NOREF),
+  m_batch(LUA_NOREF),
+  m_depth(0),
+  m_commands(0)
 {
     
 }
@@ -263,6 +952,7 @@ proxy_command_stack::~proxy_command_stack()
     luaL_unref(m_state, LUA_REGISTRYINDEX, m_push_argument);
     luaL_unref(m_state, LUA_REGISTRYINDEX, m_pop_string);
     luaL_unref(m_state, LUA_REGISTRYINDEX, m_call);
+    luaL_unref(m_state, LUA_REGISTRYINDEX, m_batch);
 }
 
 int proxy_command_stack::__gc(lua_State * L)
@@ -272,8 +962,94 @@ int proxy_command_stack::__gc(lua_State * L)
     return 0;
 }
 
+proxy_command_stack::operation & proxy_command_stack::add_operation(
+    operation::operation_kind kind, operation::value_type type)
+{
+    m_operations.push_back(operation());
+    operation & added = m_operations.back();
+    added.kind = kind;
+    added.type = type;
+    return added;
+}
+
+void proxy_command_stack::add_string_operation(
+    operation::operation_kind kind, const char * value, std::size_t length)
+{
+    operation & added = add_operation(kind, operation::STRING);
+    added.string_offset = m_strings.length();
+    added.string_length = length;
+    m_strings.append(value, length);
+}
+
+void proxy_command_stack::flush()
+{
+    if(m_operations.empty()) return;
+    
+    static const char * names[] = {
+        "push_command",
+        "push_argument_symbol",
+        "push_argument",
+        "call"
+    };
+    
+    std::size_t count = m_operations.size();
+    
+    lua_rawgeti(m_state, LUA_REGISTRYINDEX, m_batch);
+    lua_createtable(m_state, count * 2, 0);
+    
+    for(std::size_t i = 0; i < count; i++)
+    {
+        const operation & op = m_operations[i];
+        
+        lua_pushstring(m_state, names[op.kind]);
+        lua_rawseti(m_state, -2, i * 2 + 1);
+        
+        switch(op.type)
+        {
+            case operation::NIL:
+                continue;
+            case operation::BOOLEAN:
+                lua_pushboolean(m_state, op.boolean);
+                break;
+            case operation::NUMBER:
+                lua_pushnumber(m_state, op.number);
+                break;
+            case operation::STRING:
+                lua_pushlstring(m_state, m_strings.data() + op.string_offset,
+                                op.string_length);
+                break;
+        }
+        
+        lua_rawseti(m_state, -2, i * 2 + 2);
+    }
+    
+    lua_pushinteger(m_state, count);
+    
+    m_operations.clear();
+    m_strings.clear();
+    
+    if(::lua::pcall(m_state, 2, 0) != 0)
+        throw command_error("internal error in batch command");
+}
+
+void proxy_command_stack::discard()
+{
+    m_operations.clear();
+    m_strings.clear();
+    m_depth = 0;
+    m_commands = 0;
+}
+
 std::size_t proxy_command_stack::push_command()
 {
+    if(m_batch != LUA_NOREF)
+    {
+        m_depth++;
+        add_operation(operation::PUSH_COMMAND, operation::NUMBER).number = 
+            ++m_commands;
+        return m_commands;
+    }
+    
     if(m_push_command == LUA_NOREF)
         throw command_error("no function bound for push command");
     
@@ -288,6 +1064,13 @@ std::size_t proxy_command_stack::push_command()
 void proxy_command_stack::push_argument_symbol(
     const char * value, std::size_t value_length)
 {
+    if(m_batch != LUA_NOREF)
+    {
+        add_string_operation(operation::PUSH_ARGUMENT_SYMBOL, value, 
+                             value_length);
+        return;
+    }
+    
     if(m_push_argument_symbol == LUA_NOREF)
         throw command_error("no function bound for push argument symbol");
     
@@ -314,12 +1097,25 @@ void proxy_command_stack::call_push_argument(int nargs, int nresults)
 
 void proxy_command_stack::push_argument()
 {
+    if(m_batch != LUA_NOREF)
+    {
+        add_operation(operation::PUSH_ARGUMENT, operation::NIL);
+        return;
+    }
+    
     setup_push_argument_call();
     call_push_argument(0, 0);
 }
 
 void proxy_command_stack::push_argument(bool value)
 {
+    if(m_batch != LUA_NOREF)
+    {
+        add_operation(operation::PUSH_ARGUMENT, operation::BOOLEAN).boolean = 
+            value;
+        return;
+    }
+    
     setup_push_argument_call();
     lua_pushboolean(m_state, value);
     call_push_argument(1, 0);
@@ -327,6 +1123,13 @@ void proxy_command_stack::push_argument(bool value)
 
 void proxy_command_stack::push_argument(int value)
 {
+    if(m_batch != LUA_NOREF)
+    {
+        add_operation(operation::PUSH_ARGUMENT, operation::NUMBER).number = 
+            value;
+        return;
+    }
+    
     setup_push_argument_call();
     lua_pushinteger(m_state, value);
     call_push_argument(1, 0);
@@ -334,6 +1137,41 @@ void proxy_command_stack::push_argument(int value)
 
 void proxy_command_stack::push_argument(float value)
 {
+    if(m_batch != LUA_NOREF)
+    {
+        add_operation(operation::PUSH_ARGUMENT, operation::NUMBER).number = 
+            value;
+        return;
+    }
+    
+    setup_push_argument_call();
+    lua_pushnumber(m_state, value);
+    call_push_argument(1, 0);
+}
+
+void proxy_command_stack::push_argument(long long value)
+{
+    if(m_batch != LUA_NOREF)
+    {
+        add_operation(operation::PUSH_ARGUMENT, operation::NUMBER).number = 
+            static_cast<lua_Number>(value);
+        return;
+    }
+    
+    setup_push_argument_call();
+    lua_pushnumber(m_state, static_cast<lua_Number>(value));
+    call_push_argument(1, 0);
+}
+
+void proxy_command_stack::push_argument(double value)
+{
+    if(m_batch != LUA_NOREF)
+    {
+        add_operation(operation::PUSH_ARGUMENT, operation::NUMBER).number = 
+            value;
+        return;
+    }
+    
     setup_push_argument_call();
     lua_pushnumber(m_state, value);
     call_push_argument(1, 0);
@@ -342,6 +1180,12 @@ void proxy_command_stack::push_argument(float value)
 void proxy_command_stack::push_argument(
     const char * value, std::size_t value_length)
 {
+    if(m_batch != LUA_NOREF)
+    {
+        add_string_operation(operation::PUSH_ARGUMENT, value, value_length);
+        return;
+    }
+    
     setup_push_argument_call();
     lua_pushlstring(m_state, value, value_length);
     call_push_argument(1, 0);
@@ -352,6 +1196,8 @@ std::string proxy_command_stack::pop_string()
     if(m_pop_string == LUA_NOREF)
         throw command_error("no function bound for pop string");
     
+    if(m_batch != LUA_NOREF) flush();
+    
     lua_rawgeti(m_state, LUA_REGISTRYINDEX, m_pop_string);
     
     if(::lua::pcall(m_state, 0, 1) != 0)
@@ -362,6 +1208,17 @@ std::string proxy_command_stack::pop_string()
 
 void proxy_command_stack::call(std::size_t index)
 {
+    if(m_batch != LUA_NOREF)
+    {
+        add_operation(operation::CALL, operation::NUMBER).number = index;
+        if(--m_depth == 0)
+        {
+            m_commands = 0;
+            flush();
+        }
+        return;
+    }
+    
     if(m_call == LUA_NOREF)
         throw command_error("no function bound for call command");
     
@@ -427,6 +1284,12 @@ int proxy_command_stack::create(lua_State * L)
         object->m_call = luaL_ref(L, LUA_REGISTRYINDEX);
     else lua_pop(L, 1);
     
+    lua_pushliteral(L, "batch");
+    lua_gettable(L, -2);
+    if(lua_type(L, -1) == LUA_TFUNCTION)
+        object->m_batch = luaL_ref(L, LUA_REGISTRYINDEX);
+    else lua_pop(L, 1);
+    
     lua_pop(L, 1);
     
     luaL_getmetatable(L, CLASS_NAME);
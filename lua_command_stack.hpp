@@ -24,6 +24,11 @@
 
 #include <lua.hpp>
 #include "cubescript.hpp"
+#include "bytecode.hpp"
+#include "ast.hpp"
+#include "to_lua.hpp"
+#include "parallel_compile.hpp"
+#include "mapped_file.hpp"
 
 namespace cubescript{
 
@@ -52,6 +57,8 @@ public:
     void push_argument(bool);
     void push_argument(int);
     void push_argument(float);
+    void push_argument(long long);
+    void push_argument(double);
     void push_argument(const char *, std::size_t);
     std::string pop_string();
     void call(std::size_t);
@@ -63,20 +70,222 @@ private:
 namespace lua{
 
 /**
-    A lua wrapper function for eval() (declared in cubescript.hpp).
+    A lua wrapper function for eval() (declared in cubescript.hpp). The code
+    argument can be a string, a mapped_file or a compiled_program object.
 */
 int eval(lua_State * L);
 
+/**
+    Evaluate a script file mapped into memory, with the same results as the
+    eval function, e.g. eval_file(filename, env). Strings without escape
+    sequences are passed to the command stack straight from the mapped 
+    pages. Returns nil and an error message if the file can't be mapped.
+*/
+int eval_file(lua_State * L);
+
 /**
     A lua wrapper function for is_complete_code() (declared in cubescript.hpp)
 */
 int is_complete_code(lua_State * L);
 
+/**
+    A lua wrapper function for generate_lua_code() and generate_lua_function()
+    (declared in to_lua.hpp). Called as to_lua(code) or, to generate a
+    function, to_lua(body, parameters). An optional third argument is a table
+    of the lua_code_options flags to change, by name. Returns the Lua code, 
+    or nil and an error message.
+*/
+int to_lua(lua_State * L);
+
+/**
+    Returns LUA_CODE_VERSION (declared in to_lua.hpp).
+*/
+int lua_code_version(lua_State * L);
+
+/**
+    Returns the program::hash (declared in bytecode.hpp) of a string, as a 
+    string of hex digits.
+*/
+int source_hash(lua_State * L);
+
+/**
+    A Lua userdata object wrapping a code_scanner (declared in cubescript.hpp).
+    Lua methods: feed(code) returns true when the code fed so far is complete,
+    is_complete() and reset().
+*/
+class code_scanner
+{
+public:
+    static const char * CLASS_NAME;
+    static int register_metatable(lua_State * L);
+    static int create(lua_State *);
+private:
+    code_scanner();
+    ~code_scanner();
+    static int __gc(lua_State * L);
+    static int feed(lua_State * L);
+    static int is_complete(lua_State * L);
+    static int reset(lua_State * L);
+    
+    ::cubescript::code_scanner m_scanner;
+};
+
+/**
+    A program (declared in bytecode.hpp) owned by a Lua userdata object. The
+    create function is a lua wrapper for compile(). If the code has a parse
+    error it also returns the error message, which eval raises when the
+    program reaches the error.
+*/
+class compiled_program
+{
+public:
+    static const char * CLASS_NAME;
+    static int register_metatable(lua_State * L);
+    static int create(lua_State *);
+    
+    const program & get_program()const;
+private:
+    compiled_program();
+    ~compiled_program();
+    static int __gc(lua_State * L);
+    
+    program m_program;
+};
+
+/**
+    A mapped_file (declared in mapped_file.hpp) owned by a Lua userdata 
+    object. The create function takes a filename, and returns nil and an 
+    error message if the file can't be mapped. The object can be used in 
+    place of a source code string by eval, compile, compile_file and hash, 
+    and #file is the length of the code. Lua methods: close() unmaps the file
+    before the object is collected, leaving it empty. Closing a file that is
+    being read (e.g. by a command called from eval) raises an error.
+*/
+class mapped_file
+{
+public:
+    static const char * CLASS_NAME;
+    static int register_metatable(lua_State * L);
+    static int create(lua_State *);
+    
+    /**
+        Return the source code argument at the stack index, which can be a 
+        string or a mapped_file object.
+    */
+    static const char * check_source(lua_State * L, int index, 
+                                     std::size_t * length);
+    
+    /**
+        Marks the mapped_file object at the stack index as being read for 
+        the lifetime of the reader, so that close() fails instead of 
+        unmapping the code being read. Other values are ignored. A Lua error 
+        that unwinds past the reader leaves the file open until the object 
+        is collected.
+    */
+    class reader
+    {
+    public:
+        reader(lua_State * L, int index);
+        ~reader();
+    private:
+        reader(const reader &);
+        reader & operator=(const reader &);
+        
+        mapped_file * m_file;
+    };
+private:
+    mapped_file();
+    ~mapped_file();
+    static int __gc(lua_State * L);
+    static int __len(lua_State * L);
+    static int close(lua_State * L);
+    
+    ::cubescript::mapped_file m_file;
+    int m_readers;
+    
+    friend int eval_file(lua_State *);
+};
+
+/**
+    A compiled_file (declared in parallel_compile.hpp) owned by a Lua 
+    userdata object. The create function is a lua wrapper for compile_file(),
+    taking the source code and the optional number of threads. Lua methods: 
+    size(), lines(i) returns the first and last line numbers of a chunk,
+    eval(i, env) runs a chunk with the same results as the eval function, and
+    save() returns the compiled file as a string. The load function creates
+    the object from a saved string, returning nil if it isn't valid.
+*/
+class compiled_file
+{
+public:
+    static const char * CLASS_NAME;
+    static int register_metatable(lua_State * L);
+    static int create(lua_State *);
+    static int load(lua_State *);
+private:
+    compiled_file();
+    ~compiled_file();
+    static int __gc(lua_State * L);
+    static int size(lua_State * L);
+    static int lines(lua_State * L);
+    static int eval(lua_State * L);
+    static int save(lua_State * L);
+    
+    static std::size_t check_chunk(lua_State * L);
+    
+    ::cubescript::compiled_file m_file;
+};
+
+/**
+    A syntax tree (declared in ast.hpp) owned by a Lua userdata object. The 
+    create function is a lua wrapper for parse(), returning the tree and the
+    parse error message, if there was an error.
+    
+    Nodes are referred to by their index, counting from 1 as Lua does. Lua 
+    methods: root_count(), root(i), argument_count(node), argument(node, i),
+    is_expression(node), is_symbol(node) and value(node), which returns the 
+    value that eval() would push to the command stack for a literal, or the 
+    name of a symbol.
+*/
+class ast
+{
+public:
+    static const char * CLASS_NAME;
+    static int register_metatable(lua_State * L);
+    static int create(lua_State *);
+private:
+    ast();
+    ~ast();
+    static int __gc(lua_State * L);
+    static int root_count(lua_State * L);
+    static int root(lua_State * L);
+    static int argument_count(lua_State * L);
+    static int argument(lua_State * L);
+    static int is_expression(lua_State * L);
+    static int is_symbol(lua_State * L);
+    static int value(lua_State * L);
+    
+    static const ::cubescript::ast::node & check_node(lua_State * L, int);
+    
+    ::cubescript::ast m_ast;
+};
+
 /**
     For implementing command stacks in Lua code
     
     Used by the Cubescript runtime library for translating Cubescript code to 
     Lua code.
+    
+    The create function takes a table of Lua functions named after the 
+    command_stack methods. If the table has a batch function, the push and 
+    call operations are instead collected until the end of each root 
+    expression and then passed to batch(operations, count) in one call. The
+    operations table holds count pairs of the method name and its argument:
+    push_argument has the value (nil for push_argument()), 
+    push_argument_symbol has the name, and push_command and call have a 
+    number identifying the command. Collected operations are also passed to 
+    batch before each pop_string call. The eval function discards the 
+    operations of an expression that is cut off by an error.
 */
 class proxy_command_stack:public command_stack
 {
@@ -91,10 +300,48 @@ public:
     void push_argument(bool);
     void push_argument(int);
     void push_argument(float);
+    void push_argument(long long);
+    void push_argument(double);
     void push_argument(const char *, std::size_t);
     std::string pop_string();
     void call(std::size_t);
+    
+    /**
+        Pass the collected operations to the batch function.
+    */
+    void flush();
+    
+    /**
+        Discard the collected operations of an unfinished expression.
+    */
+    void discard();
 private:
+    struct operation
+    {
+        enum operation_kind
+        {
+            PUSH_COMMAND = 0,
+            PUSH_ARGUMENT_SYMBOL,
+            PUSH_ARGUMENT,
+            CALL
+        };
+        
+        enum value_type
+        {
+            NIL = 0,
+            BOOLEAN,
+            NUMBER,
+            STRING
+        };
+        
+        operation_kind kind;
+        value_type type;
+        bool boolean;
+        lua_Number number;
+        std::size_t string_offset;
+        std::size_t string_length;
+    };
+    
     proxy_command_stack(lua_State *);
     ~proxy_command_stack();
     static int __gc(lua_State * L);
@@ -102,12 +349,23 @@ private:
     void setup_push_argument_call();
     void call_push_argument(int nargs, int nresults);
     
+    operation & add_operation(operation::operation_kind, 
+                              operation::value_type);
+    void add_string_operation(operation::operation_kind, const char *, 
+                              std::size_t);
+    
     lua_State * m_state;
     int m_push_command;
     int m_push_argument_symbol;
     int m_push_argument;
     int m_pop_string;
     int m_call;
+    int m_batch;
+    
+    std::vector<operation> m_operations;
+    std::string m_strings;
+    std::size_t m_depth;
+    std::size_t m_commands;
 };
 
 } //namespace lua
@@ -0,0 +1,194 @@
+/*
+  Copyright (c) 2010 Graham Daws <graham.daws@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#include <cstring>
+#include "lua_exec_file.hpp"
+#include "lua_command_stack.hpp"
+#include "eval.hpp"
+
+namespace cubescript{
+namespace lua{
+
+script_file::script_file()
+ :m_file(NULL)
+{
+    
+}
+
+script_file::~script_file()
+{
+    if(m_file) std::fclose(m_file);
+}
+
+int script_file::__gc(lua_State * L)
+{
+    reinterpret_cast<script_file *>(
+        luaL_checkudata(L, 1, CLASS_NAME))->~script_file();
+    return 0;
+}
+
+const char * script_file::CLASS_NAME = "script_file";
+
+int script_file::register_metatable(lua_State * L)
+{
+    luaL_newmetatable(L, CLASS_NAME);
+    luaL_Reg functions[] = {
+        {"__gc", &script_file::__gc},
+        {NULL, NULL}
+    };
+    luaL_register(L, NULL, functions);
+    lua_pop(L, 1);
+    return 0;
+}
+
+int script_file::exec(lua_State * L)
+{
+    const char * filename = luaL_checkstring(L, 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    bool has_location = !lua_isnoneornil(L, 3);
+    if(has_location) luaL_checktype(L, 3, LUA_TTABLE);
+    lua_settop(L, 3);
+    
+    script_file * object = new (lua_newuserdata(L, 
+        sizeof(script_file))) script_file();
+    
+    luaL_getmetatable(L, CLASS_NAME);
+    lua_setmetatable(L, -2);
+    
+    object->m_file = std::fopen(filename, "r");
+    if(!object->m_file)
+    {
+        lua_pushnil(L);
+        lua_pushfstring(L, "could not open file '%s'", filename);
+        return 2;
+    }
+    
+    std::string & expression = object->m_expression;
+    
+    lua_command_stack lua_command(L, 2);
+    ::cubescript::code_scanner scanner;
+    
+    int bottom = lua_gettop(L);
+    
+    std::size_t line_number = 1;
+    std::size_t first_line = 1;
+    
+    // Offset in the expression of the line being read, which can be split
+    // across blocks
+    std::size_t line_start = 0;
+    
+    char block[65536];
+    bool end_of_file = false;
+    
+    while(!end_of_file)
+    {
+        std::size_t block_size = std::fread(block, 1, sizeof(block), 
+                                            object->m_file);
+        const char * cursor = block;
+        const char * block_end = block + block_size;
+        
+        if(block_size < sizeof(block)) end_of_file = true;
+        
+        while(cursor != block_end || 
+              (end_of_file && line_start != expression.length()))
+        {
+            const char * line_end = reinterpret_cast<const char *>(
+                std::memchr(cursor, '\n', block_end - cursor));
+            
+            if(line_end) line_end++;
+            else
+            {
+                expression.append(cursor, block_end);
+                cursor = block_end;
+                if(!end_of_file) break;
+                
+                // The last line of the file has no new line character
+                expression += '\n';
+                line_end = block_end;
+            }
+            
+            expression.append(cursor, line_end);
+            cursor = line_end;
+            
+            const char * code = expression.data();
+            bool complete = scanner.feed(code + line_start, 
+                                         code + expression.length());
+            
+            line_start = expression.length();
+            
+            if(complete)
+            {
+                if(has_location)
+                {
+                    lua_pushinteger(L, first_line);
+                    lua_setfield(L, 3, "line");
+                }
+                
+                const char * code_end = code + expression.length();
+                bool failed = false;
+                std::string error_message;
+                
+                try
+                {
+                    eval_status status = try_eval(&code, code_end, 
+                                                  lua_command);
+                    if(status.error != eval_status::OK)
+                    {
+                        failed = true;
+                        error_message = status.message();
+                    }
+                }
+                catch(const eval_error & error)
+                {
+                    failed = true;
+                    error_message = error.what();
+                }
+                
+                lua_settop(L, bottom);
+                
+                if(failed)
+                {
+                    lua_pushboolean(L, 0);
+                    lua_pushlstring(L, error_message.data(), 
+                                    error_message.length());
+                    lua_pushinteger(L, line_number);
+                    return 3;
+                }
+                
+                expression.clear();
+                scanner.reset();
+                line_start = 0;
+                first_line = line_number + 1;
+            }
+            
+            line_number++;
+        }
+    }
+    
+    std::fclose(object->m_file);
+    object->m_file = NULL;
+    
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+} //namespace lua
+} //namespace cubescript
@@ -0,0 +1,65 @@
+/*
+  Copyright (c) 2010 Graham Daws <graham.daws@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#ifndef CUBESCRIPT_LUA_EXEC_FILE_HPP
+#define CUBESCRIPT_LUA_EXEC_FILE_HPP
+
+#include <lua.hpp>
+#include <cstdio>
+#include <string>
+
+namespace cubescript{
+namespace lua{
+
+/**
+    Runs a Cubescript file one root expression at a time, with the same 
+    results as feeding the file to a code_scanner line by line and calling 
+    eval each time the code read so far is complete. The file is read in 
+    blocks as the expressions are run. Its state is kept in a Lua userdata 
+    object, so that the file is closed by the garbage collector if a Lua 
+    error interrupts the execution.
+    
+    The exec function is called as exec_file(filename, env [, location]).
+    Before an expression is run, the number of the line it starts on is 
+    stored in location.line. Returns true when the whole file has been run;
+    false, the error message and the number of the line the expression ends 
+    on when an expression fails; or nil and an error message if the file 
+    can't be opened. Incomplete code at the end of the file is left out.
+*/
+class script_file
+{
+public:
+    static const char * CLASS_NAME;
+    static int register_metatable(lua_State * L);
+    static int exec(lua_State * L);
+private:
+    script_file();
+    ~script_file();
+    static int __gc(lua_State * L);
+    
+    std::FILE * m_file;
+    std::string m_expression;
+};
+
+} //namespace lua
+} //namespace cubescript
+
+#endif
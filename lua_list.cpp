@@ -0,0 +1,342 @@
+/*
+  Copyright (c) 2010 Graham Daws <graham.daws@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#include "lua_list.hpp"
+#include <algorithm>
+#include <string>
+#include <cstring>
+#include <climits>
+#include <new>
+
+namespace cubescript{
+namespace lua{
+
+// Registry field of the table mapping list strings to their list objects.
+// The table has weak values, so a list is dropped once it's no longer used.
+static const char * LIST_CACHE_KEY = "cubescript_list_cache";
+
+static bool is_element_char(unsigned char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           (c >= '0' && c <= '9') || c == '_';
+}
+
+list::list()
+ :m_source(NULL), m_source_ref(LUA_NOREF)
+{
+    
+}
+
+list::~list()
+{
+    
+}
+
+void list::parse(const char * source, std::size_t length)
+{
+    m_source = source;
+    
+    std::size_t i = 0;
+    while(i < length)
+    {
+        if(!is_element_char(source[i]))
+        {
+            i++;
+            continue;
+        }
+        
+        m_offsets.push_back(i);
+        while(i < length && is_element_char(source[i])) i++;
+        m_offsets.push_back(i);
+    }
+}
+
+std::size_t list::size()const
+{
+    return m_offsets.size() / 2;
+}
+
+const char * list::element(std::size_t index, std::size_t & length)const
+{
+    unsigned int start = m_offsets[index * 2];
+    length = m_offsets[index * 2 + 1] - start;
+    return m_source + start;
+}
+
+list * list::check_list(lua_State * L, int index)
+{
+    return reinterpret_cast<list *>(luaL_checkudata(L, index, CLASS_NAME));
+}
+
+list * list::to_list(lua_State * L, int index)
+{
+    if(index < 0) index = lua_gettop(L) + index + 1;
+    
+    if(lua_type(L, index) == LUA_TUSERDATA)
+    {
+        list * object = check_list(L, index);
+        lua_pushvalue(L, index);
+        return object;
+    }
+    
+    std::size_t length;
+    const char * source = luaL_checklstring(L, index, &length);
+    luaL_argcheck(L, length < UINT_MAX, index, "list string too long");
+    
+    lua_pushstring(L, LIST_CACHE_KEY);
+    lua_rawget(L, LUA_REGISTRYINDEX);
+    
+    if(lua_type(L, -1) != LUA_TTABLE)
+    {
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_newtable(L);
+        lua_pushliteral(L, "v");
+        lua_setfield(L, -2, "__mode");
+        lua_setmetatable(L, -2);
+        lua_pushstring(L, LIST_CACHE_KEY);
+        lua_pushvalue(L, -2);
+        lua_rawset(L, LUA_REGISTRYINDEX);
+    }
+    
+    int cache = lua_gettop(L);
+    
+    lua_pushvalue(L, index);
+    lua_rawget(L, cache);
+    
+    if(lua_type(L, -1) == LUA_TUSERDATA)
+    {
+        lua_remove(L, cache);
+        return reinterpret_cast<list *>(lua_touserdata(L, -1));
+    }
+    
+    lua_pop(L, 1);
+    
+    list * object = new (lua_newuserdata(L, sizeof(list))) list();
+    
+    luaL_getmetatable(L, CLASS_NAME);
+    lua_setmetatable(L, -2);
+    
+    lua_pushvalue(L, index);
+    object->m_source_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    object->parse(source, length);
+    
+    lua_pushvalue(L, index);
+    lua_pushvalue(L, -2);
+    lua_rawset(L, cache);
+    
+    lua_remove(L, cache);
+    return object;
+}
+
+int list::__gc(lua_State * L)
+{
+    list * object = check_list(L, 1);
+    luaL_unref(L, LUA_REGISTRYINDEX, object->m_source_ref);
+    object->~list();
+    return 0;
+}
+
+int list::__index(lua_State * L)
+{
+    list * object = check_list(L, 1);
+    
+    if(lua_type(L, 2) == LUA_TNUMBER)
+    {
+        lua_Number index = lua_tonumber(L, 2);
+        if(index >= 1 && index <= object->size() &&
+           index == static_cast<std::size_t>(index))
+        {
+            std::size_t length;
+            const char * value = object->element(
+                static_cast<std::size_t>(index) - 1, length);
+            lua_pushlstring(L, value, length);
+        }
+        else lua_pushnil(L);
+        return 1;
+    }
+    
+    lua_getmetatable(L, 1);
+    lua_pushvalue(L, 2);
+    lua_rawget(L, -2);
+    return 1;
+}
+
+int list::__len(lua_State * L)
+{
+    lua_pushinteger(L, check_list(L, 1)->size());
+    return 1;
+}
+
+int list::find(lua_State * L)
+{
+    list * object = check_list(L, 1);
+    std::size_t value_length;
+    const char * value = luaL_checklstring(L, 2, &value_length);
+    
+    for(std::size_t i = 0; i < object->size(); i++)
+    {
+        std::size_t length;
+        const char * element = object->element(i, length);
+        if(length == value_length && 
+           std::memcmp(element, value, length) == 0)
+        {
+            lua_pushinteger(L, i + 1);
+            return 1;
+        }
+    }
+    
+    lua_pushinteger(L, -1);
+    return 1;
+}
+
+static int compare_elements(const char * a, std::size_t a_length,
+                            const char * b, std::size_t b_length)
+{
+    int compare = std::memcmp(a, b, std::min(a_length, b_length));
+    if(compare) return compare;
+    return a_length < b_length ? -1 : (a_length > b_length ? 1 : 0);
+}
+
+namespace{
+
+class element_less
+{
+public:
+    element_less(const char * source, const std::vector<unsigned int> & offsets)
+     :m_source(source), m_offsets(offsets){}
+    
+    bool operator()(std::size_t a, std::size_t b)const
+    {
+        const char * a_string = m_source + m_offsets[a * 2];
+        std::size_t a_length = m_offsets[a * 2 + 1] - m_offsets[a * 2];
+        const char * b_string = m_source + m_offsets[b * 2];
+        std::size_t b_length = m_offsets[b * 2 + 1] - m_offsets[b * 2];
+        
+        return compare_elements(a_string, a_length, b_string, b_length) < 0;
+    }
+private:
+    const char * m_source;
+    const std::vector<unsigned int> & m_offsets;
+};
+
+} //namespace
+
+int list::sorted(lua_State * L)
+{
+    list * object = check_list(L, 1);
+    
+    std::vector<std::size_t> order(object->size());
+    for(std::size_t i = 0; i < order.size(); i++) order[i] = i;
+    std::sort(order.begin(), order.end(), 
+        element_less(object->m_source, object->m_offsets));
+    
+    // The elements end before the end of the last one in the source
+    std::size_t source_length = 
+        object->m_offsets.empty() ? 0 : object->m_offsets.back();
+    
+    std::string output;
+    output.reserve(source_length + order.size());
+    
+    for(std::size_t i = 0; i < order.size(); i++)
+    {
+        if(i) output += ' ';
+        std::size_t length;
+        const char * element = object->element(order[i], length);
+        output.append(element, length);
+    }
+    
+    lua_pushlstring(L, output.data(), output.length());
+    return 1;
+}
+
+int list::remove(lua_State * L)
+{
+    list * object = check_list(L, 1);
+    list * other = to_list(L, 2);
+    
+    std::vector<std::size_t> other_order(other->size());
+    for(std::size_t i = 0; i < other_order.size(); i++) other_order[i] = i;
+    
+    element_less other_less(other->m_source, other->m_offsets);
+    std::sort(other_order.begin(), other_order.end(), other_less);
+    
+    std::string output;
+    
+    for(std::size_t i = 0; i < object->size(); i++)
+    {
+        std::size_t length;
+        const char * element = object->element(i, length);
+        
+        // Binary search for the element among the sorted elements of other
+        std::size_t low = 0;
+        std::size_t high = other_order.size();
+        bool found = false;
+        while(low < high && !found)
+        {
+            std::size_t middle = (low + high) / 2;
+            std::size_t other_length;
+            const char * other_element = other->element(
+                other_order[middle], other_length);
+            int compare = compare_elements(element, length,
+                                           other_element, other_length);
+            if(compare < 0) high = middle;
+            else if(compare > 0) low = middle + 1;
+            else found = true;
+        }
+        
+        if(found) continue;
+        
+        if(!output.empty()) output += ' ';
+        output.append(element, length);
+    }
+    
+    lua_pushlstring(L, output.data(), output.length());
+    return 1;
+}
+
+const char * list::CLASS_NAME = "list";
+
+int list::register_metatable(lua_State * L)
+{
+    luaL_newmetatable(L, CLASS_NAME);
+    luaL_Reg functions[] = {
+        {"__gc", &list::__gc},
+        {"__index", &list::__index},
+        {"__len", &list::__len},
+        {"find", &list::find},
+        {"sorted", &list::sorted},
+        {"remove", &list::remove},
+        {NULL, NULL}
+    };
+    luaL_register(L, NULL, functions);
+    lua_pop(L, 1);
+    return 0;
+}
+
+int list::create(lua_State * L)
+{
+    to_list(L, 1);
+    return 1;
+}
+
+} //namespace lua
+} //namespace cubescript
@@ -0,0 +1,77 @@
+/*
+  Copyright (c) 2010 Graham Daws <graham.daws@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#ifndef CUBESCRIPT_LUA_LIST_HPP
+#define CUBESCRIPT_LUA_LIST_HPP
+
+#include <lua.hpp>
+#include <vector>
+
+namespace cubescript{
+namespace lua{
+
+/**
+    A Cubescript list string parsed into the offsets of its elements, owned by
+    a Lua userdata object. The elements of a list are its runs of letters,
+    digits and underscores.
+    
+    The create function takes the list string and returns the list object for
+    it, which is cached for as long as the object is in use, so a string is
+    only parsed once. Elements are indexed from 1 as Lua tables are, and
+    #list is the number of elements. Lua methods: find(value) returns the index
+    of the first element equal to value, or -1; sorted() returns the elements
+    in ascending order and remove(other) returns the elements not in the list
+    or list string other, both as a list string.
+*/
+class list
+{
+public:
+    static const char * CLASS_NAME;
+    static int register_metatable(lua_State * L);
+    static int create(lua_State *);
+private:
+    list();
+    ~list();
+    static int __gc(lua_State * L);
+    static int __index(lua_State * L);
+    static int __len(lua_State * L);
+    static int find(lua_State * L);
+    static int sorted(lua_State * L);
+    static int remove(lua_State * L);
+    
+    static list * check_list(lua_State * L, int index);
+    static list * to_list(lua_State * L, int index);
+    
+    void parse(const char * source, std::size_t length);
+    std::size_t size()const;
+    const char * element(std::size_t index, std::size_t & length)const;
+    
+    const char * m_source;
+    int m_source_ref;
+    
+    // The start and end offsets of each element, in pairs
+    std::vector<unsigned int> m_offsets;
+};
+
+} //namespace lua
+} //namespace cubescript
+
+#endif
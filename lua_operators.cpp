@@ -0,0 +1,273 @@
+/*
+  Copyright (c) 2010 Graham Daws <graham.daws@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#include "lua_operators.hpp"
+#include <cmath>
+#include <cstring>
+
+namespace cubescript{
+namespace lua{
+
+static int call_fallback(lua_State * L)
+{
+    lua_pushvalue(L, lua_upvalueindex(1));
+    lua_insert(L, 1);
+    lua_call(L, lua_gettop(L) - 1, LUA_MULTRET);
+    return lua_gettop(L);
+}
+
+static bool are_numbers(lua_State * L, int count)
+{
+    for(int i = 1; i <= count; i++)
+        if(lua_type(L, i) != LUA_TNUMBER) return false;
+    return true;
+}
+
+// Arithmetic. The unary forms match the folds in the Lua library, e.g.
+// (- x) is x - 2 * x.
+
+struct add_operation
+{
+    static lua_Number unary(lua_Number x){return x + 0;}
+    static lua_Number binary(lua_Number x, lua_Number y){return x + y;}
+};
+
+struct subtract_operation
+{
+    static lua_Number unary(lua_Number x){return x - 2 * x;}
+    static lua_Number binary(lua_Number x, lua_Number y){return x - y;}
+};
+
+struct multiply_operation
+{
+    static lua_Number unary(lua_Number x){return x * 1;}
+    static lua_Number binary(lua_Number x, lua_Number y){return x * y;}
+};
+
+struct divide_operation
+{
+    static lua_Number unary(lua_Number x){return x / 1;}
+    static lua_Number binary(lua_Number x, lua_Number y){return x / y;}
+};
+
+template<typename Operation>
+static int fold(lua_State * L)
+{
+    int count = lua_gettop(L);
+    
+    if(count == 2 && lua_type(L, 1) == LUA_TNUMBER && 
+       lua_type(L, 2) == LUA_TNUMBER)
+    {
+        lua_pushnumber(L, Operation::binary(lua_tonumber(L, 1), 
+                                            lua_tonumber(L, 2)));
+        return 1;
+    }
+    
+    if(count == 0 || !are_numbers(L, count)) return call_fallback(L);
+    
+    if(count == 1)
+    {
+        lua_pushnumber(L, Operation::unary(lua_tonumber(L, 1)));
+        return 1;
+    }
+    
+    lua_Number result = lua_tonumber(L, 1);
+    for(int i = 2; i <= count; i++)
+        result = Operation::binary(result, lua_tonumber(L, i));
+    
+    lua_pushnumber(L, result);
+    return 1;
+}
+
+static int modulo(lua_State * L)
+{
+    if(lua_gettop(L) != 2 || !are_numbers(L, 2)) return call_fallback(L);
+    lua_Number x = lua_tonumber(L, 1);
+    lua_Number y = lua_tonumber(L, 2);
+    lua_pushnumber(L, x - std::floor(x / y) * y);
+    return 1;
+}
+
+static int minimum(lua_State * L)
+{
+    int count = lua_gettop(L);
+    if(count == 0 || !are_numbers(L, count)) return call_fallback(L);
+    lua_Number result = lua_tonumber(L, 1);
+    for(int i = 2; i <= count; i++)
+    {
+        lua_Number x = lua_tonumber(L, i);
+        if(x < result) result = x;
+    }
+    lua_pushnumber(L, result);
+    return 1;
+}
+
+static int maximum(lua_State * L)
+{
+    int count = lua_gettop(L);
+    if(count == 0 || !are_numbers(L, count)) return call_fallback(L);
+    lua_Number result = lua_tonumber(L, 1);
+    for(int i = 2; i <= count; i++)
+    {
+        lua_Number x = lua_tonumber(L, i);
+        if(x > result) result = x;
+    }
+    lua_pushnumber(L, result);
+    return 1;
+}
+
+// Comparison. Numbers and strings are compared here, anything else (which
+// may have metamethods or raise an error) by the fallback.
+
+static int equal(lua_State * L)
+{
+    lua_settop(L, 2);
+    lua_pushboolean(L, lua_equal(L, 1, 2));
+    return 1;
+}
+
+static int not_equal(lua_State * L)
+{
+    lua_settop(L, 2);
+    lua_pushboolean(L, !lua_equal(L, 1, 2));
+    return 1;
+}
+
+static int compare(lua_State * L, int a, int b, bool or_equal)
+{
+    int a_type = lua_type(L, a);
+    
+    if(a_type == LUA_TNUMBER && lua_type(L, b) == LUA_TNUMBER)
+    {
+        lua_Number x = lua_tonumber(L, a);
+        lua_Number y = lua_tonumber(L, b);
+        lua_pushboolean(L, or_equal ? x <= y : x < y);
+        return 1;
+    }
+    
+    // Strings are totally ordered, so a <= b is the same as not (b < a)
+    if(a_type == LUA_TSTRING && lua_type(L, b) == LUA_TSTRING)
+    {
+        lua_pushboolean(L, or_equal ? !lua_lessthan(L, b, a) : 
+                                      lua_lessthan(L, a, b));
+        return 1;
+    }
+    
+    return call_fallback(L);
+}
+
+static int less_than(lua_State * L)
+{
+    lua_settop(L, 2);
+    return compare(L, 1, 2, false);
+}
+
+static int less_than_or_equal(lua_State * L)
+{
+    lua_settop(L, 2);
+    return compare(L, 1, 2, true);
+}
+
+static int greater_than(lua_State * L)
+{
+    lua_settop(L, 2);
+    return compare(L, 2, 1, false);
+}
+
+static int greater_than_or_equal(lua_State * L)
+{
+    lua_settop(L, 2);
+    return compare(L, 2, 1, true);
+}
+
+// Logic
+
+static int logical_not(lua_State * L)
+{
+    lua_pushboolean(L, !lua_toboolean(L, 1));
+    return 1;
+}
+
+static int logical_or(lua_State * L)
+{
+    lua_settop(L, 2);
+    if(!lua_toboolean(L, 1)) lua_pushvalue(L, 2);
+    else lua_pushvalue(L, 1);
+    return 1;
+}
+
+static int logical_and(lua_State * L)
+{
+    lua_settop(L, 2);
+    if(lua_toboolean(L, 1)) lua_pushvalue(L, 2);
+    else lua_pushvalue(L, 1);
+    return 1;
+}
+
+namespace{
+
+struct operator_function
+{
+    const char * name;
+    lua_CFunction function;
+    bool needs_fallback;
+};
+
+const operator_function operators[] = {
+    {"+", fold<add_operation>, true},
+    {"-", fold<subtract_operation>, true},
+    {"*", fold<multiply_operation>, true},
+    {"div", fold<divide_operation>, true},
+    {"mod", modulo, true},
+    {"min", minimum, true},
+    {"max", maximum, true},
+    {"=", equal, false},
+    {"!=", not_equal, false},
+    {"<", less_than, true},
+    {"<=", less_than_or_equal, true},
+    {">", greater_than, true},
+    {">=", greater_than_or_equal, true},
+    {"!", logical_not, false},
+    {"||", logical_or, false},
+    {"&&", logical_and, false},
+    {NULL, NULL, false}
+};
+
+} //namespace
+
+int create_operator(lua_State * L)
+{
+    const char * name = luaL_checkstring(L, 1);
+    
+    const operator_function * op = operators;
+    while(op->name && std::strcmp(op->name, name) != 0) op++;
+    
+    if(!op->name) return luaL_argerror(L, 1, "unknown operator");
+    
+    if(op->needs_fallback) luaL_checktype(L, 2, LUA_TFUNCTION);
+    lua_settop(L, 2);
+    
+    lua_pushcclosure(L, op->function, 1);
+    return 1;
+}
+
+} //namespace lua
+} //namespace cubescript
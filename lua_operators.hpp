@@ -0,0 +1,46 @@
+/*
+  Copyright (c) 2010 Graham Daws <graham.daws@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#ifndef CUBESCRIPT_LUA_OPERATORS_HPP
+#define CUBESCRIPT_LUA_OPERATORS_HPP
+
+#include <lua.hpp>
+
+namespace cubescript{
+namespace lua{
+
+/**
+    Create a C function for an arithmetic, comparison or logic command.
+    Called as operator(name, fallback), where name is one of +, -, *, div,
+    mod, min, max, =, !=, <, <=, >, >=, !, || or &&.
+    
+    The C functions handle number arguments (and string arguments for the
+    comparisons) without creating any Lua objects. They call the fallback
+    function for any other arguments, so its behaviour for those arguments,
+    including metamethods and error messages, is kept. The fallback is
+    optional for =, !=, !, || and &&, which handle every type.
+*/
+int create_operator(lua_State * L);
+
+} //namespace lua
+} //namespace cubescript
+
+#endif
@@ -0,0 +1,469 @@
+/*
+  Copyright (c) 2010 Graham Daws <graham.daws@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#include "lua_string_library.hpp"
+#include "scan.hpp"
+#include <cstring>
+
+namespace cubescript{
+namespace lua{
+
+/*
+    Every step that can raise a Lua error (a __tostring or __index metamethod,
+    a bad value, running out of memory) is done before the result is written,
+    and the result is written into a buffer owned by Lua: lua_error longjmps
+    past C++ destructors, so a std::string alive at that point would leak.
+*/
+
+/*
+    Replace a value with its string form, converted the same way tostring()
+    converts it. The index must be absolute.
+*/
+static void tostring_in_place(lua_State * L, int index)
+{
+    switch(lua_type(L, index))
+    {
+        case LUA_TSTRING:
+            return;
+        case LUA_TNUMBER:
+            lua_tolstring(L, index, NULL);
+            return;
+        default:
+            break;
+    }
+    
+    if(luaL_callmeta(L, index, "__tostring"))
+    {
+        if(!lua_isstring(L, -1))
+            luaL_error(L, "attempt to concatenate a %s value",
+                       luaL_typename(L, -1));
+    }
+    else
+    {
+        switch(lua_type(L, index))
+        {
+            case LUA_TNIL:
+                lua_pushliteral(L, "nil");
+                break;
+            case LUA_TBOOLEAN:
+                lua_pushstring(L, lua_toboolean(L, index) ? "true" : "false");
+                break;
+            default:
+                lua_pushfstring(L, "%s: %p", luaL_typename(L, index),
+                                lua_topointer(L, index));
+        }
+    }
+    
+    lua_replace(L, index);
+}
+
+// Results up to this size are written on the C stack, as luaL_Buffer does
+static const std::size_t LOCAL_BUFFER_SIZE = LUAL_BUFFERSIZE;
+
+/*
+    Return a buffer for a result of the given size: the local buffer if the
+    result fits, otherwise a userdata pushed onto the stack, which is 
+    collected if pushing the result raises a memory error.
+*/
+static char * result_buffer(lua_State * L, std::size_t size, 
+                            char * local_buffer)
+{
+    if(size <= LOCAL_BUFFER_SIZE) return local_buffer;
+    return static_cast<char *>(lua_newuserdata(L, size));
+}
+
+static char * append(char * output, const char * data, std::size_t length)
+{
+    std::memcpy(output, data, length);
+    return output + length;
+}
+
+static char * append_string_value(lua_State * L, int index, char * output)
+{
+    std::size_t length;
+    const char * value = lua_tolstring(L, index, &length);
+    return append(output, value, length);
+}
+
+static int join_arguments(lua_State * L, const char * glue,
+                          std::size_t glue_length)
+{
+    int count = lua_gettop(L);
+    
+    std::size_t size = count > 1 ? (count - 1) * glue_length : 0;
+    for(int i = 1; i <= count; i++)
+    {
+        tostring_in_place(L, i);
+        size += lua_objlen(L, i);
+    }
+    
+    char local_buffer[LOCAL_BUFFER_SIZE];
+    char * output = result_buffer(L, size, local_buffer);
+    char * cursor = output;
+    
+    for(int i = 1; i <= count; i++)
+    {
+        if(i > 1) cursor = append(cursor, glue, glue_length);
+        cursor = append_string_value(L, i, cursor);
+    }
+    
+    lua_pushlstring(L, output, size);
+    return 1;
+}
+
+int concatword(lua_State * L)
+{
+    return join_arguments(L, "", 0);
+}
+
+int concat(lua_State * L)
+{
+    return join_arguments(L, " ", 1);
+}
+
+int implode(lua_State * L)
+{
+    luaL_checktype(L, 1, LUA_TTABLE);
+    
+    std::size_t glue_length = 0;
+    const char * glue = "";
+    if(lua_toboolean(L, 2)) glue = luaL_checklstring(L, 2, &glue_length);
+    
+    lua_settop(L, 2);
+    
+    int count = lua_objlen(L, 1);
+    
+    // Elements are read with lua_gettable only when the table has a
+    // metatable
+    bool raw = !lua_getmetatable(L, 1);
+    if(!raw) lua_pop(L, 1);
+    
+    // The string forms are kept in a second table (at index 3) unless every
+    // element is a string read with lua_rawgeti: reading or converting an 
+    // element may run Lua code that changes the pieces table.
+    lua_pushnil(L);
+    
+    std::size_t size = count > 1 ? (count - 1) * glue_length : 0;
+    
+    for(int i = 1; i <= count; i++)
+    {
+        if(raw) lua_rawgeti(L, 1, i);
+        else
+        {
+            lua_pushinteger(L, i);
+            lua_gettable(L, 1);
+        }
+        
+        if(lua_isnil(L, 3) && (!raw || lua_type(L, 4) != LUA_TSTRING))
+        {
+            lua_createtable(L, count, 0);
+            for(int j = 1; j < i; j++)
+            {
+                lua_rawgeti(L, 1, j);
+                lua_rawseti(L, -2, j);
+            }
+            lua_replace(L, 3);
+        }
+        
+        if(!lua_isnil(L, 3))
+        {
+            tostring_in_place(L, 4);
+            lua_pushvalue(L, 4);
+            lua_rawseti(L, 3, i);
+        }
+        
+        size += lua_objlen(L, 4);
+        lua_pop(L, 1);
+    }
+    
+    int pieces = lua_isnil(L, 3) ? 1 : 3;
+    
+    char local_buffer[LOCAL_BUFFER_SIZE];
+    char * output = result_buffer(L, size, local_buffer);
+    char * cursor = output;
+    
+    for(int i = 1; i <= count; i++)
+    {
+        if(i > 1) cursor = append(cursor, glue, glue_length);
+        lua_rawgeti(L, pieces, i);
+        cursor = append_string_value(L, -1, cursor);
+        lua_pop(L, 1);
+    }
+    
+    lua_pushlstring(L, output, size);
+    return 1;
+}
+
+int strreplace(lua_State * L)
+{
+    std::size_t source_length;
+    const char * source = luaL_checklstring(L, 1, &source_length);
+    const char * source_end = source + source_length;
+    
+    std::size_t find_length;
+    const char * find = luaL_checklstring(L, 2, &find_length);
+    
+    std::size_t replacement_length;
+    const char * replacement = luaL_checklstring(L, 3, &replacement_length);
+    
+    // The matches are counted to size the result, then found again to
+    // write it
+    std::size_t match_count = 0;
+    
+    if(find_length)
+    {
+        const char * match = scan::find_substring(source, source_end,
+                                                  find, find_length);
+        while(match != source_end)
+        {
+            match_count++;
+            match = scan::find_substring(match + find_length, source_end,
+                                         find, find_length);
+        }
+    }
+    
+    if(!match_count)
+    {
+        lua_pushlstring(L, source, source_length);
+        return 1;
+    }
+    
+    std::size_t size = source_length - match_count * find_length + 
+        match_count * replacement_length;
+    
+    char local_buffer[LOCAL_BUFFER_SIZE];
+    char * output = result_buffer(L, size, local_buffer);
+    char * cursor = output;
+    
+    const char * start = source;
+    const char * match = scan::find_substring(source, source_end,
+                                              find, find_length);
+    while(match != source_end)
+    {
+        cursor = append(cursor, start, match - start);
+        cursor = append(cursor, replacement, replacement_length);
+        start = match + find_length;
+        match = scan::find_substring(start, source_end, find, find_length);
+    }
+    append(cursor, start, source_end - start);
+    
+    lua_pushlstring(L, output, size);
+    return 1;
+}
+
+int strstr(lua_State * L)
+{
+    std::size_t source_length;
+    const char * source = luaL_checklstring(L, 1, &source_length);
+    const char * source_end = source + source_length;
+    
+    std::size_t substring_length;
+    const char * substring = luaL_checklstring(L, 2, &substring_length);
+    
+    const char * match = scan::find_substring(source, source_end,
+                                              substring, substring_length);
+    
+    if(match == source_end && substring_length) lua_pushinteger(L, -1);
+    else lua_pushinteger(L, match - source);
+    return 1;
+}
+
+static lua_Integer relative_position(lua_Integer position, std::size_t length)
+{
+    if(position < 0) position += static_cast<lua_Integer>(length) + 1;
+    return position >= 0 ? position : 0;
+}
+
+int substr(lua_State * L)
+{
+    std::size_t source_length;
+    const char * source = luaL_checklstring(L, 1, &source_length);
+    lua_Number start_number = luaL_checknumber(L, 2);
+    lua_Number length = luaL_checknumber(L, 3);
+    
+    if(length == 0)
+    {
+        lua_pushliteral(L, "");
+        return 1;
+    }
+    
+    // Same bounds as string.sub(s, start, start + length - 1)
+    lua_Integer start = relative_position(
+        static_cast<lua_Integer>(start_number), source_length);
+    lua_Integer end = relative_position(
+        static_cast<lua_Integer>(start_number + length - 1), source_length);
+    
+    if(start < 1) start = 1;
+    if(end > static_cast<lua_Integer>(source_length)) end = source_length;
+    
+    if(start <= end) lua_pushlstring(L, source + start - 1, end - start + 1);
+    else lua_pushliteral(L, "");
+    return 1;
+}
+
+static bool is_name_char(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           (c >= '0' && c <= '9') || c == '_';
+}
+
+/*
+    Find the next %name in the format string from start. The characters
+    before percent are copied as they are, and a % not followed by a name
+    is copied with them (percent is then the end of the name).
+*/
+static bool next_name(const char * start, const char * source_end,
+                      const char ** percent, const char ** name_end)
+{
+    const char * found = static_cast<const char *>(
+        std::memchr(start, '%', source_end - start));
+    if(!found) return false;
+    
+    const char * name = found + 1;
+    const char * end = name;
+    while(end != source_end && is_name_char(*end)) end++;
+    
+    *percent = end == name ? name : found;
+    *name_end = end;
+    return true;
+}
+
+int format(lua_State * L)
+{
+    std::size_t source_length;
+    const char * source = luaL_checklstring(L, 1, &source_length);
+    const char * source_end = source + source_length;
+    
+    int argument_count = lua_gettop(L) - 1;
+    bool has_fields = lua_type(L, 2) == LUA_TTABLE;
+    
+    // The replacement for each name (false for an empty one) is kept on the
+    // stack, and in a table once the stack can't grow
+    int first_replacement = lua_gettop(L) + 1;
+    int replacement_count = 0;
+    int stacked_replacements = 0;
+    int replacement_table = 0;
+    
+    std::size_t size = 0;
+    
+    const char * start = source;
+    const char * percent;
+    const char * name_end;
+    
+    while(next_name(start, source_end, &percent, &name_end))
+    {
+        size += percent - start;
+        const char * name = percent + 1;
+        start = name_end;
+        
+        if(percent == name_end) continue;
+        
+        lua_pushlstring(L, name, name_end - name);
+        
+        int argument = 0;
+        if(lua_isnumber(L, -1))
+        {
+            lua_Number index = lua_tonumber(L, -1);
+            if(index >= 1 && index <= argument_count &&
+               index == static_cast<int>(index))
+                argument = static_cast<int>(index) + 1;
+        }
+        
+        if(argument && lua_toboolean(L, argument)) lua_pushvalue(L, argument);
+        else if(has_fields)
+        {
+            lua_pushvalue(L, -1);
+            lua_gettable(L, 2);
+        }
+        else lua_pushnil(L);
+        
+        if(lua_toboolean(L, -1))
+        {
+            if(!lua_isstring(L, -1))
+                luaL_error(L, "invalid replacement value (a %s)", 
+                           luaL_typename(L, -1));
+            tostring_in_place(L, lua_gettop(L));
+            size += lua_objlen(L, -1);
+        }
+        else
+        {
+            lua_pop(L, 1);
+            lua_pushboolean(L, 0);
+        }
+        
+        lua_remove(L, -2);
+        replacement_count++;
+        
+        if(!replacement_table && lua_checkstack(L, LUA_MINSTACK))
+        {
+            stacked_replacements++;
+            continue;
+        }
+        
+        if(!replacement_table)
+        {
+            lua_newtable(L);
+            lua_insert(L, -2);
+            replacement_table = lua_gettop(L) - 1;
+        }
+        
+        lua_rawseti(L, replacement_table, 
+                    replacement_count - stacked_replacements);
+    }
+    
+    size += source_end - start;
+    
+    char local_buffer[LOCAL_BUFFER_SIZE];
+    char * output = result_buffer(L, size, local_buffer);
+    char * cursor = output;
+    
+    int replacement = 0;
+    start = source;
+    
+    while(next_name(start, source_end, &percent, &name_end))
+    {
+        cursor = append(cursor, start, percent - start);
+        start = name_end;
+        
+        if(percent == name_end) continue;
+        
+        if(++replacement <= stacked_replacements)
+        {
+            int index = first_replacement + replacement - 1;
+            if(lua_type(L, index) == LUA_TSTRING)
+                cursor = append_string_value(L, index, cursor);
+            continue;
+        }
+        
+        lua_rawgeti(L, replacement_table, replacement - stacked_replacements);
+        if(lua_type(L, -1) == LUA_TSTRING)
+            cursor = append_string_value(L, -1, cursor);
+        lua_pop(L, 1);
+    }
+    
+    append(cursor, start, source_end - start);
+    
+    lua_pushlstring(L, output, size);
+    return 1;
+}
+
+} //namespace lua
+} //namespace cubescript
@@ -0,0 +1,80 @@
+/*
+  Copyright (c) 2010 Graham Daws <graham.daws@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#ifndef CUBESCRIPT_LUA_STRING_LIBRARY_HPP
+#define CUBESCRIPT_LUA_STRING_LIBRARY_HPP
+
+#include <lua.hpp>
+
+namespace cubescript{
+namespace lua{
+
+/*
+    String commands for the Cubescript library. Results are built in one
+    buffer sized before the first piece is copied, so the cost is linear in
+    the length of the result.
+*/
+
+/**
+    concatword(...) joins the string forms of its arguments (the @ command).
+*/
+int concatword(lua_State * L);
+
+/**
+    concat(...) joins the string forms of its arguments with spaces.
+*/
+int concat(lua_State * L);
+
+/**
+    implode(pieces, glue) joins the string forms of the elements of the
+    pieces array, with glue (default "") between them.
+*/
+int implode(lua_State * L);
+
+/**
+    strreplace(s, find, replacement) replaces every occurrence of find in s.
+    An empty find string leaves s unchanged.
+*/
+int strreplace(lua_State * L);
+
+/**
+    strstr(s, substring) returns the zero-based position of the first
+    occurrence of substring in s, or -1.
+*/
+int strstr(lua_State * L);
+
+/**
+    substr(s, start, length) returns the length characters of s from
+    the one-based position start. A negative start counts from the end.
+*/
+int substr(lua_State * L);
+
+/**
+    format(s, ...) replaces each %name in s. A name that is an argument index
+    is replaced by that argument, other names by the field of the table passed
+    as the first argument, and anything else by an empty string.
+*/
+int format(lua_State * L);
+
+} //namespace lua
+} //namespace cubescript
+
+#endif
@@ -0,0 +1,124 @@
+/*
+  Copyright (c) 2010 Graham Daws <graham.daws@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "mapped_file.hpp"
+
+namespace cubescript{
+
+mapped_file::mapped_file()
+ :m_mapping(NULL), m_mapping_size(0), m_size(0)
+{
+    
+}
+
+mapped_file::~mapped_file()
+{
+    close();
+}
+
+bool mapped_file::open(const char * filename)
+{
+    close();
+    
+    int fd = ::open(filename, O_RDONLY);
+    if(fd == -1) return false;
+    
+    struct stat status;
+    if(fstat(fd, &status) == -1 || !S_ISREG(status.st_mode))
+    {
+        ::close(fd);
+        return false;
+    }
+    
+    std::size_t file_size = status.st_size;
+    std::size_t page_size = sysconf(_SC_PAGESIZE);
+    
+    // The region has room for a new line character after the end of the
+    // file. Where the file ends on a page boundary, that byte is in the
+    // anonymous page under the file mapping.
+    std::size_t mapping_size = (file_size + page_size) / page_size * page_size;
+    
+    void * region = mmap(NULL, mapping_size, PROT_READ | PROT_WRITE, 
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(region == MAP_FAILED)
+    {
+        ::close(fd);
+        return false;
+    }
+    
+    char * mapping = static_cast<char *>(region);
+    
+    if(file_size && mmap(mapping, file_size, PROT_READ, MAP_PRIVATE | MAP_FIXED,
+                         fd, 0) == MAP_FAILED)
+    {
+        munmap(region, mapping_size);
+        ::close(fd);
+        return false;
+    }
+    
+    ::close(fd);
+    
+    m_mapping = mapping;
+    m_mapping_size = mapping_size;
+    m_size = file_size;
+    
+    if(!file_size || mapping[file_size - 1] == '\n') return true;
+    
+    char * last_page = mapping + file_size / page_size * page_size;
+    if(mprotect(last_page, page_size, PROT_READ | PROT_WRITE) == -1)
+    {
+        close();
+        return false;
+    }
+    
+    mapping[m_size++] = '\n';
+    
+    return true;
+}
+
+void mapped_file::close()
+{
+    if(m_mapping) munmap(m_mapping, m_mapping_size);
+    m_mapping = NULL;
+    m_mapping_size = 0;
+    m_size = 0;
+}
+
+const char * mapped_file::begin()const
+{
+    return m_mapping;
+}
+
+const char * mapped_file::end()const
+{
+    return m_mapping + m_size;
+}
+
+std::size_t mapped_file::size()const
+{
+    return m_size;
+}
+
+} //namespace cubescript
@@ -0,0 +1,70 @@
+/*
+  Copyright (c) 2010 Graham Daws <graham.daws@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#ifndef CUBESCRIPT_MAPPED_FILE_HPP
+#define CUBESCRIPT_MAPPED_FILE_HPP
+
+#include <cstddef>
+
+namespace cubescript{
+
+/**
+    A script file mapped read-only into memory, so that it can be parsed in 
+    place instead of being copied into a string first. The pages are shared 
+    with the operating system's file cache, and only read in as the parser
+    reaches them.
+    
+    The mapped code always ends with a new line character, so that the last
+    expression is complete, as it is when the file is read line by line. If
+    the file doesn't end with one, it's added after the end of the file, 
+    which makes a private copy of the last page only. An empty file maps to
+    empty code. Reading the mapping after the file has been truncated by 
+    another process raises SIGBUS, as for any file mapping.
+*/
+class mapped_file
+{
+public:
+    mapped_file();
+    ~mapped_file();
+    
+    /**
+        Map a file, replacing the previous mapping. Returns false if the file
+        can't be opened or mapped, leaving the object empty.
+    */
+    bool open(const char * filename);
+    
+    void close();
+    
+    const char * begin()const;
+    const char * end()const;
+    std::size_t size()const;
+private:
+    mapped_file(const mapped_file &);
+    mapped_file & operator=(const mapped_file &);
+    
+    char * m_mapping;
+    std::size_t m_mapping_size;
+    std::size_t m_size;
+};
+
+} //namespace cubescript
+
+#endif
@@ -0,0 +1,562 @@
+/*
+  Copyright (c) 2010 Graham Daws <graham.daws@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "native_command_stack.hpp"
+#include "eval.hpp"
+
+namespace cubescript{
+
+native_command_stack::symbol::symbol()
+ :used(false), hash(0)
+{
+    content.type = NIL;
+    content.storage = SOURCE_STRING;
+}
+
+native_command_stack::native_command_stack()
+ :m_values(m_inline_values),
+  m_size(0),
+  m_capacity(INLINE_STACK_SIZE),
+  m_source_begin(NULL),
+  m_source_end(NULL),
+  m_symbols(INITIAL_SYMBOL_TABLE_SIZE),
+  m_symbol_count(0)
+{
+    set_command("@", concatenate);
+}
+
+native_command_stack::~native_command_stack()
+{
+    if(m_values != m_inline_values) delete [] m_values;
+}
+
+const char * native_command_stack::type_name(value_type type)
+{
+    static const char * names[] = {
+        "nil", "boolean", "integer", "real", "string", "function"
+    };
+    return names[type];
+}
+
+std::size_t native_command_stack::hash_name(const char * name, 
+                                            std::size_t length)
+{
+    // FNV-1a
+    std::size_t hash = 2166136261U;
+    for(std::size_t i = 0; i < length; i++)
+    {
+        hash ^= static_cast<unsigned char>(name[i]);
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+native_command_stack::symbol * native_command_stack::find_symbol(
+    const char * name, std::size_t length, std::size_t hash)
+{
+    std::size_t mask = m_symbols.size() - 1;
+    
+    for(std::size_t index = hash & mask; m_symbols[index].used; 
+        index = (index + 1) & mask)
+    {
+        symbol & entry = m_symbols[index];
+        if(entry.hash == hash && entry.name.length() == length &&
+           std::memcmp(entry.name.data(), name, length) == 0)
+            return &entry;
+    }
+    
+    return NULL;
+}
+
+void native_command_stack::grow_symbol_table()
+{
+    std::vector<symbol> old_symbols(m_symbols.size() * 2);
+    old_symbols.swap(m_symbols);
+    
+    std::size_t mask = m_symbols.size() - 1;
+    
+    for(std::size_t i = 0; i < old_symbols.size(); i++)
+    {
+        if(!old_symbols[i].used) continue;
+        
+        std::size_t index = old_symbols[i].hash & mask;
+        while(m_symbols[index].used) index = (index + 1) & mask;
+        
+        symbol & entry = m_symbols[index];
+        entry.used = true;
+        entry.hash = old_symbols[i].hash;
+        entry.name.swap(old_symbols[i].name);
+        entry.content = old_symbols[i].content;
+        entry.string_content.swap(old_symbols[i].string_content);
+    }
+}
+
+native_command_stack::symbol & native_command_stack::set_symbol(
+    const char * name)
+{
+    std::size_t length = std::strlen(name);
+    std::size_t hash = hash_name(name, length);
+    
+    symbol * existing = find_symbol(name, length, hash);
+    if(existing)
+    {
+        existing->string_content.clear();
+        return *existing;
+    }
+    
+    if((m_symbol_count + 1) * 2 > m_symbols.size()) grow_symbol_table();
+    
+    std::size_t mask = m_symbols.size() - 1;
+    std::size_t index = hash & mask;
+    while(m_symbols[index].used) index = (index + 1) & mask;
+    
+    symbol & entry = m_symbols[index];
+    entry.used = true;
+    entry.hash = hash;
+    entry.name.assign(name, length);
+    m_symbol_count++;
+    
+    return entry;
+}
+
+void native_command_stack::set_command(const char * name, 
+                                       function command, void * data)
+{
+    symbol & entry = set_symbol(name);
+    entry.content.type = FUNCTION;
+    entry.content.function.pointer = command;
+    entry.content.function.data = data;
+}
+
+void native_command_stack::set_variable(const char * name, bool value)
+{
+    symbol & entry = set_symbol(name);
+    entry.content.type = BOOLEAN;
+    entry.content.boolean = value;
+}
+
+void native_command_stack::set_variable(const char * name, int value)
+{
+    set_variable(name, static_cast<long long>(value));
+}
+
+void native_command_stack::set_variable(const char * name, long long value)
+{
+    symbol & entry = set_symbol(name);
+    entry.content.type = INTEGER;
+    entry.content.integer = value;
+}
+
+void native_command_stack::set_variable(const char * name, double value)
+{
+    symbol & entry = set_symbol(name);
+    entry.content.type = REAL;
+    entry.content.real = value;
+}
+
+void native_command_stack::set_variable(const char * name, 
+                                        const std::string & value)
+{
+    symbol & entry = set_symbol(name);
+    entry.content.type = STRING;
+    entry.string_content = value;
+}
+
+void native_command_stack::unset(const char * name)
+{
+    std::size_t length = std::strlen(name);
+    symbol * entry = find_symbol(name, length, hash_name(name, length));
+    if(!entry) return;
+    
+    // Removing from the middle of a probe sequence would hide the symbols 
+    // after it, so the following symbols of the run are inserted again
+    entry->used = false;
+    entry->name.clear();
+    entry->string_content.clear();
+    m_symbol_count--;
+    
+    std::size_t mask = m_symbols.size() - 1;
+    std::size_t index = ((entry - &m_symbols[0]) + 1) & mask;
+    
+    for(; m_symbols[index].used; index = (index + 1) & mask)
+    {
+        symbol moved = m_symbols[index];
+        m_symbols[index] = symbol();
+        
+        std::size_t target = moved.hash & mask;
+        while(m_symbols[target].used) target = (target + 1) & mask;
+        m_symbols[target] = moved;
+    }
+}
+
+eval_status native_command_stack::eval(const char * source_begin, 
+                                       const char * source_end)
+{
+    m_source_begin = source_begin;
+    m_source_end = source_end;
+    
+    // Values left by an unfinished expression may refer to the source code
+    std::size_t entry_size = m_size;
+    eval_status status;
+    
+    try
+    {
+        status = ::cubescript::try_eval(&source_begin, source_end, *this);
+    }
+    catch(...)
+    {
+        pop(m_size - entry_size);
+        m_source_begin = NULL;
+        m_source_end = NULL;
+        throw;
+    }
+    
+    // The caller may free the source code after reading the return values
+    for(std::size_t i = 0; i < m_size; i++)
+    {
+        value & result = m_values[i];
+        if(result.type == STRING && result.storage == SOURCE_STRING)
+        {
+            std::size_t offset = m_strings.length();
+            m_strings.append(result.string.data, result.string.length);
+            result.storage = OWNED_STRING;
+            result.string.offset = offset;
+        }
+    }
+    
+    m_source_begin = NULL;
+    m_source_end = NULL;
+    
+    return status;
+}
+
+std::size_t native_command_stack::size()const
+{
+    return m_size;
+}
+
+native_command_stack::value_type native_command_stack::type(
+    std::size_t index)const
+{
+    return m_values[index].type;
+}
+
+const char * native_command_stack::string_data(const value & string)const
+{
+    switch(string.storage)
+    {
+        case OWNED_STRING: return m_strings.data() + string.string.offset;
+        case CONVERTED_STRING: return string.converted.data;
+        default: return string.string.data;
+    }
+}
+
+std::size_t native_command_stack::string_length(const value & string)
+{
+    return string.storage == CONVERTED_STRING ? string.converted.length : 
+        string.string.length;
+}
+
+bool native_command_stack::to_boolean(std::size_t index)const
+{
+    const value & input = m_values[index];
+    if(input.type == NIL) return false;
+    if(input.type == BOOLEAN) return input.boolean;
+    return true;
+}
+
+long long native_command_stack::to_integer(std::size_t index)const
+{
+    const value & input = m_values[index];
+    switch(input.type)
+    {
+        case BOOLEAN: return input.boolean;
+        case INTEGER: return input.integer;
+        case REAL: return static_cast<long long>(input.real);
+        case STRING:
+        {
+            std::string copy(string_data(input), string_length(input));
+            return std::strtoll(copy.c_str(), NULL, 10);
+        }
+        default: return 0;
+    }
+}
+
+double native_command_stack::to_real(std::size_t index)const
+{
+    const value & input = m_values[index];
+    switch(input.type)
+    {
+        case BOOLEAN: return input.boolean;
+        case INTEGER: return static_cast<double>(input.integer);
+        case REAL: return input.real;
+        case STRING:
+        {
+            std::string copy(string_data(input), string_length(input));
+            return std::strtod(copy.c_str(), NULL);
+        }
+        default: return 0;
+    }
+}
+
+std::string native_command_stack::to_string(std::size_t index)const
+{
+    const value & input = m_values[index];
+    char buffer[32];
+    
+    switch(input.type)
+    {
+        case BOOLEAN:
+            return input.boolean ? "true" : "false";
+        case INTEGER:
+            std::sprintf(buffer, "%lld", input.integer);
+            return buffer;
+        case REAL:
+            std::sprintf(buffer, "%.14g", input.real);
+            return buffer;
+        case STRING:
+            return std::string(string_data(input), string_length(input));
+        case FUNCTION:
+            return "function";
+        default:
+            return "";
+    }
+}
+
+const char * native_command_stack::to_string(std::size_t index, 
+                                            std::size_t & length)
+{
+    value & input = m_values[index];
+    
+    if(input.type == NIL || input.type == FUNCTION) return NULL;
+    
+    // Appending to m_strings here would move the characters of strings
+    // already returned to the caller
+    if(input.type != STRING)
+    {
+        char buffer[32];
+        
+        switch(input.type)
+        {
+            case BOOLEAN:
+                std::strcpy(buffer, input.boolean ? "true" : "false");
+                break;
+            case INTEGER:
+                std::sprintf(buffer, "%lld", input.integer);
+                break;
+            default:
+                std::sprintf(buffer, "%.14g", input.real);
+        }
+        
+        std::size_t buffer_length = std::strlen(buffer);
+        assert(buffer_length <= CONVERTED_STRING_SIZE);
+        
+        input.type = STRING;
+        input.storage = CONVERTED_STRING;
+        input.converted.length = static_cast<unsigned char>(buffer_length);
+        std::memcpy(input.converted.data, buffer, buffer_length);
+    }
+    
+    length = string_length(input);
+    return string_data(input);
+}
+
+void native_command_stack::pop(std::size_t count)
+{
+    m_size -= std::min(count, m_size);
+    if(!m_size) m_strings.clear();
+}
+
+void native_command_stack::clear()
+{
+    pop(m_size);
+}
+
+native_command_stack::value & native_command_stack::push()
+{
+    if(m_size == m_capacity)
+    {
+        value * values = new value[m_capacity * 2];
+        std::copy(m_values, m_values + m_size, values);
+        if(m_values != m_inline_values) delete [] m_values;
+        m_values = values;
+        m_capacity *= 2;
+    }
+    
+    value & pushed = m_values[m_size++];
+    pushed.storage = SOURCE_STRING;
+    return pushed;
+}
+
+void native_command_stack::push_string_copy(const char * data, 
+                                            std::size_t length)
+{
+    std::size_t offset = m_strings.length();
+    m_strings.append(data, length);
+    
+    value & pushed = push();
+    pushed.type = STRING;
+    pushed.storage = OWNED_STRING;
+    pushed.string.offset = offset;
+    pushed.string.length = length;
+}
+
+std::size_t native_command_stack::push_command()
+{
+    return m_size;
+}
+
+void native_command_stack::push_argument_symbol(const char * id, 
+                                                std::size_t id_length)
+{
+    symbol * entry = find_symbol(id, id_length, hash_name(id, id_length));
+    
+    if(!entry)
+    {
+        push_argument();
+        return;
+    }
+    
+    if(entry->content.type == STRING)
+    {
+        push_string_copy(entry->string_content.data(), 
+                         entry->string_content.length());
+        return;
+    }
+    
+    push() = entry->content;
+}
+
+void native_command_stack::push_argument()
+{
+    push().type = NIL;
+}
+
+void native_command_stack::push_argument(bool input)
+{
+    value & pushed = push();
+    pushed.type = BOOLEAN;
+    pushed.boolean = input;
+}
+
+void native_command_stack::push_argument(int input)
+{
+    push_argument(static_cast<long long>(input));
+}
+
+void native_command_stack::push_argument(float input)
+{
+    push_argument(static_cast<double>(input));
+}
+
+void native_command_stack::push_argument(long long input)
+{
+    value & pushed = push();
+    pushed.type = INTEGER;
+    pushed.integer = input;
+}
+
+void native_command_stack::push_argument(double input)
+{
+    value & pushed = push();
+    pushed.type = REAL;
+    pushed.real = input;
+}
+
+void native_command_stack::push_argument(const char * input, 
+                                         std::size_t length)
+{
+    if(input < m_source_begin || input + length > m_source_end)
+    {
+        push_string_copy(input, length);
+        return;
+    }
+    
+    value & pushed = push();
+    pushed.type = STRING;
+    pushed.string.data = input;
+    pushed.string.length = length;
+}
+
+std::string native_command_stack::pop_string()
+{
+    if(!m_size) throw command_error("pop_string called on an empty stack");
+    std::string output = to_string(m_size - 1);
+    pop();
+    return output;
+}
+
+void native_command_stack::call(std::size_t index)
+{
+    if(index >= m_size)
+    {
+        push_argument();
+        return;
+    }
+    
+    const value & callee = m_values[index];
+    
+    if(callee.type != FUNCTION)
+    {
+        value_type callee_type = callee.type;
+        m_size = index;
+        throw command_error(std::string("attempt to call a ") + 
+                            type_name(callee_type) + " value");
+    }
+    
+    function command = callee.function.pointer;
+    void * data = callee.function.data;
+    
+    std::size_t first = index + 1;
+    std::size_t results = m_size;
+    
+    try
+    {
+        command(*this, first, results - first, data);
+    }
+    catch(...)
+    {
+        m_size = index;
+        throw;
+    }
+    
+    std::size_t result_count = m_size - results;
+    std::copy(m_values + results, m_values + m_size, m_values + index);
+    m_size = index + result_count;
+    
+    if(!m_size) m_strings.clear();
+}
+
+void native_command_stack::concatenate(native_command_stack & stack, 
+    std::size_t first, std::size_t count, void *)
+{
+    std::string output;
+    for(std::size_t i = first; i < first + count; i++)
+        output += stack.to_string(i);
+    stack.push_string_copy(output.data(), output.length());
+}
+
+} //namespace cubescript
@@ -0,0 +1,224 @@
+/*
+  Copyright (c) 2010 Graham Daws <graham.daws@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#ifndef CUBESCRIPT_NATIVE_COMMAND_STACK_HPP
+#define CUBESCRIPT_NATIVE_COMMAND_STACK_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "cubescript.hpp"
+
+namespace cubescript{
+
+/**
+    A command stack implementation that runs Cubescript code without a host
+    language. Values are kept on a stack of typed values, and symbols are 
+    looked up in a hash table of commands and variables set by the program.
+    Names with sub keys ("a.b") are looked up as a whole.
+    
+    Strings pushed while running the eval method that are unchanged parts of
+    the source code are kept as pointers into the source instead of copies.
+    The command "@" (concatenate arguments as strings) is always set, for
+    evaluating interpolated multiline strings.
+*/
+class native_command_stack:public command_stack
+{
+public:
+    enum value_type
+    {
+        NIL = 0,
+        BOOLEAN,
+        INTEGER,
+        REAL,
+        STRING,
+        FUNCTION
+    };
+    
+    /**
+        A command function. The arguments are at stack positions first to 
+        first + count - 1. Return values are pushed onto the stack with the 
+        push_argument methods; the arguments are removed by the caller. 
+        Errors are reported by throwing an eval_error exception.
+    */
+    typedef void (*function)(native_command_stack &, std::size_t first, 
+                             std::size_t count, void * data);
+    
+    native_command_stack();
+    ~native_command_stack();
+    
+    static const char * type_name(value_type);
+    
+    void set_command(const char * name, function, void * data = NULL);
+    
+    void set_variable(const char * name, bool);
+    void set_variable(const char * name, int);
+    void set_variable(const char * name, long long);
+    void set_variable(const char * name, double);
+    void set_variable(const char * name, const std::string &);
+    
+    /**
+        Remove a command or variable.
+    */
+    void unset(const char * name);
+    
+    /**
+        Evaluate Cubescript code with the same effect as try_eval(). Return 
+        values are left on the stack, and are copied out of the source code 
+        before returning. If an exception is thrown, the stack is restored to
+        its size before the call.
+    */
+    eval_status eval(const char * source_begin, const char * source_end);
+    
+    /**
+        Return the number of values on the stack.
+    */
+    std::size_t size()const;
+    
+    value_type type(std::size_t index)const;
+    
+    /**
+        Return false for nil and false values, otherwise true.
+    */
+    bool to_boolean(std::size_t index)const;
+    
+    long long to_integer(std::size_t index)const;
+    double to_real(std::size_t index)const;
+    
+    /**
+        Convert a value to a string. Nil converts to an empty string.
+    */
+    std::string to_string(std::size_t index)const;
+    
+    /**
+        Return a pointer to the characters of a string value, converting a 
+        boolean or number value to a string in place, in the same way as 
+        lua_tolstring. The string isn't null-terminated. Return NULL for nil 
+        and function values. The pointer stays valid until the value is 
+        removed from the stack, even if other values are converted.
+    */
+    const char * to_string(std::size_t index, std::size_t & length);
+    
+    /**
+        Remove values from the top of the stack.
+    */
+    void pop(std::size_t count = 1);
+    
+    void clear();
+    
+    std::size_t push_command();
+    void push_argument_symbol(const char * id, std::size_t id_length);
+    void push_argument();
+    void push_argument(bool);
+    void push_argument(int);
+    void push_argument(float);
+    void push_argument(long long);
+    void push_argument(double);
+    void push_argument(const char *, std::size_t);
+    std::string pop_string();
+    void call(std::size_t index);
+private:
+    native_command_stack(const native_command_stack &);
+    native_command_stack & operator=(const native_command_stack &);
+    
+    enum string_storage
+    {
+        SOURCE_STRING,      // string.data points into the evaluated code
+        OWNED_STRING,       // stored in m_strings at string.offset
+        CONVERTED_STRING    // stored in the value by to_string(index, length)
+    };
+    
+    static const std::size_t CONVERTED_STRING_SIZE = 23;
+    
+    struct value
+    {
+        value_type type;
+        string_storage storage;
+        
+        union
+        {
+            bool boolean;
+            long long integer;
+            double real;
+            
+            struct
+            {
+                const char * data;
+                std::size_t offset;
+                std::size_t length;
+            } string;
+            
+            struct
+            {
+                char data[CONVERTED_STRING_SIZE];
+                unsigned char length;
+            } converted;
+            
+            struct
+            {
+                native_command_stack::function pointer;
+                void * data;
+            } function;
+        };
+    };
+    
+    struct symbol
+    {
+        symbol();
+        bool used;
+        std::size_t hash;
+        std::string name;
+        value content;
+        std::string string_content;
+    };
+    
+    static const std::size_t INLINE_STACK_SIZE = 32;
+    static const std::size_t INITIAL_SYMBOL_TABLE_SIZE = 64;
+    
+    value & push();
+    void push_string_copy(const char *, std::size_t);
+    const char * string_data(const value &)const;
+    static std::size_t string_length(const value &);
+    
+    static std::size_t hash_name(const char *, std::size_t);
+    symbol * find_symbol(const char *, std::size_t, std::size_t hash);
+    symbol & set_symbol(const char *);
+    void grow_symbol_table();
+    
+    static void concatenate(native_command_stack &, std::size_t, 
+                            std::size_t, void *);
+    
+    value m_inline_values[INLINE_STACK_SIZE];
+    value * m_values;
+    std::size_t m_size;
+    std::size_t m_capacity;
+    
+    std::string m_strings;
+    const char * m_source_begin;
+    const char * m_source_end;
+    
+    std::vector<symbol> m_symbols;
+    std::size_t m_symbol_count;
+};
+
+} //namespace cubescript
+
+#endif
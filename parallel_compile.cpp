@@ -0,0 +1,351 @@
+/*
+  Copyright (c) 2010 Graham Daws <graham.daws@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <pthread.h>
+#include <unistd.h>
+#include "parallel_compile.hpp"
+#include "image.hpp"
+
+namespace cubescript{
+
+namespace{
+
+struct chunk_source
+{
+    const char * begin;
+    const char * end;
+    bool add_new_line; // The last line of the file has no new line character
+};
+
+/**
+    Work shared by the compiler threads. Each task is a group of consecutive
+    chunks compiled into one program.
+*/
+struct compile_job
+{
+    const std::vector<chunk_source> * sources;
+    std::vector<program> * programs;
+    std::vector<std::size_t> * ends; // Instruction index at end of each chunk
+    std::size_t chunks_per_program;
+    std::size_t next_program;
+    pthread_mutex_t lock;
+};
+
+void compile_program(const compile_job & job, std::size_t index)
+{
+    const std::vector<chunk_source> & sources = *job.sources;
+    program & output = (*job.programs)[index];
+    
+    std::size_t first = index * job.chunks_per_program;
+    std::size_t last = std::min(first + job.chunks_per_program, 
+                                sources.size());
+    
+    for(std::size_t i = first; i < last; i++)
+    {
+        const chunk_source & source = sources[i];
+        
+        if(source.add_new_line)
+        {
+            std::string code(source.begin, source.end);
+            code += '\n';
+            compile_append(code.data(), code.data() + code.length(), output);
+        }
+        else compile_append(source.begin, source.end, output);
+        
+        (*job.ends)[i] = output.size();
+    }
+}
+
+void * compile_thread(void * arg)
+{
+    compile_job & job = *reinterpret_cast<compile_job *>(arg);
+    std::size_t size = job.programs->size();
+    
+    while(true)
+    {
+        pthread_mutex_lock(&job.lock);
+        std::size_t index = job.next_program;
+        if(index < size) job.next_program++;
+        pthread_mutex_unlock(&job.lock);
+        
+        if(index == size) break;
+        
+        compile_program(job, index);
+    }
+    
+    return NULL;
+}
+
+std::size_t processor_count()
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? count : 1;
+}
+
+/**
+    Identifies a compiled file image and its format. The version number must
+    change whenever the layout of the image or of the program instructions 
+    changes.
+*/
+struct image_header
+{
+    char magic[4];
+    unsigned int version;
+    unsigned int chunks_per_program;
+};
+
+const char IMAGE_MAGIC[4] = {'C', 'S', 'F', 'C'};
+const unsigned int IMAGE_VERSION = 1;
+
+/**
+    Check that a chunk covers whole root expressions: replaying it never
+    calls a command that it didn't push.
+*/
+bool is_balanced(program::const_iterator first, program::const_iterator last)
+{
+    std::size_t depth = 0;
+    for(program::const_iterator iter = first; iter != last; iter++)
+    {
+        if(iter->op == program::PUSH_COMMAND) depth++;
+        else if(iter->op == program::CALL && !depth--) return false;
+    }
+    return true;
+}
+
+} //anonymous namespace
+
+std::size_t compiled_file::size()const
+{
+    return m_chunks.size();
+}
+
+std::size_t compiled_file::first_line(std::size_t index)const
+{
+    return m_chunks[index].first_line;
+}
+
+std::size_t compiled_file::last_line(std::size_t index)const
+{
+    return m_chunks[index].last_line;
+}
+
+void compiled_file::replay(std::size_t index, command_stack & command)const
+{
+    const chunk & code = m_chunks[index];
+    const program & chunk_program = m_programs[index / CHUNKS_PER_PROGRAM];
+    ::cubescript::replay(chunk_program, 
+        chunk_program.begin() + code.first_instruction,
+        chunk_program.begin() + code.last_instruction, command);
+}
+
+void compile_file(const char * source_begin, const char * source_end,
+                  compiled_file & output, std::size_t threads)
+{
+    std::vector<chunk_source> sources;
+    output.m_chunks.clear();
+    
+    // Splitting the file is sequential, but the scanner is much faster than
+    // the parser
+    code_scanner scanner;
+    const char * chunk_begin = source_begin;
+    std::size_t first_line = 1;
+    std::size_t line_number = 1;
+    
+    for(const char * line = source_begin; line != source_end; line_number++)
+    {
+        const char * line_end = line;
+        while(line_end != source_end && *line_end != '\n') line_end++;
+        
+        bool add_new_line = line_end == source_end;
+        if(!add_new_line) line_end++;
+        
+        bool complete = scanner.feed(line, line_end);
+        if(add_new_line) complete = scanner.feed("\n", "\n" + 1);
+        
+        line = line_end;
+        
+        if(!complete) continue;
+        
+        chunk_source source;
+        source.begin = chunk_begin;
+        source.end = line_end;
+        source.add_new_line = add_new_line;
+        sources.push_back(source);
+        
+        compiled_file::chunk chunk;
+        chunk.first_line = first_line;
+        chunk.last_line = line_number;
+        output.m_chunks.push_back(chunk);
+        
+        scanner.reset();
+        chunk_begin = line_end;
+        first_line = line_number + 1;
+    }
+    
+    std::size_t program_count = (sources.size() + 
+        compiled_file::CHUNKS_PER_PROGRAM - 1) / 
+        compiled_file::CHUNKS_PER_PROGRAM;
+    
+    output.m_programs.clear();
+    output.m_programs.resize(program_count);
+    
+    std::vector<std::size_t> ends(sources.size());
+    
+    compile_job job;
+    job.sources = &sources;
+    job.programs = &output.m_programs;
+    job.ends = &ends;
+    job.chunks_per_program = compiled_file::CHUNKS_PER_PROGRAM;
+    job.next_program = 0;
+    pthread_mutex_init(&job.lock, NULL);
+    
+    if(!threads) threads = processor_count();
+    if(threads > program_count) threads = program_count;
+    
+    // The calling thread does its share of the work
+    std::vector<pthread_t> workers;
+    for(std::size_t i = 1; i < threads; i++)
+    {
+        pthread_t thread;
+        if(pthread_create(&thread, NULL, compile_thread, &job) != 0) break;
+        workers.push_back(thread);
+    }
+    
+    compile_thread(&job);
+    
+    for(std::size_t i = 0; i < workers.size(); i++)
+        pthread_join(workers[i], NULL);
+    
+    pthread_mutex_destroy(&job.lock);
+    
+    for(std::size_t i = 0; i < ends.size(); i++)
+    {
+        bool first_in_program = i % compiled_file::CHUNKS_PER_PROGRAM == 0;
+        output.m_chunks[i].first_instruction = first_in_program ? 0 : ends[i - 1];
+        output.m_chunks[i].last_instruction = ends[i];
+    }
+}
+
+void save(const compiled_file & file, std::string & output)
+{
+    image_header header;
+    std::memcpy(header.magic, IMAGE_MAGIC, sizeof(header.magic));
+    header.version = IMAGE_VERSION;
+    header.chunks_per_program = compiled_file::CHUNKS_PER_PROGRAM;
+    
+    output.clear();
+    image::write_raw(header, output);
+    
+    // Chunks start where the previous chunk in the same program ended, on 
+    // the line after the previous chunk, so only their sizes are saved
+    image::write_size(file.m_chunks.size(), output);
+    for(std::size_t i = 0; i < file.m_chunks.size(); i++)
+    {
+        const compiled_file::chunk & chunk = file.m_chunks[i];
+        image::write_size(chunk.last_instruction - chunk.first_instruction,
+            output);
+        image::write_size(chunk.last_line - chunk.first_line, output);
+    }
+    
+    for(std::size_t i = 0; i < file.m_programs.size(); i++)
+        save(file.m_programs[i], output);
+}
+
+bool load(const char * image_begin, const char * image_end, 
+          compiled_file & output)
+{
+    output.m_programs.clear();
+    output.m_chunks.clear();
+    
+    const char * position = image_begin;
+    
+    image_header header;
+    if(!image::read_raw(&position, image_end, header) ||
+       std::memcmp(header.magic, IMAGE_MAGIC, sizeof(header.magic)) != 0 ||
+       header.version != IMAGE_VERSION || 
+       header.chunks_per_program != compiled_file::CHUNKS_PER_PROGRAM)
+    {
+        return false;
+    }
+    
+    // Each chunk takes at least two bytes
+    std::size_t chunk_count;
+    if(!image::read_size(&position, image_end, chunk_count) ||
+       chunk_count > static_cast<std::size_t>(image_end - position) / 2)
+        return false;
+    
+    output.m_chunks.resize(chunk_count);
+    
+    bool valid = true;
+    std::size_t next_line = 1;
+    
+    for(std::size_t i = 0; valid && i < chunk_count; i++)
+    {
+        compiled_file::chunk & chunk = output.m_chunks[i];
+        
+        std::size_t instructions;
+        std::size_t lines;
+        valid = image::read_size(&position, image_end, instructions) &&
+                image::read_size(&position, image_end, lines);
+        
+        bool first_in_program = i % compiled_file::CHUNKS_PER_PROGRAM == 0;
+        chunk.first_instruction = first_in_program ? 0 : 
+            output.m_chunks[i - 1].last_instruction;
+        chunk.last_instruction = chunk.first_instruction + instructions;
+        chunk.first_line = next_line;
+        chunk.last_line = next_line + lines;
+        next_line = chunk.last_line + 1;
+    }
+    
+    std::size_t program_count = (chunk_count + 
+        compiled_file::CHUNKS_PER_PROGRAM - 1) / 
+        compiled_file::CHUNKS_PER_PROGRAM;
+    output.m_programs.resize(valid ? program_count : 0);
+    
+    for(std::size_t i = 0; valid && i < program_count; i++)
+        valid = load(&position, image_end, output.m_programs[i]);
+    
+    valid = valid && position == image_end;
+    
+    for(std::size_t i = 0; valid && i < chunk_count; i++)
+    {
+        const compiled_file::chunk & chunk = output.m_chunks[i];
+        const program & chunk_program = output.m_programs[
+            i / compiled_file::CHUNKS_PER_PROGRAM];
+        valid = chunk.first_instruction <= chunk.last_instruction &&
+            chunk.last_instruction <= chunk_program.size() &&
+            is_balanced(chunk_program.begin() + chunk.first_instruction,
+                        chunk_program.begin() + chunk.last_instruction);
+    }
+    
+    if(!valid)
+    {
+        output.m_programs.clear();
+        output.m_chunks.clear();
+    }
+    
+    return valid;
+}
+
+} //namespace cubescript
@@ -0,0 +1,115 @@
+/*
+  Copyright (c) 2010 Graham Daws <graham.daws@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#ifndef CUBESCRIPT_PARALLEL_COMPILE_HPP
+#define CUBESCRIPT_PARALLEL_COMPILE_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "bytecode.hpp"
+
+namespace cubescript{
+
+/**
+    A script file compiled in chunks that end at the end of a root 
+    expression. Consecutive chunks share a program, so that compiling a file
+    of many short expressions doesn't make a program for each one.
+*/
+class compiled_file
+{
+public:
+    /**
+        Return the number of chunks.
+    */
+    std::size_t size()const;
+    
+    /**
+        Return the line number, counting from 1, of the first line of a chunk.
+    */
+    std::size_t first_line(std::size_t index)const;
+    
+    /**
+        Return the line number of the last line of a chunk.
+    */
+    std::size_t last_line(std::size_t index)const;
+    
+    /**
+        Run a chunk against a command_stack object. The effect is the same as
+        calling eval() on the chunk's source code.
+    */
+    void replay(std::size_t index, command_stack &)const;
+private:
+    friend void compile_file(const char *, const char *, compiled_file &, 
+                             std::size_t);
+    friend void save(const compiled_file &, std::string &);
+    friend bool load(const char *, const char *, compiled_file &);
+    
+    struct chunk
+    {
+        std::size_t first_instruction;
+        std::size_t last_instruction;
+        std::size_t first_line;
+        std::size_t last_line;
+    };
+    
+    static const std::size_t CHUNKS_PER_PROGRAM = 64;
+    
+    std::vector<program> m_programs;
+    std::vector<chunk> m_chunks;
+};
+
+/**
+    Split the source code of a script file into chunks and compile the chunks
+    on a pool of threads. Any previous contents of the output are replaced.
+    
+    The code is split at the same places as when a file is read line by line
+    and each line is fed to a code_scanner, evaluating the code read so far
+    each time the scanner reports it complete. Each line is terminated by a 
+    new line character, and incomplete code at the end of the file is left 
+    out. Replaying the chunks in order has the same effect as evaluating the 
+    code in that way, including stopping at the same parse error.
+    
+    @param threads The number of threads to use, or 0 to use one thread for
+           each processor.
+*/
+void compile_file(const char * source_begin, const char * source_end,
+                  compiled_file &, std::size_t threads = 0);
+
+/**
+    Write a binary image of a compiled file to the output string, replacing
+    its contents. The image starts with a format header, and can only be read
+    back by a build of the same format version for the same platform. The
+    source code isn't saved.
+*/
+void save(const compiled_file &, std::string & output);
+
+/**
+    Read a compiled file image written by save(). Any previous contents of 
+    the output are replaced. Returns false if the header doesn't match or
+    the image is not valid, in which case the output is left empty.
+*/
+bool load(const char * image_begin, const char * image_end, 
+          compiled_file &);
+
+} //namespace cubescript
+
+#endif
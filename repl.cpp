@@ -5,6 +5,10 @@
 #include <string>
 #include "cubescript.hpp"
 #include "lua_command_stack.hpp"
+#include "lua_string_library.hpp"
+#include "lua_list.hpp"
+#include "lua_operators.hpp"
+#include "lua_exec_file.hpp"
 #include "lua/pcall.hpp"
 
 static int env_table_ref = LUA_NOREF;
@@ -20,7 +24,12 @@ static int set_env_table(lua_State * L)
     return 0;
 }
 
-int main(int, char**)
+/*
+    Usage: repl [script]. With a script argument, the Lua script is run after
+    init.lua instead of reading Cubescript from the terminal, and the exit 
+    status is 1 if either of them raises an error.
+*/
+int main(int argc, char ** argv)
 {
     lua_State * L = luaL_newstate();
     luaL_openlibs(L);
@@ -38,11 +47,38 @@ int main(int, char**)
     debug_traceback_function_ref = luaL_ref(L, LUA_REGISTRYINDEX);
     
     cubescript::lua::proxy_command_stack::register_metatable(L);
+    cubescript::lua::compiled_program::register_metatable(L);
+    cubescript::lua::code_scanner::register_metatable(L);
+    cubescript::lua::ast::register_metatable(L);
+    cubescript::lua::compiled_file::register_metatable(L);
+    cubescript::lua::mapped_file::register_metatable(L);
+    cubescript::lua::list::register_metatable(L);
+    cubescript::lua::script_file::register_metatable(L);
     
     luaL_Reg cubescript_functions[] = {
         {"eval", cubescript::lua::eval},
+        {"eval_file", cubescript::lua::eval_file},
+        {"map_file", &cubescript::lua::mapped_file::create},
         {"command_stack", &cubescript::lua::proxy_command_stack::create},
+        {"compile", &cubescript::lua::compiled_program::create},
         {"is_complete_expression", &cubescript::lua::is_complete_code},
+        {"code_scanner", &cubescript::lua::code_scanner::create},
+        {"parse", &cubescript::lua::ast::create},
+        {"to_lua", cubescript::lua::to_lua},
+        {"compile_file", &cubescript::lua::compiled_file::create},
+        {"load_compiled_file", &cubescript::lua::compiled_file::load},
+        {"exec_file", &cubescript::lua::script_file::exec},
+        {"lua_code_version", cubescript::lua::lua_code_version},
+        {"hash", cubescript::lua::source_hash},
+        {"list", &cubescript::lua::list::create},
+        {"operator", cubescript::lua::create_operator},
+        {"concatword", cubescript::lua::concatword},
+        {"concat", cubescript::lua::concat},
+        {"implode", cubescript::lua::implode},
+        {"strreplace", cubescript::lua::strreplace},
+        {"strstr", cubescript::lua::strstr},
+        {"substr", cubescript::lua::substr},
+        {"format", cubescript::lua::format},
         {NULL, NULL}
     };
     luaL_register(L, "cubescript", cubescript_functions);
@@ -51,21 +87,35 @@ int main(int, char**)
     lua_setglobal(L, "set_env_table");
     
     if(luaL_dofile(L, "./init.lua") != 0)
+    {
+        std::cerr<<lua_tostring(L, -1)<<std::endl;
+        if(argc > 1) return 1;
+    }
+    
+    if(argc > 1)
+    {
+        if(luaL_dofile(L, argv[1]) == 0) return 0;
         std::cerr<<lua_tostring(L, -1)<<std::endl;
+        return 1;
+    }
     
     std::string code;
+    cubescript::code_scanner scanner;
     const char * line;
     while((line = readline(code.length() ? ">> " : "> ")))
     {
         if(!line[0]) continue;
         
+        std::size_t line_start = code.length();
+        
         code += line;
         code += "\n";
         
         const char * code_c_str = code.c_str();
         const char * code_c_str_end = code_c_str + code.length();
         
-        if(!cubescript::is_complete_code(code_c_str, code_c_str_end)) continue;
+        if(!scanner.feed(code_c_str + line_start, code_c_str_end)) continue;
+        scanner.reset();
         
         if(env_table_ref != LUA_NOREF)
             lua_rawgeti(L, LUA_REGISTRYINDEX, env_table_ref);
@@ -83,7 +133,14 @@ int main(int, char**)
         
         try
         {
-            cubescript::eval(&code_c_str, code_c_str_end, lua_command);
+            cubescript::eval_status status = cubescript::try_eval(
+                &code_c_str, code_c_str_end, lua_command);
+            
+            if(status.error != cubescript::eval_status::OK)
+            {
+                std::cout<<"Parse error: "<<status.message()<<std::endl;
+                discard_stack = true;
+            }
         }
         catch(const cubescript::parse_error & error)
         {
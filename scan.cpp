@@ -0,0 +1,330 @@
+/*
+  Copyright (c) 2010 Graham Daws <graham.daws@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#include "scan.hpp"
+#include <cstring>
+
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define CUBESCRIPT_SCAN_X86
+#include <immintrin.h>
+#endif
+
+namespace cubescript{
+namespace scan{
+
+// Each set has five members so the kernels can use a fixed number of
+// comparisons; smaller sets are padded out with repeated characters.
+static const char STRING_SET[] = {'"', '\\', '^', '\r', '\n'};
+static const char MULTILINE_SET[] = {'[', ']', '@', '@', '@'};
+static const char COMMENT_SET[] = {'\n', '\r', ';', ';', ';'};
+
+typedef const char * (* find_function)(const char *, const char *,
+                                       const char *);
+
+typedef const char * (* find_substring_function)(const char *, const char *,
+                                                 const char *, std::size_t);
+
+static const char * find_scalar(const char * begin, const char * end,
+                                const char * set)
+{
+    for(; begin != end; begin++)
+    {
+        char c = *begin;
+        if(c == set[0] || c == set[1] || c == set[2] || c == set[3] ||
+           c == set[4]) return begin;
+    }
+    return end;
+}
+
+// The substring kernels are only called with a substring of at least two
+// characters that fits between begin and end.
+
+static const char * find_substring_scalar(const char * begin, const char * end,
+                                          const char * substring,
+                                          std::size_t length)
+{
+    const char * last = end - length;
+    const char first = substring[0];
+    
+    for(; begin <= last; begin++)
+    {
+        begin = static_cast<const char *>(
+            std::memchr(begin, first, last - begin + 1));
+        if(!begin) return end;
+        if(std::memcmp(begin + 1, substring + 1, length - 1) == 0)
+            return begin;
+    }
+    
+    return end;
+}
+
+#ifdef CUBESCRIPT_SCAN_X86
+
+__attribute__((target("sse2")))
+static const char * find_sse2(const char * begin, const char * end,
+                              const char * set)
+{
+    const __m128i c0 = _mm_set1_epi8(set[0]);
+    const __m128i c1 = _mm_set1_epi8(set[1]);
+    const __m128i c2 = _mm_set1_epi8(set[2]);
+    const __m128i c3 = _mm_set1_epi8(set[3]);
+    const __m128i c4 = _mm_set1_epi8(set[4]);
+
+    for(; end - begin >= 16; begin += 16)
+    {
+        __m128i block = _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(begin));
+
+        __m128i match = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(block, c0), _mm_cmpeq_epi8(block, c1)),
+            _mm_or_si128(_mm_cmpeq_epi8(block, c2), _mm_cmpeq_epi8(block, c3)));
+        match = _mm_or_si128(match, _mm_cmpeq_epi8(block, c4));
+
+        unsigned int mask = _mm_movemask_epi8(match);
+        if(mask) return begin + __builtin_ctz(mask);
+    }
+
+    return find_scalar(begin, end, set);
+}
+
+__attribute__((target("avx2")))
+static const char * find_avx2(const char * begin, const char * end,
+                              const char * set)
+{
+    const __m256i c0 = _mm256_set1_epi8(set[0]);
+    const __m256i c1 = _mm256_set1_epi8(set[1]);
+    const __m256i c2 = _mm256_set1_epi8(set[2]);
+    const __m256i c3 = _mm256_set1_epi8(set[3]);
+    const __m256i c4 = _mm256_set1_epi8(set[4]);
+
+    for(; end - begin >= 32; begin += 32)
+    {
+        __m256i block = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i *>(begin));
+
+        __m256i match = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(block, c0),
+                            _mm256_cmpeq_epi8(block, c1)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(block, c2),
+                            _mm256_cmpeq_epi8(block, c3)));
+        match = _mm256_or_si256(match, _mm256_cmpeq_epi8(block, c4));
+
+        unsigned int mask = _mm256_movemask_epi8(match);
+        if(mask) return begin + __builtin_ctz(mask);
+    }
+
+    return find_sse2(begin, end, set);
+}
+
+// The substring kernels compare each block against the first and the last
+// character of the substring, and only check the candidate positions where
+// both match.
+
+__attribute__((target("sse2")))
+static const char * find_substring_sse2(const char * begin, const char * end,
+                                        const char * substring,
+                                        std::size_t length)
+{
+    const __m128i first = _mm_set1_epi8(substring[0]);
+    const __m128i last = _mm_set1_epi8(substring[length - 1]);
+    
+    // Enough characters left for a block of candidate positions
+    const std::ptrdiff_t block_span = length + 15;
+    
+    for(; end - begin >= block_span; begin += 16)
+    {
+        __m128i block_first = _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(begin));
+        __m128i block_last = _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(begin + length - 1));
+        
+        unsigned int mask = _mm_movemask_epi8(_mm_and_si128(
+            _mm_cmpeq_epi8(block_first, first),
+            _mm_cmpeq_epi8(block_last, last)));
+        
+        while(mask)
+        {
+            unsigned int offset = __builtin_ctz(mask);
+            if(std::memcmp(begin + offset + 1, substring + 1, length - 2) == 0)
+                return begin + offset;
+            mask &= mask - 1;
+        }
+    }
+    
+    return find_substring_scalar(begin, end, substring, length);
+}
+
+__attribute__((target("avx2")))
+static const char * find_substring_avx2(const char * begin, const char * end,
+                                        const char * substring,
+                                        std::size_t length)
+{
+    const __m256i first = _mm256_set1_epi8(substring[0]);
+    const __m256i last = _mm256_set1_epi8(substring[length - 1]);
+    
+    // Enough characters left for a block of candidate positions
+    const std::ptrdiff_t block_span = length + 31;
+    
+    for(; end - begin >= block_span; begin += 32)
+    {
+        __m256i block_first = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i *>(begin));
+        __m256i block_last = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i *>(begin + length - 1));
+        
+        unsigned int mask = _mm256_movemask_epi8(_mm256_and_si256(
+            _mm256_cmpeq_epi8(block_first, first),
+            _mm256_cmpeq_epi8(block_last, last)));
+        
+        while(mask)
+        {
+            unsigned int offset = __builtin_ctz(mask);
+            if(std::memcmp(begin + offset + 1, substring + 1, length - 2) == 0)
+                return begin + offset;
+            mask &= mask - 1;
+        }
+    }
+    
+    return find_substring_sse2(begin, end, substring, length);
+}
+
+#endif
+
+static bool is_supported(kernel k)
+{
+    switch(k)
+    {
+        case SCALAR: return true;
+#ifdef CUBESCRIPT_SCAN_X86
+        case SSE2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("sse2");
+        case AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+#endif
+        default: return false;
+    }
+}
+
+static find_function get_find_function(kernel k)
+{
+    switch(k)
+    {
+#ifdef CUBESCRIPT_SCAN_X86
+        case SSE2: return find_sse2;
+        case AVX2: return find_avx2;
+#endif
+        default: return find_scalar;
+    }
+}
+
+static find_substring_function get_find_substring_function(kernel k)
+{
+    switch(k)
+    {
+#ifdef CUBESCRIPT_SCAN_X86
+        case SSE2: return find_substring_sse2;
+        case AVX2: return find_substring_avx2;
+#endif
+        default: return find_substring_scalar;
+    }
+}
+
+static const char * find_init(const char *, const char *, const char *);
+
+static kernel current_kernel = SCALAR;
+static find_function find = find_init;
+static find_substring_function substring_find = find_substring_scalar;
+
+static void select_kernel()
+{
+    if(is_supported(AVX2)) set_kernel(AVX2);
+    else if(is_supported(SSE2)) set_kernel(SSE2);
+    else set_kernel(SCALAR);
+}
+
+static const char * find_init(const char * begin, const char * end,
+                              const char * set)
+{
+    // Only reached if a scan function is used before static initialization
+    select_kernel();
+    return find(begin, end, set);
+}
+
+static struct kernel_selector
+{
+    kernel_selector()
+    {
+        if(find == find_init) select_kernel();
+    }
+} kernel_selector_instance;
+
+kernel get_kernel()
+{
+    if(find == find_init) select_kernel();
+    return current_kernel;
+}
+
+bool set_kernel(kernel k)
+{
+    if(!is_supported(k)) return false;
+    current_kernel = k;
+    find = get_find_function(k);
+    substring_find = get_find_substring_function(k);
+    return true;
+}
+
+const char * string_special(const char * begin, const char * end)
+{
+    return find(begin, end, STRING_SET);
+}
+
+const char * multiline_special(const char * begin, const char * end)
+{
+    return find(begin, end, MULTILINE_SET);
+}
+
+const char * comment_end(const char * begin, const char * end)
+{
+    return find(begin, end, COMMENT_SET);
+}
+
+const char * find_substring(const char * begin, const char * end,
+                            const char * substring, std::size_t length)
+{
+    if(length == 0) return begin;
+    if(static_cast<std::size_t>(end - begin) < length) return end;
+    
+    if(length == 1)
+    {
+        const char * found = static_cast<const char *>(
+            std::memchr(begin, substring[0], end - begin));
+        return found ? found : end;
+    }
+    
+    if(find == find_init) select_kernel();
+    return substring_find(begin, end, substring, length);
+}
+
+} //namespace scan
+} //namespace cubescript
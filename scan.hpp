@@ -0,0 +1,89 @@
+/*
+  Copyright (c) 2010 Graham Daws <graham.daws@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#ifndef CUBESCRIPT_SCAN_HPP
+#define CUBESCRIPT_SCAN_HPP
+
+#include <cstddef>
+
+namespace cubescript{
+namespace scan{
+
+/**
+    Implementations of the scanning functions. The fastest kernel supported by
+    the CPU is selected at startup.
+*/
+enum kernel
+{
+    SCALAR = 0,
+    SSE2,
+    AVX2
+};
+
+/**
+    Return the kernel currently used by the scanning functions.
+*/
+kernel get_kernel();
+
+/**
+    Select the kernel to be used by the scanning functions.
+
+    @return false if the CPU doesn't support the kernel, in which case the
+            current kernel is kept.
+*/
+bool set_kernel(kernel);
+
+/**
+    Find the next character of interest in a quoted string: '"', '\\', '^',
+    '\r' or '\n'.
+
+    @return Pointer to the character found, or end if there is none.
+*/
+const char * string_special(const char * begin, const char * end);
+
+/**
+    Find the next character of interest in a multiline string: '[', ']' or
+    '@'.
+
+    @return Pointer to the character found, or end if there is none.
+*/
+const char * multiline_special(const char * begin, const char * end);
+
+/**
+    Find the end of a comment: '\n', '\r' or ';'.
+
+    @return Pointer to the character found, or end if there is none.
+*/
+const char * comment_end(const char * begin, const char * end);
+
+/**
+    Find the first occurrence of a substring. An empty substring is found at
+    begin.
+
+    @return Pointer to the start of the occurrence, or end if there is none.
+*/
+const char * find_substring(const char * begin, const char * end,
+                            const char * substring, std::size_t length);
+
+} //namespace scan
+} //namespace cubescript
+
+#endif
@@ -0,0 +1,215 @@
+/*
+  Copyright (c) 2010 Graham Daws <graham.daws@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+/*
+    Compares evaluating a large generated config with eval() against 
+    replaying the program compiled from it (see bytecode.hpp), with a 
+    command stack that only counts the calls and with a lua_command_stack
+    whose commands are an empty Lua function.
+    
+    Usage: bench-bytecode [lines] [runs]. Prints the best time of the runs
+    for each path. The exit status is non-zero if the replay makes a 
+    different number of calls.
+*/
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include "../bytecode.hpp"
+#include "../lua_command_stack.hpp"
+
+using namespace cubescript;
+
+namespace{
+
+class counting_command_stack:public command_stack
+{
+public:
+    counting_command_stack()
+     :m_depth(0), m_calls(0)
+    {
+        
+    }
+    
+    std::size_t push_command()
+    {
+        return ++m_depth;
+    }
+    
+    void push_argument_symbol(const char *, std::size_t){}
+    void push_argument(){}
+    void push_argument(bool){}
+    void push_argument(int){}
+    void push_argument(float){}
+    void push_argument(long long){}
+    void push_argument(double){}
+    void push_argument(const char *, std::size_t){}
+    
+    std::string pop_string()
+    {
+        return "";
+    }
+    
+    void call(std::size_t)
+    {
+        m_depth--;
+        m_calls++;
+    }
+    
+    std::size_t calls()const
+    {
+        return m_calls;
+    }
+private:
+    std::size_t m_depth;
+    std::size_t m_calls;
+};
+
+// A config of lines like the ones found in game configs: variable settings,
+// key bindings with blocks, sub-expressions and comments
+std::string generate_config(int lines)
+{
+    std::string output;
+    char line[256];
+    for(int i = 0; i < lines; i++)
+    {
+        switch(i % 5)
+        {
+            case 0:
+                std::sprintf(line, "set var%i %i\n", i, i * 7);
+                break;
+            case 1:
+                std::sprintf(line, "bind KEY%i [say \"pressed %i\"; "
+                    "set last %i] // binding %i\n", i, i, i, i);
+                break;
+            case 2:
+                std::sprintf(line, "alias name%i (concat \"name\" %i 0.5)\n", 
+                    i, i);
+                break;
+            case 3:
+                std::sprintf(line, "say \"line %i with a longer string "
+                    "argument\" $var%i\n", i, i - 3);
+                break;
+            default:
+                std::sprintf(line, "// comment line %i\n", i);
+        }
+        output += line;
+    }
+    return output;
+}
+
+template<class Function>
+double best_time(int runs, Function function)
+{
+    double best = 0;
+    for(int run = 0; run < runs; run++)
+    {
+        std::clock_t start = std::clock();
+        function();
+        double elapsed = static_cast<double>(std::clock() - start) * 1000 / 
+            CLOCKS_PER_SEC;
+        if(run == 0 || elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+struct eval_source
+{
+    const std::string * source;
+    command_stack * stack;
+    void operator()()const
+    {
+        const char * cursor = source->data();
+        eval(&cursor, cursor + source->length(), *stack);
+    }
+};
+
+struct replay_program
+{
+    const program * code;
+    command_stack * stack;
+    void operator()()const
+    {
+        replay(*code, *stack);
+    }
+};
+
+int noop(lua_State *)
+{
+    return 0;
+}
+
+void report(const char * name, double eval_time, double replay_time)
+{
+    std::printf("%-18s eval %8.2fms  replay %8.2fms  (%.2fx)\n", name, 
+        eval_time, replay_time, eval_time / replay_time);
+}
+
+} //anonymous namespace
+
+int main(int argc, char ** argv)
+{
+    int lines = argc > 1 ? std::atoi(argv[1]) : 20000;
+    int runs = argc > 2 ? std::atoi(argv[2]) : 10;
+    
+    std::string source = generate_config(lines);
+    
+    program code;
+    compile(source.data(), source.data() + source.length(), code);
+    
+    std::printf("%i lines, %u bytes, %u instructions\n", lines, 
+        static_cast<unsigned int>(source.length()), 
+        static_cast<unsigned int>(code.size()));
+    
+    counting_command_stack eval_counter;
+    counting_command_stack replay_counter;
+    eval_source eval_counting = {&source, &eval_counter};
+    replay_program replay_counting = {&code, &replay_counter};
+    report("counting stack", best_time(runs, eval_counting), 
+        best_time(runs, replay_counting));
+    
+    if(eval_counter.calls() != replay_counter.calls())
+    {
+        std::cerr<<"eval made "<<eval_counter.calls()<<" calls, replay made "
+                 <<replay_counter.calls()<<std::endl;
+        return 1;
+    }
+    
+    lua_State * L = luaL_newstate();
+    lua_newtable(L);
+    const char * commands[] = {"set", "bind", "alias", "say", "concat", NULL};
+    for(const char ** name = commands; *name; name++)
+    {
+        lua_pushcfunction(L, noop);
+        lua_setfield(L, -2, *name);
+    }
+    
+    lua_command_stack lua_stack(L, lua_gettop(L));
+    eval_source eval_lua = {&source, &lua_stack};
+    replay_program replay_lua = {&code, &lua_stack};
+    report("lua_command_stack", best_time(runs, eval_lua), 
+        best_time(runs, replay_lua));
+    
+    lua_close(L);
+    return 0;
+}
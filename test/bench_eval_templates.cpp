@@ -0,0 +1,186 @@
+/*
+  Copyright (c) 2010 Graham Daws <graham.daws@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+/*
+    Compares the compiled eval() for command_stack, which calls the stack 
+    through virtual methods, with the eval templates in eval.hpp 
+    instantiated for a class derived from command_stack and for a class 
+    that isn't derived from it. Each stack only counts the calls.
+    
+    Usage: bench-eval-templates [bytes] [runs]. Prints the best time of the
+    runs for each path. The exit status is non-zero if the paths make 
+    different numbers of calls.
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include "../eval.hpp"
+
+using namespace cubescript;
+
+namespace{
+
+struct no_base{};
+
+/*
+    A stack with the same methods as command_stack. Derived from 
+    command_stack, the methods override its virtual methods.
+*/
+template<class Base>
+class counting_stack:public Base
+{
+public:
+    counting_stack()
+     :m_depth(0), m_arguments(0), m_calls(0)
+    {
+        
+    }
+    
+    std::size_t push_command()
+    {
+        return ++m_depth;
+    }
+    
+    void push_argument_symbol(const char *, std::size_t){m_arguments++;}
+    void push_argument(){m_arguments++;}
+    void push_argument(bool){m_arguments++;}
+    void push_argument(int){m_arguments++;}
+    void push_argument(float){m_arguments++;}
+    void push_argument(long long){m_arguments++;}
+    void push_argument(double){m_arguments++;}
+    void push_argument(const char *, std::size_t){m_arguments++;}
+    
+    std::string pop_string()
+    {
+        return "";
+    }
+    
+    void call(std::size_t)
+    {
+        m_depth--;
+        m_calls++;
+    }
+    
+    std::size_t count()const
+    {
+        return m_arguments + m_calls;
+    }
+private:
+    std::size_t m_depth;
+    std::size_t m_arguments;
+    std::size_t m_calls;
+};
+
+typedef counting_stack<command_stack> derived_counting_stack;
+typedef counting_stack<no_base> underived_counting_stack;
+
+// Expressions with words, numbers, strings, symbols, sub-expressions, blocks
+// and comments
+std::string generate_source(std::size_t bytes)
+{
+    std::string output;
+    char line[256];
+    for(int i = 0; output.length() < bytes; i++)
+    {
+        switch(i % 6)
+        {
+            case 0:
+                std::sprintf(line, "set var%i %i 2.5 -%i\n", i, i, i * 3);
+                break;
+            case 1:
+                std::sprintf(line, "echo (add $var%i (mul 2 (sub %i 1)))\n", 
+                    i - 1, i);
+                break;
+            case 2:
+                std::sprintf(line, "echo \"string %i with ^\"escapes^\"\" "
+                    "word%i\n", i, i);
+                break;
+            case 3:
+                std::sprintf(line, "bind key%i [echo %i; set last %i]\n", 
+                    i, i, i);
+                break;
+            case 4:
+                std::sprintf(line, "a; b %i; c (d) (e %i) // comment\n", i, i);
+                break;
+            default:
+                std::sprintf(line, "if (< $var%i 100) [echo small] "
+                    "[echo big]\n", i - 5);
+        }
+        output += line;
+    }
+    return output;
+}
+
+template<class Stack>
+double best_time(const std::string & source, int runs, Stack & stack)
+{
+    double best = 0;
+    for(int run = 0; run < runs; run++)
+    {
+        std::clock_t start = std::clock();
+        const char * cursor = source.data();
+        eval(&cursor, cursor + source.length(), stack);
+        double elapsed = static_cast<double>(std::clock() - start) * 1000 / 
+            CLOCKS_PER_SEC;
+        if(run == 0 || elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+} //anonymous namespace
+
+int main(int argc, char ** argv)
+{
+    std::size_t bytes = argc > 1 ? std::atoi(argv[1]) : 1500000;
+    int runs = argc > 2 ? std::atoi(argv[2]) : 300;
+    
+    std::string source = generate_source(bytes);
+    std::printf("%u bytes, best of %i runs\n", 
+        static_cast<unsigned int>(source.length()), runs);
+    
+    derived_counting_stack virtual_stack;
+    command_stack & virtual_stack_reference = virtual_stack;
+    double virtual_time = best_time(source, runs, virtual_stack_reference);
+    std::printf("virtual command_stack                       %.2fms\n", 
+        virtual_time);
+    
+    derived_counting_stack derived_stack;
+    double derived_time = best_time(source, runs, derived_stack);
+    std::printf("template on a command_stack-derived class   %.2fms (%+.0f%%)\n",
+        derived_time, (derived_time / virtual_time - 1) * 100);
+    
+    underived_counting_stack underived_stack;
+    double underived_time = best_time(source, runs, underived_stack);
+    std::printf("template on an underived class              %.2fms (%+.0f%%)\n",
+        underived_time, (underived_time / virtual_time - 1) * 100);
+    
+    if(virtual_stack.count() != derived_stack.count() ||
+       virtual_stack.count() != underived_stack.count())
+    {
+        std::cerr<<"the paths made different numbers of stack calls"
+                 <<std::endl;
+        return 1;
+    }
+    
+    return 0;
+}
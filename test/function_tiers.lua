@@ -0,0 +1,97 @@
+--[[
+  Copyright (c) 2010 Graham Daws <graham.daws@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+]]
+
+--[[
+    Checks that a function body behaves the same before and after it is
+    promoted from the interpreted tier to the compiled tier. Each body is
+    called more times than env.function_tier_threshold, and the output of
+    every call is compared with the output of the same call in an
+    environment where every body is compiled from the start.
+    
+    Run from the source directory: repl test/function_tiers.lua
+    The exit status is 1 if any output differs.
+]]
+
+local TIER_THRESHOLD = 8
+
+local cases = {
+    {"a b", "print $a $b", {1, 2}},
+    {"a b", "print (@ $a $b)", {"x", "y"}},
+    {"", "print (true) (false) (nil)", {}},
+    {"a", "looplist x [1 2] [print $x $a]", {1}},
+    {"", "if (< 1 2 3) [print yes] [print no]", {}},
+    {"", "if [= 1 2] [print a] [print b]", {}},
+    {"a", "if (< $a 2) [print $a] [print big]", {1}},
+    {"a", "if $a [print yes] [print no]", {"= 1 2"}},
+    {"", "print (< 3 2 1) (= 1 1 2) (!= 1 2 1) (>= 2 1 3)", {}},
+    {"a b", "print (+ $a $b)", {1}},
+    {"", "print (+ 1 2 3) (- 10 1 2) (* 2 3 4) (div 12 2 3)", {}},
+    {"", "print (! 0) (! (false)) (&& 1 2) (|| (nil) 3)", {}},
+    {"a", "def x $a; print $x", {5}},
+    {"a", "loop i 2 [print $i $a]", {7}},
+    {"", "print a; print [b", {}},
+    {"", "print \"x", {}},
+    {"", "print a ) b", {}}
+}
+
+local function run(env, case)
+    local output = {}
+    env.print = function(...)
+        local line = {}
+        for i = 1, select("#", ...) do line[i] = tostring(select(i, ...)) end
+        output[#output + 1] = table.concat(line, " ")
+    end
+    
+    local results = {}
+    for call = 1, TIER_THRESHOLD + 2 do
+        output = {}
+        local func = env.func(case[1], case[2])
+        local ok = pcall(func, unpack(case[3]))
+        results[call] = (ok and "" or "error ") .. table.concat(output, "\n")
+    end
+    return results
+end
+
+local function new_environment(threshold)
+    local env = loadfile("cubescript_library.lua")()
+    env.function_tier_threshold = threshold
+    return env
+end
+
+local failures = 0
+
+for _, case in ipairs(cases) do
+    local tiered = run(new_environment(TIER_THRESHOLD), case)
+    local compiled = run(new_environment(0), case)
+    for call = 1, #tiered do
+        if tiered[call] ~= compiled[call] then
+            failures = failures + 1
+            io.stderr:write(string.format(
+                "failed: %q call %i: %q, compiled: %q\n", 
+                case[2], call, tiered[call], compiled[call]))
+            break
+        end
+    end
+end
+
+print(#cases .. " cases, " .. failures .. " failures")
+os.exit(failures == 0 and 0 or 1)
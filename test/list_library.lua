@@ -0,0 +1,72 @@
+--[[
+  Copyright (c) 2010 Graham Daws <graham.daws@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+]]
+
+--[[
+    Checks the list commands of the library with list strings, list objects
+    and Lua arrays.
+    
+    Run from the source directory: repl test/list_library.lua
+    The exit status is 1 if any check fails.
+]]
+
+local env = loadfile("cubescript_library.lua")()
+local list = cubescript.list
+
+local failures = 0
+local count = 0
+
+local function show(value)
+    if type(value) == "table" then
+        return "{" .. table.concat(value, ",") .. "}"
+    end
+    return tostring(value)
+end
+
+local function check(expected, func, ...)
+    count = count + 1
+    local ok, result = pcall(func, ...)
+    result = ok and show(result) or "error: " .. tostring(result)
+    if result ~= expected then
+        failures = failures + 1
+        io.stderr:write(string.format("failed: check %i: %q, expected %q\n",
+                                      count, result, expected))
+    end
+end
+
+check("3", env.listlen, "a b c")
+check("b", env.at, "a b c", 2)
+check("3", env.listfind, "a b c", "c")
+check("-1", env.listfind, {"a", "b"}, "c")
+check("a b c", env.sortlist, "c b a")
+check("xxx y zz", env.sortlist, list("zz y xxx"))
+check("{a,b,c}", env.sortlist, {"c", "a", "b"})
+
+check("b", env.listdel, "a b c", "c a")
+check("x z", env.listdel, list("x y z"), "y")
+check("{a,c}", env.listdel, {"a", "b", "c"}, {"b"})
+check("{c}", env.listdel, {"a", "b", "c"}, "a b")
+check("b c", env.listdel, "a b c", {"a"})
+check("x z", env.listdel, list("x y z"), {"y"})
+check("{y}", env.listdel, {"x", "y"}, list("x"))
+
+print(count .. " checks, " .. failures .. " failures")
+os.exit(failures == 0 and 0 or 1)
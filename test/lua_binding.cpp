@@ -0,0 +1,274 @@
+/*
+  Copyright (c) 2010 Graham Daws <graham.daws@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+/*
+    Checks the Lua function bindings (lua_binding.hpp): functions of every 
+    supported signature are bound to a Lua table and called from Lua code,
+    directly and as Cubescript commands.
+    
+    Usage: test-lua-binding. The exit status is non-zero if any check fails.
+*/
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include "../lua_binding.hpp"
+#include "../lua_command_stack.hpp"
+
+using namespace cubescript;
+
+namespace{
+
+std::size_t failures = 0;
+
+/*
+    Run a Lua chunk and compare the string form of its first result with the
+    expected string. A failed chunk gives "error: " followed by the error 
+    message without its position prefix.
+*/
+void check(lua_State * L, const char * code, const std::string & expected)
+{
+    std::string result;
+    if(luaL_loadstring(L, code) == 0 && lua_pcall(L, 0, 1, 0) == 0)
+    {
+        lua_getglobal(L, "tostring");
+        lua_insert(L, -2);
+        lua_call(L, 1, 1);
+        std::size_t length;
+        const char * string = lua_tolstring(L, -1, &length);
+        result.assign(string, length);
+    }
+    else
+    {
+        std::string message = lua_tostring(L, -1);
+        std::size_t position = message.find("]:");
+        if(position != std::string::npos)
+            message = message.substr(message.find(' ', position) + 1);
+        result = "error: " + message;
+    }
+    lua_pop(L, 1);
+    
+    if(result == expected) return;
+    std::cerr<<"failed: "<<code<<"\n  result: "<<result<<"\n  expected: "
+             <<expected<<std::endl;
+    failures++;
+}
+
+bool called = false;
+
+void none()
+{
+    called = true;
+}
+
+const char * version()
+{
+    return "1.0";
+}
+
+const char * null_string()
+{
+    return NULL;
+}
+
+bool negate(bool value)
+{
+    return !value;
+}
+
+int add_int(int a, int b)
+{
+    return a + b;
+}
+
+long long add_long_long(long long a, long long b)
+{
+    return a + b;
+}
+
+float half(float value)
+{
+    return value / 2;
+}
+
+double sum(double a, double b, double c, double d)
+{
+    return a + b + c + d;
+}
+
+std::string times(const std::string & value, int times)
+{
+    std::string output;
+    for(int i = 0; i < times; i++) output += value;
+    return output;
+}
+
+// Each argument must stay valid while the others are converted
+std::string join(string_ref a, string_ref b, string_ref c)
+{
+    return std::string(a.data, a.length) + "," + 
+        std::string(b.data, b.length) + "," + 
+        std::string(c.data, c.length);
+}
+
+string_ref first_half(string_ref value)
+{
+    return string_ref(value.data, value.length / 2);
+}
+
+std::string last_string;
+
+void store(const std::string & value, bool append, int count, double scale)
+{
+    if(!append) last_string.clear();
+    for(int i = 0; i < count; i++) last_string += value;
+    last_string += scale > 1 ? "+" : "-";
+}
+
+void store_string(string_ref value)
+{
+    last_string.assign(value.data, value.length);
+}
+
+void set_two(int a, const std::string & b)
+{
+    last_string = b + std::string(a, '!');
+}
+
+void set_three(bool a, float b, string_ref c)
+{
+    last_string = std::string(c.data, c.length) + (a ? "t" : "f") + 
+        (b > 0 ? "p" : "n");
+}
+
+int fail(int value)
+{
+    if(value < 0) throw std::runtime_error("negative value");
+    return value;
+}
+
+} //anonymous namespace
+
+int main()
+{
+    lua_State * L = luaL_newstate();
+    luaL_openlibs(L);
+    
+    lua_pushcfunction(L, lua::eval);
+    lua_setglobal(L, "eval");
+    
+    lua_newtable(L);
+    bind(L, -1, "none", none);
+    bind(L, -1, "version", version);
+    bind(L, -1, "null_string", null_string);
+    bind(L, -1, "negate", negate);
+    bind(L, -1, "add_int", add_int);
+    bind(L, -1, "add_long_long", add_long_long);
+    bind(L, -1, "half", half);
+    bind(L, -1, "sum", sum);
+    bind(L, -1, "times", times);
+    bind(L, -1, "join", join);
+    bind(L, -1, "first_half", first_half);
+    bind(L, -1, "store", store);
+    bind(L, -1, "store_string", store_string);
+    bind(L, -1, "set_two", set_two);
+    bind(L, -1, "set_three", set_three);
+    bind(L, -1, "fail", fail);
+    lua_setglobal(L, "bound");
+    
+    // Results and argument conversions
+    check(L, "return bound.none()", "nil");
+    if(!called) 
+    {
+        std::cerr<<"failed: none() wasn't called"<<std::endl;
+        failures++;
+    }
+    check(L, "return bound.version()", "1.0");
+    check(L, "return bound.null_string()", "nil");
+    check(L, "return bound.negate(nil)", "true");
+    check(L, "return bound.negate(0)", "false");
+    check(L, "return bound.add_int(2, '3')", "5");
+    check(L, "return bound.add_int(2.75, 1)", "3");
+    check(L, "return bound.add_long_long(2^40, 1)", "1099511627777");
+    check(L, "return bound.half(5)", "2.5");
+    check(L, "return bound.sum(1, 2, 3, 4.5)", "10.5");
+    check(L, "return bound.times('ab', 3)", "ababab");
+    check(L, "return bound.times(12, 2)", "1212");
+    check(L, "return bound.join('a', 123456789012, 2.5)", 
+          "a,123456789012,2.5");
+    check(L, "return bound.first_half('abcdef')", "abc");
+    check(L, "return bound.first_half('a\\0bc')", std::string("a\0", 2));
+    
+    // Functions without return values
+    check(L, "bound.store('x', false, 3, 2) return true", "true");
+    if(last_string != "xxx+")
+    {
+        std::cerr<<"failed: store() result "<<last_string<<std::endl;
+        failures++;
+    }
+    check(L, "return select('#', bound.store_string('s'))", "0");
+    check(L, "bound.set_two(2, 'y') return true", "true");
+    if(last_string != "y!!")
+    {
+        std::cerr<<"failed: set_two() result "<<last_string<<std::endl;
+        failures++;
+    }
+    check(L, "bound.set_three(true, -1, 'z') return true", "true");
+    if(last_string != "ztn")
+    {
+        std::cerr<<"failed: set_three() result "<<last_string<<std::endl;
+        failures++;
+    }
+    
+    // Argument errors are raised before any argument is converted
+    check(L, "return bound.add_int(1)", 
+          "error: bad argument #2 to 'add_int' (number expected, got no value)");
+    check(L, "return bound.add_int('x', 1)", 
+          "error: bad argument #1 to 'add_int' (number expected, got string)");
+    check(L, "return bound.times({}, 1)", 
+          "error: bad argument #1 to 'times' (string expected, got table)");
+    check(L, "return bound.join('a', 'b', nil)", 
+          "error: bad argument #3 to 'join' (string expected, got nil)");
+    check(L, "return bound.store('a', true, 1, 'x')",
+          "error: bad argument #4 to 'store' (number expected, got string)");
+    
+    // C++ exceptions become Lua errors
+    check(L, "return bound.fail(1)", "1");
+    check(L, "return bound.fail(-1)", "error: negative value");
+    check(L, "return select(2, pcall(bound.fail, -1))", "negative value");
+    
+    // The bound functions are Cubescript commands in an environment table
+    check(L, "bound.print = function(...) result = table.concat({...}, ' ') "
+             "end return eval('print (join a 1 (add_int 2 3))\\n', bound)", 
+          "nil");
+    check(L, "return result", "a,1,5");
+    check(L, "return (eval('fail -2\\n', bound):match('[^\\n]*'))", 
+          "negative value");
+    
+    lua_close(L);
+    
+    if(failures)
+    {
+        std::cerr<<failures<<" failures"<<std::endl;
+        return 1;
+    }
+    
+    return 0;
+}
@@ -0,0 +1,58 @@
+--[[
+  Copyright (c) 2010 Graham Daws <graham.daws@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+]]
+
+--[[
+    Checks that a mapped file can't be closed while it is being read.
+    
+    Run from the source directory: repl test/mapped_file.lua
+]]
+
+local path = os.tmpname()
+local file = assert(io.open(path, "wb"))
+file:write(string.rep("noop\n", 1000))
+file:close()
+
+local mapped = assert(cubescript.map_file(path))
+local close_errors = 0
+
+local env = setmetatable({}, {__index = _G})
+env.noop = function()
+    if not pcall(mapped.close, mapped) then close_errors = close_errors + 1 end
+end
+
+local error_message = cubescript.eval(mapped, env)
+assert(error_message == nil, error_message)
+assert(close_errors == 1000, "closed while being read")
+
+-- The file can be closed once eval returns
+mapped:close()
+assert(#mapped == 0)
+
+-- An error raised by close is reported by eval
+mapped = assert(cubescript.map_file(path))
+env.noop = function() mapped:close() end
+assert(cubescript.eval(mapped, env) ~= nil, "close error isn't reported")
+assert(#mapped > 0)
+mapped:close()
+
+os.remove(path)
+print("ok")
@@ -0,0 +1,154 @@
+/*
+  Copyright (c) 2010 Graham Daws <graham.daws@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+/*
+    Checks the native_command_stack and the function bindings against cases
+    that depend on where argument and result strings are stored.
+    
+    Usage: test-native-command-stack. The program's exit status is non-zero
+    if any check fails.
+*/
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../binding.hpp"
+#include "../cubescript.hpp"
+
+using namespace cubescript;
+
+namespace{
+
+std::size_t failures = 0;
+
+void check(bool condition, const char * description)
+{
+    if(condition) return;
+    std::cerr<<"failed: "<<description<<std::endl;
+    failures++;
+}
+
+void eval_string(native_command_stack & stack, const std::string & code)
+{
+    eval_status status = stack.eval(code.data(), code.data() + code.length());
+    if(status.error != eval_status::OK) status.throw_exception();
+}
+
+std::string join(const std::string & first, const std::string & second)
+{
+    return first + "," + second;
+}
+
+std::string join_refs(string_ref first, string_ref second, string_ref third)
+{
+    return std::string(first.data, first.length) + "," + 
+        std::string(second.data, second.length) + "," + 
+        std::string(third.data, third.length);
+}
+
+void fail()
+{
+    throw command_error("fail");
+}
+
+void ignore(const std::string &)
+{
+    
+}
+
+/*
+    A command that throws must not leave the arguments of the unfinished
+    outer expression on the stack: they refer to the caller's source code.
+*/
+void test_unwind_on_error()
+{
+    native_command_stack stack;
+    bind(stack, "join", join);
+    bind(stack, "fail", fail);
+    bind(stack, "ignore", ignore);
+    
+    eval_string(stack, "join first second\n");
+    check(stack.size() == 1, "result left on the stack");
+    
+    std::vector<char> source;
+    const char * code = "ignore some_argument_string_here (fail)\n";
+    source.assign(code, code + std::strlen(code));
+    
+    bool thrown = false;
+    try
+    {
+        stack.eval(&source[0], &source[0] + source.size());
+    }
+    catch(const eval_error &)
+    {
+        thrown = true;
+    }
+    
+    std::fill(source.begin(), source.end(), 'x');
+    
+    check(thrown, "command error is thrown");
+    check(stack.size() == 1, "stack is restored after an error");
+    check(stack.to_string(0) == "first,second", 
+          "earlier result survives an error");
+}
+
+/*
+    Converting a number argument to a string must not move the characters of
+    string arguments converted before it.
+*/
+void test_mixed_string_arguments()
+{
+    native_command_stack stack;
+    bind(stack, "join_refs", join_refs);
+    stack.set_variable("v", std::string("variable"));
+    
+    eval_string(stack, "join_refs (@ $v) 123456789012 1.5\n");
+    check(stack.to_string(0) == "variable,123456789012,1.5", 
+          "owned string followed by numbers");
+    stack.clear();
+    
+    eval_string(stack, "join_refs $v 1234567 true\n");
+    check(stack.to_string(0) == "variable,1234567,true", 
+          "variable followed by numbers");
+    stack.clear();
+    
+    eval_string(stack, "join_refs -9223372036854775807 -1.2345678901234e-300 "
+                       "source\n");
+    check(stack.to_string(0) == 
+          "-9223372036854775807,-1.2345678901234e-300,source", 
+          "longest number conversions");
+}
+
+} //anonymous namespace
+
+int main()
+{
+    test_unwind_on_error();
+    test_mixed_string_arguments();
+    
+    if(failures)
+    {
+        std::cerr<<failures<<" failures"<<std::endl;
+        return 1;
+    }
+    
+    return 0;
+}
@@ -0,0 +1,189 @@
+/*
+  Copyright (c) 2010 Graham Daws <graham.daws@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+/*
+    Checks that every scanning kernel supported by the CPU gives the same
+    results as a plain loop, on a generated corpus of buffers of every length
+    up to a few blocks, starting at every alignment, so that the tails
+    shorter than a block are covered.
+    
+    Usage: test-scan-kernels. The exit status is non-zero if any result 
+    differs.
+*/
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../scan.hpp"
+
+using namespace cubescript;
+
+namespace{
+
+const char * const KERNEL_NAMES[] = {"scalar", "sse2", "avx2"};
+
+const std::size_t MAX_LENGTH = 160;
+const std::size_t MAX_OFFSET = 32;
+const int ROUNDS = 40;
+
+// The corpus is mostly plain characters, with each special character
+// and bytes above 127 mixed in
+const char ALPHABET[] = "abcdefghij \t\"\\^\r\n[]@;\x80\xff";
+
+unsigned int random_state = 12345;
+
+unsigned int next_random()
+{
+    random_state = random_state * 1103515245 + 12345;
+    return (random_state >> 16) & 0x7fff;
+}
+
+char random_char(unsigned int plain_odds)
+{
+    std::size_t specials = sizeof(ALPHABET) - 1 - 10;
+    if(next_random() % plain_odds) return ALPHABET[next_random() % 10];
+    return ALPHABET[10 + next_random() % specials];
+}
+
+const char * find_any(const char * begin, const char * end, 
+                      const char * characters)
+{
+    for(; begin != end; ++begin)
+        if(*begin && std::strchr(characters, *begin)) return begin;
+    return end;
+}
+
+const char * find_substring(const char * begin, const char * end, 
+                            const char * substring, std::size_t length)
+{
+    if(static_cast<std::size_t>(end - begin) < length) return end;
+    for(const char * start = begin; start + length <= end; ++start)
+        if(std::memcmp(start, substring, length) == 0) return start;
+    return end;
+}
+
+std::size_t failures = 0;
+
+void check(const char * function, scan::kernel kernel, std::size_t length,
+           std::size_t offset, const char * result, const char * expected)
+{
+    if(result == expected) return;
+    if(failures++ < 10)
+    {
+        std::cerr<<"failed: "<<function<<" with the "<<KERNEL_NAMES[kernel]
+                 <<" kernel, length "<<length<<", offset "<<offset
+                 <<std::endl;
+    }
+}
+
+void test_buffer(const char * begin, const char * end, std::size_t offset, 
+                 const std::vector<std::string> & substrings)
+{
+    std::size_t length = end - begin;
+    
+    const char * string_expected = find_any(begin, end, "\"\\^\r\n");
+    const char * multiline_expected = find_any(begin, end, "[]@");
+    const char * comment_expected = find_any(begin, end, "\n\r;");
+    
+    std::vector<const char *> substring_expected;
+    for(std::size_t i = 0; i < substrings.size(); i++)
+    {
+        substring_expected.push_back(find_substring(begin, end, 
+            substrings[i].data(), substrings[i].length()));
+    }
+    
+    for(int k = scan::SCALAR; k <= scan::AVX2; k++)
+    {
+        scan::kernel kernel = static_cast<scan::kernel>(k);
+        if(!scan::set_kernel(kernel)) continue;
+        
+        check("string_special", kernel, length, offset,
+              scan::string_special(begin, end), string_expected);
+        check("multiline_special", kernel, length, offset,
+              scan::multiline_special(begin, end), multiline_expected);
+        check("comment_end", kernel, length, offset,
+              scan::comment_end(begin, end), comment_expected);
+        
+        for(std::size_t i = 0; i < substrings.size(); i++)
+        {
+            check("find_substring", kernel, length, offset,
+                  scan::find_substring(begin, end, substrings[i].data(), 
+                                       substrings[i].length()),
+                  substring_expected[i]);
+        }
+    }
+}
+
+} //anonymous namespace
+
+int main()
+{
+    scan::kernel initial_kernel = scan::get_kernel();
+    
+    for(int round = 0; round < ROUNDS; round++)
+    {
+        // Special characters are rare in some rounds, so that the kernels
+        // scan whole blocks before finding one
+        unsigned int plain_odds = round % 2 ? 4 : 200;
+        
+        for(std::size_t length = 0; length <= MAX_LENGTH; length++)
+        {
+            std::size_t offset = next_random() % MAX_OFFSET;
+            
+            // The buffer is exactly as long as the input, so that reading
+            // past the end is caught by the address sanitizer
+            char * buffer = new char[offset + length];
+            for(std::size_t i = 0; i < offset + length; i++)
+                buffer[i] = random_char(plain_odds);
+            
+            const char * begin = buffer + offset;
+            const char * end = begin + length;
+            
+            std::vector<std::string> substrings;
+            substrings.push_back("");
+            substrings.push_back(std::string(1, random_char(plain_odds)));
+            for(int i = 0; i < 4 && length; i++)
+            {
+                std::size_t start = next_random() % length;
+                std::size_t size = 1 + next_random() % 40;
+                if(start + size > length) size = length - start;
+                substrings.push_back(std::string(begin + start, size));
+            }
+            std::string missing(begin, std::min<std::size_t>(length, 20));
+            missing += '\x01';
+            substrings.push_back(missing);
+            
+            test_buffer(begin, end, offset, substrings);
+            delete [] buffer;
+        }
+    }
+    
+    scan::set_kernel(initial_kernel);
+    
+    if(failures)
+    {
+        std::cerr<<failures<<" failures"<<std::endl;
+        return 1;
+    }
+    
+    return 0;
+}
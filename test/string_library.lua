@@ -0,0 +1,84 @@
+--[[
+  Copyright (c) 2010 Graham Daws <graham.daws@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+]]
+
+--[[
+    Checks the string commands implemented in lua_string_library.cpp.
+    
+    Run from the source directory: repl test/string_library.lua
+    The exit status is 1 if any check fails.
+]]
+
+local failures = 0
+local count = 0
+
+local function check(expected, func, ...)
+    count = count + 1
+    local ok, result = pcall(func, ...)
+    if not ok then result = "error: " .. tostring(result) end
+    if result ~= expected then
+        failures = failures + 1
+        io.stderr:write(string.format("failed: check %i: %q, expected %q\n",
+                                      count, result, expected))
+    end
+end
+
+local c = cubescript
+local object = setmetatable({}, {__tostring = function() return "T" end})
+local bad = setmetatable({}, {__tostring = function() error("bad", 0) end})
+
+check("a12.5truenilTz", c.concatword, "a", 1, 2.5, true, nil, object, "z")
+check("a 1 false T", c.concat, "a", 1, false, object)
+check("", c.concat)
+check("error: bad", c.concat, "x", bad)
+check("error: attempt to concatenate a table value", c.concat, 
+      setmetatable({}, {__tostring = function() return {} end}))
+
+check("a, b, c", c.implode, {"a", "b", "c"}, ", ")
+check("a-2-T-d", c.implode, {"a", 2, object, "d"}, "-")
+check("", c.implode, {}, "-")
+check("ab", c.implode, setmetatable({"a", "b"}, {}))
+check("error: bad", c.implode, {"a", bad})
+
+-- Converting an element changes an element already read
+local pieces = {"first", "second"}
+pieces[3] = setmetatable({}, {__tostring = function()
+    pieces[1] = string.rep("x", 100)
+    return "third"
+end})
+check("first second third", c.implode, pieces, " ")
+
+check("bye world bye", c.strreplace, "hello world hello", "hello", "bye")
+check("bb", c.strreplace, "aaaa", "aa", "b")
+check("abc", c.strreplace, "abc", "", "x")
+check("", c.strreplace, "abc", "abc", "")
+
+check("one and 2 %%  %", c.format, "%1 and %2 %% %x %3%", "one", 2)
+check("A-5", c.format, "%a-%b", {a = "A", b = 5})
+check("a!", c.format, "%a", setmetatable({}, {
+    __index = function(_, key) return key .. "!" end}))
+check("error: invalid replacement value (a table)", c.format, "%a", {a = {}})
+check("100%", c.format, "100%")
+check("A B 1 -", c.format, "%a %b %c %d-", {a = "A", b = "B", c = 1})
+check(string.rep("x2", 10000), c.format, string.rep("%1%2", 10000), "x", 2)
+
+print(count .. " checks, " .. failures .. " failures")
+os.exit(failures == 0 and 0 or 1)
@@ -0,0 +1,219 @@
+/*
+  Copyright (c) 2010 Graham Daws <graham.daws@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+/*
+    Checks the Lua code generator against a corpus of inputs and expected
+    outputs. Each input is translated as code and as the body of a function
+    with the parameters "a b", once with every lua_code_options pass off and
+    once with the default options. The outputs with the passes off are the
+    golden translations: they must stay the same when the optimisation
+    passes change.
+    
+    The corpus file is a sequence of records, each one a line with a tag and
+    the length of the text, the text itself and a new line character:
+    
+        @input 11
+        print 1 2 3
+        @code 25
+        ...
+    
+    Usage: test-to-lua-golden corpus [--update]. With --update the expected
+    outputs are regenerated from the inputs and written back to the file.
+*/
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "../to_lua.hpp"
+
+using namespace cubescript;
+
+namespace{
+
+const char * const OUTPUT_TAGS[] = {
+    "code", 
+    "function", 
+    "optimised_code", 
+    "optimised_function"
+};
+
+const std::size_t OUTPUT_COUNT = sizeof(OUTPUT_TAGS) / sizeof(OUTPUT_TAGS[0]);
+
+struct test_case
+{
+    std::string input;
+    std::string expected[OUTPUT_COUNT];
+};
+
+bool read_record(std::istream & input, std::string & tag, std::string & text)
+{
+    std::string header;
+    if(!std::getline(input, header)) return false;
+    
+    std::istringstream fields(header);
+    std::size_t length;
+    if(!(fields>>tag>>length) || tag.empty() || tag[0] != '@') 
+        throw std::runtime_error("bad record header: " + header);
+    tag.erase(0, 1);
+    
+    text.resize(length);
+    if(length) input.read(&text[0], length);
+    if(input.get() != '\n') throw std::runtime_error("truncated record");
+    return true;
+}
+
+void write_record(std::ostream & output, const char * tag, 
+                  const std::string & text)
+{
+    output<<'@'<<tag<<' '<<text.length()<<'\n'<<text<<'\n';
+}
+
+std::vector<test_case> read_corpus(const char * filename)
+{
+    std::ifstream file(filename, std::ios::binary);
+    if(!file) throw std::runtime_error(std::string("could not open ") + 
+                                       filename);
+    std::vector<test_case> cases;
+    std::string tag;
+    std::string text;
+    while(read_record(file, tag, text))
+    {
+        if(tag == "input")
+        {
+            cases.push_back(test_case());
+            cases.back().input = text;
+            continue;
+        }
+        
+        std::size_t index = 0;
+        while(index < OUTPUT_COUNT && tag != OUTPUT_TAGS[index]) index++;
+        if(index == OUTPUT_COUNT || cases.empty())
+            throw std::runtime_error("unexpected record @" + tag);
+        cases.back().expected[index] = text;
+    }
+    return cases;
+}
+
+std::string translate(const std::string & input, bool function, 
+                      const lua_code_options & options)
+{
+    const char * parameters = "a b";
+    const char * begin = input.data();
+    const char * end = begin + input.length();
+    std::string output;
+    try
+    {
+        if(function)
+        {
+            generate_lua_function(parameters, parameters + 3, begin, end, 
+                                  output, options);
+        }
+        else generate_lua_code(begin, end, output, options);
+    }
+    catch(const eval_error & error)
+    {
+        return std::string("error: ") + error.what();
+    }
+    return output;
+}
+
+void translate_all(const std::string & input, std::string * outputs)
+{
+    lua_code_options passes_off;
+    passes_off.fold_constants = false;
+    passes_off.eliminate_dead_branches = false;
+    passes_off.hoist_globals = false;
+    passes_off.inline_constants = false;
+    
+    lua_code_options defaults;
+    
+    outputs[0] = translate(input, false, passes_off);
+    outputs[1] = translate(input, true, passes_off);
+    outputs[2] = translate(input, false, defaults);
+    outputs[3] = translate(input, true, defaults);
+}
+
+} //anonymous namespace
+
+int main(int argc, char ** argv)
+{
+    if(argc < 2)
+    {
+        std::cerr<<"usage: "<<argv[0]<<" corpus [--update]"<<std::endl;
+        return 2;
+    }
+    
+    bool update = argc > 2 && std::strcmp(argv[2], "--update") == 0;
+    
+    try
+    {
+        std::vector<test_case> cases = read_corpus(argv[1]);
+        
+        if(update)
+        {
+            std::ofstream file(argv[1], std::ios::binary);
+            for(std::size_t i = 0; i < cases.size(); i++)
+            {
+                std::string outputs[OUTPUT_COUNT];
+                translate_all(cases[i].input, outputs);
+                write_record(file, "input", cases[i].input);
+                for(std::size_t j = 0; j < OUTPUT_COUNT; j++)
+                    write_record(file, OUTPUT_TAGS[j], outputs[j]);
+            }
+            std::cout<<"updated "<<cases.size()<<" cases"<<std::endl;
+            return 0;
+        }
+        
+        std::size_t failures = 0;
+        
+        for(std::size_t i = 0; i < cases.size(); i++)
+        {
+            std::string outputs[OUTPUT_COUNT];
+            translate_all(cases[i].input, outputs);
+            
+            for(std::size_t j = 0; j < OUTPUT_COUNT; j++)
+            {
+                if(outputs[j] == cases[i].expected[j]) continue;
+                if(failures++ < 10)
+                {
+                    std::cerr<<"case "<<i + 1<<" ("<<OUTPUT_TAGS[j]
+                             <<") input:\n"<<cases[i].input
+                             <<"\nexpected:\n"<<cases[i].expected[j]
+                             <<"\nactual:\n"<<outputs[j]<<std::endl;
+                }
+            }
+        }
+        
+        std::cout<<cases.size()<<" cases, "<<failures<<" failures"
+                 <<std::endl;
+        
+        return failures ? 1 : 0;
+    }
+    catch(const std::exception & error)
+    {
+        std::cerr<<error.what()<<std::endl;
+        return 2;
+    }
+}
@@ -0,0 +1,1336 @@
+/*
+  Copyright (c) 2010 Graham Daws <graham.daws@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "to_lua.hpp"
+#include "ast.hpp"
+
+namespace cubescript{
+
+namespace{
+
+enum template_kind
+{
+    FUNCTION_CALL = 0,
+    NATIVE_TRUE,
+    NATIVE_FALSE,
+    NATIVE_NIL,
+    DEFINE_VARIABLE,
+    ARITHMETIC_OPERATION,
+    COMPARISON_OPERATION,
+    LOGIC_OPERATION,
+    NOT_OPERATION,
+    RETURN_STATEMENT,
+    IF_STATEMENT,
+    LOOP,
+    DEFINE_FUNCTION
+};
+
+/**
+    A function name that is translated to a Lua compatible name, or that is
+    generated from a code template instead of a function call. Translation
+    happens first: "+" becomes "add", which has the arithmetic template.
+*/
+struct builtin_name
+{
+    const char * name;
+    const char * lua_name;
+    template_kind kind;
+    const char * lua_operator;
+};
+
+const builtin_name builtins[] = {
+    {"false", "_false", FUNCTION_CALL, NULL},
+    {"true", "_true", FUNCTION_CALL, NULL},
+    {"nil", "_nil", FUNCTION_CALL, NULL},
+    {"=", "equal", FUNCTION_CALL, NULL},
+    {"!=", "not_equal", FUNCTION_CALL, NULL},
+    {"<", "less_than", FUNCTION_CALL, NULL},
+    {"<=", "less_than_or_equal", FUNCTION_CALL, NULL},
+    {">", "greater_than", FUNCTION_CALL, NULL},
+    {">=", "greater_than_or_equal", FUNCTION_CALL, NULL},
+    {"!", "_not", FUNCTION_CALL, NULL},
+    {"||", "_or", FUNCTION_CALL, NULL},
+    {"&&", "_and", FUNCTION_CALL, NULL},
+    {"+", "add", FUNCTION_CALL, NULL},
+    {"-", "sub", FUNCTION_CALL, NULL},
+    {"*", "mul", FUNCTION_CALL, NULL},
+    {"if", "_if", FUNCTION_CALL, NULL},
+    {"return", "_return", FUNCTION_CALL, NULL},
+    {"@", "strcat", FUNCTION_CALL, NULL},
+    {"_true", NULL, NATIVE_TRUE, NULL},
+    {"_false", NULL, NATIVE_FALSE, NULL},
+    {"_nil", NULL, NATIVE_NIL, NULL},
+    {"def", NULL, DEFINE_VARIABLE, NULL},
+    {"add", NULL, ARITHMETIC_OPERATION, "+"},
+    {"sub", NULL, ARITHMETIC_OPERATION, "-"},
+    {"mul", NULL, ARITHMETIC_OPERATION, "*"},
+    {"div", NULL, ARITHMETIC_OPERATION, "/"},
+    {"equal", NULL, COMPARISON_OPERATION, "=="},
+    {"not_equal", NULL, COMPARISON_OPERATION, "~="},
+    {"less_than", NULL, COMPARISON_OPERATION, "<"},
+    {"less_than_or_equal", NULL, COMPARISON_OPERATION, "<="},
+    {"greater_than", NULL, COMPARISON_OPERATION, ">"},
+    {"greater_than_or_equal", NULL, COMPARISON_OPERATION, ">="},
+    {"_not", NULL, NOT_OPERATION, NULL},
+    {"_or", NULL, LOGIC_OPERATION, "or"},
+    {"_and", NULL, LOGIC_OPERATION, "and"},
+    {"_return", NULL, RETURN_STATEMENT, NULL},
+    {"_if", NULL, IF_STATEMENT, NULL},
+    {"loop", NULL, LOOP, NULL},
+    {"func", NULL, DEFINE_FUNCTION, NULL},
+    {NULL, NULL, FUNCTION_CALL, NULL}
+};
+
+const std::size_t BUILTIN_TABLE_SIZE = 128;
+
+/**
+    Perfect hash of the builtin names: the multipliers were picked so that 
+    no two names above share a slot. Adding a name may need new multipliers
+    (the builtin_table constructor throws a code_generation_error on a 
+    collision, so every translation fails until the hash is fixed).
+*/
+std::size_t builtin_hash(const char * name, std::size_t length)
+{
+    return (length + static_cast<unsigned char>(name[0]) * 17 + 
+        static_cast<unsigned char>(name[length - 1]) * 5) & 
+        (BUILTIN_TABLE_SIZE - 1);
+}
+
+class builtin_table
+{
+public:
+    builtin_table()
+    {
+        for(std::size_t i = 0; i < BUILTIN_TABLE_SIZE; i++) m_slots[i] = NULL;
+        
+        for(const builtin_name * entry = builtins; entry->name; entry++)
+        {
+            std::size_t slot = builtin_hash(entry->name, 
+                                            std::strlen(entry->name));
+            if(m_slots[slot])
+                throw code_generation_error(std::string("builtin names '") +
+                    m_slots[slot]->name + "' and '" + entry->name + 
+                    "' have the same hash");
+            m_slots[slot] = entry;
+        }
+    }
+    
+    const builtin_name * find(const char * name, std::size_t length)const
+    {
+        if(!length) return NULL;
+        const builtin_name * entry = m_slots[builtin_hash(name, length)];
+        if(!entry || std::strlen(entry->name) != length ||
+           std::memcmp(entry->name, name, length) != 0) return NULL;
+        return entry;
+    }
+private:
+    const builtin_name * m_slots[BUILTIN_TABLE_SIZE];
+};
+
+const builtin_table & get_builtin_table()
+{
+    static const builtin_table table;
+    return table;
+}
+
+/**
+    Format a number the same way as Lua's tostring() does.
+*/
+int format_number(double value, char * buffer)
+{
+    return std::sprintf(buffer, "%.14g", value);
+}
+
+bool is_name_char(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || 
+           (c >= '0' && c <= '9') || c == '_';
+}
+
+const char * const lua_keywords[] = {
+    "and", "break", "do", "else", "elseif", "end", "false", "for", 
+    "function", "if", "in", "local", "nil", "not", "or", "repeat", "return",
+    "then", "true", "until", "while", NULL
+};
+
+/**
+    Return true if the name can be declared as a Lua local.
+*/
+bool is_local_name(const char * name, std::size_t length)
+{
+    if(!length || (name[0] >= '0' && name[0] <= '9')) return false;
+    
+    for(std::size_t i = 0; i < length; i++)
+        if(!is_name_char(name[i])) return false;
+    
+    for(const char * const * keyword = lua_keywords; *keyword; keyword++)
+    {
+        if(std::strlen(*keyword) == length && 
+           std::memcmp(*keyword, name, length) == 0) return false;
+    }
+    
+    return true;
+}
+
+/**
+    The value Lua reads back from a number written by format_number().
+*/
+double lua_number(double value)
+{
+    char buffer[32];
+    format_number(value, buffer);
+    return std::strtod(buffer, NULL);
+}
+
+bool is_finite(double value)
+{
+    return value == value && value - value == 0;
+}
+
+/**
+    A value known when the code is generated.
+*/
+struct constant
+{
+    enum constant_type
+    {
+        NUMBER,
+        STRING,
+        BOOLEAN
+    };
+    
+    constant()
+     :type(NUMBER), number(0), boolean(false){}
+    
+    constant_type type;
+    double number;
+    bool boolean;
+    std::string string;
+    
+    void set_number(double value)
+    {
+        type = NUMBER;
+        number = value;
+    }
+    
+    void set_boolean(bool value)
+    {
+        type = BOOLEAN;
+        boolean = value;
+    }
+    
+    bool is_true()const
+    {
+        return type != BOOLEAN || boolean;
+    }
+    
+    bool equals(const constant & other)const
+    {
+        if(type != other.type) return false;
+        switch(type)
+        {
+            case NUMBER: return number == other.number;
+            case STRING: return string == other.string;
+            default: return boolean == other.boolean;
+        }
+    }
+};
+
+/**
+    Body calls in a loop count as this many calls when choosing the functions
+    to hoist.
+*/
+const unsigned int LOOP_CALL_WEIGHT = 2;
+
+/**
+    Most locals declared for hoisted functions (Lua allows 200 locals in a
+    function).
+*/
+const std::size_t MAX_HOISTED_FUNCTIONS = 32;
+
+} //anonymous namespace
+
+lua_code_options::lua_code_options()
+ :fold_constants(true), 
+  eliminate_dead_branches(true),
+  hoist_globals(false),
+  inline_constants(true)
+{
+    
+}
+
+code_generation_error::code_generation_error(const std::string & what)
+ :eval_error(what)
+{
+
+}
+
+/**
+    Writes the Lua code for a syntax tree. The generator works through the 
+    tree depth-first and writes the code in order straight to the output 
+    string, so the size of the output doesn't affect the cost of adding to
+    it. Bodies of if, loop and func expressions are parsed when they're 
+    reached and generated recursively.
+    
+    The optimisations in lua_code_options are made while the code is written:
+    constants are evaluated from the tree before an expression is generated,
+    and the variables declared by def, loop and func are tracked in a stack
+    of scopes that follows the Lua blocks being written.
+*/
+class lua_code_generator
+{
+public:
+    lua_code_generator(std::string & output, const lua_code_options & options)
+     :m_output(output), m_options(options)
+    {
+
+    }
+
+    void generate_code(const char * source_begin, const char * source_end)
+    {
+        ast tree;
+        parse_code(source_begin, source_end, tree);
+        generate_block(tree);
+    }
+
+    void generate_function(const char * parameters_begin, 
+                           const char * parameters_end,
+                           const char * body_begin, const char * body_end)
+    {
+        m_output += "function(";
+
+        bool first = true;
+        const char * cursor = parameters_begin;
+        while(cursor != parameters_end)
+        {
+            if(!is_name_char(*cursor))
+            {
+                cursor++;
+                continue;
+            }
+
+            const char * name = cursor;
+            while(cursor != parameters_end && is_name_char(*cursor)) cursor++;
+
+            if(!first) m_output += ',';
+            else first = false;
+            m_output.append(name, cursor);
+        }
+
+        m_output += ")\n";
+        
+        ast tree;
+        parse_code(body_begin, body_end, tree);
+        
+        if(m_options.hoist_globals)
+            hoist_functions(tree, parameters_begin, parameters_end);
+        
+        begin_scope();
+        declare_names(parameters_begin, parameters_end);
+        generate_block(tree);
+        end_scope();
+        
+        m_output += "end";
+    }
+private:
+    /**
+        The string value of an argument: the Lua name of a symbol, or the
+        contents of a string.
+    */
+    struct string_value
+    {
+        const char * data;
+        std::size_t length;
+    };
+
+    struct expression
+    {
+        const ast * tree;
+        const ast::node * node;
+        const expression * parent;
+
+        // Position of the expression's argument values in m_values
+        std::size_t values;
+    };
+
+    static void parse_code(const char * source_begin, const char * source_end,
+                           ast & tree)
+    {
+        std::string source(source_begin, source_end);
+        source += '\n';
+        parse(source.data(), source.data() + source.length(), tree);
+    }
+
+    void generate_block(const ast & tree)
+    {
+        begin_scope();
+        
+        for(std::size_t i = 0; i < tree.root_count(); i++)
+        {
+            const ast::node & node = tree.get_node(tree.root(i));
+            if(node.value.arguments.count == 0) continue;
+            generate_expression(tree, node, NULL);
+            m_output += '\n';
+        }
+        
+        end_scope();
+    }
+
+    void generate_expression(const ast & tree, const ast::node & node, 
+                             const expression * parent)
+    {
+        // Operator templates only apply to expressions used as values
+        constant value;
+        if(parent && m_options.fold_constants && 
+           constant_expression(tree, node, value))
+        {
+            append_constant(value);
+            return;
+        }
+        
+        expression input;
+        input.tree = &tree;
+        input.node = &node;
+        input.parent = parent;
+        input.values = m_values.size();
+
+        for(std::size_t i = 0; i < node.value.arguments.count; i++)
+        {
+            const ast::node & argument = tree.get_node(tree.argument(node, i));
+            string_value value;
+            value.data = NULL;
+            value.length = 0;
+            if(argument.type == ast::SYMBOL)
+            {
+                value.data = tree.string(argument);
+                value.length = argument.value.string.length;
+                compatible_name(value);
+            }
+            else if(argument.type == ast::STRING)
+            {
+                value.data = tree.string(argument);
+                value.length = argument.value.string.length;
+            }
+            m_values.push_back(value);
+        }
+
+        const builtin_name * code = find_template(input);
+        switch(code ? code->kind : FUNCTION_CALL)
+        {
+            case NATIVE_TRUE: m_output += "true"; break;
+            case NATIVE_FALSE: m_output += "false"; break;
+            case NATIVE_NIL: m_output += "nil"; break;
+            case DEFINE_VARIABLE: define_variable(input); break;
+            case ARITHMETIC_OPERATION: 
+                arithmetic_operation(input, code->lua_operator);
+                break;
+            case COMPARISON_OPERATION:
+                comparison_operation(input, code->lua_operator);
+                break;
+            case LOGIC_OPERATION: 
+                logic_operation(input, code->lua_operator);
+                break;
+            case NOT_OPERATION: not_operation(input); break;
+            case RETURN_STATEMENT: return_statement(input); break;
+            case IF_STATEMENT: if_statement(input); break;
+            case LOOP: loop(input); break;
+            case DEFINE_FUNCTION: define_function(input); break;
+            default: function_call(input);
+        }
+
+        m_values.resize(input.values);
+    }
+
+    /**
+        Translate a builtin name to its Lua name, without checking the name.
+    */
+    static void translate_name(string_value & name)
+    {
+        const builtin_name * builtin = 
+            get_builtin_table().find(name.data, name.length);
+        if(builtin && builtin->lua_name)
+        {
+            name.data = builtin->lua_name;
+            name.length = std::strlen(builtin->lua_name);
+        }
+    }
+
+    static string_value symbol_name(const ast & tree, const ast::node & node)
+    {
+        string_value name;
+        name.data = tree.string(node);
+        name.length = node.value.string.length;
+        translate_name(name);
+        return name;
+    }
+
+    void compatible_name(string_value & name)
+    {
+        const builtin_name * builtin = 
+            get_builtin_table().find(name.data, name.length);
+        
+        if(builtin && builtin->lua_name)
+        {
+            name.data = builtin->lua_name;
+            name.length = std::strlen(builtin->lua_name);
+            return;
+        }
+
+        for(std::size_t i = 0; i < name.length; i++)
+        {
+            if(!is_name_char(name.data[i]) && name.data[i] != '.')
+            {
+                throw code_generation_error("invalid name '" + 
+                    std::string(name.data, name.length) + "'");
+            }
+        }
+    }
+
+    const builtin_name * find_template(const expression & input)const
+    {
+        if(input.node->value.arguments.count == 0) return NULL;
+        const string_value & name = m_values[input.values];
+        if(!name.data) return NULL;
+        return get_builtin_table().find(name.data, name.length);
+    }
+
+    std::size_t argument_count(const expression & input)const
+    {
+        return input.node->value.arguments.count;
+    }
+
+    bool not_enough_args(const expression & input, std::size_t n)const
+    {
+        return argument_count(input) < n + 1;
+    }
+
+    const ast::node * get_argument(const expression & input, 
+                                   std::size_t index)const
+    {
+        if(index >= argument_count(input)) return NULL;
+        return &input.tree->get_node(input.tree->argument(*input.node, index));
+    }
+
+    void append_number(double value)
+    {
+        char buffer[32];
+        m_output.append(buffer, format_number(value, buffer));
+    }
+
+    /**
+        Write a quoted string, with control characters, backslashes and 
+        double quotes written as decimal escape sequences.
+    */
+    void append_string_literal(const char * value, std::size_t length)
+    {
+        m_output += '"';
+        const char * end = value + length;
+        const char * start = value;
+        for(const char * cursor = value; cursor != end; cursor++)
+        {
+            unsigned char c = static_cast<unsigned char>(*cursor);
+            if(c >= 32 && c != 127 && c != '\\' && c != '"') continue;
+            m_output.append(start, cursor);
+            char buffer[8];
+            m_output.append(buffer, std::sprintf(buffer, "\\%i", c));
+            start = cursor + 1;
+        }
+        m_output.append(start, end);
+        m_output += '"';
+    }
+
+    /**
+        Write the code for an argument used as a value in an expression.
+    */
+    void argument_code(const expression & input, std::size_t index)
+    {
+        const ast::node * argument = get_argument(input, index);
+        if(!argument) throw code_generation_error("empty expression");
+
+        const string_value & value = m_values[input.values + index];
+        switch(argument->type)
+        {
+            case ast::EXPRESSION:
+            {
+                // A constant can't be called without brackets
+                constant known;
+                if(index == 0 && m_options.fold_constants &&
+                   constant_expression(*input.tree, *argument, known))
+                {
+                    m_output += '(';
+                    append_constant(known);
+                    m_output += ')';
+                }
+                else generate_expression(*input.tree, *argument, &input);
+                break;
+            }
+            case ast::SYMBOL:
+            {
+                const constant * known = index > 0 && 
+                    m_options.inline_constants ? 
+                    find_constant(value.data, value.length) : NULL;
+                if(known) append_constant(*known);
+                else m_output.append(value.data, value.length);
+                break;
+            }
+            case ast::STRING:
+                append_string_literal(value.data, value.length);
+                break;
+            case ast::INTEGER:
+                append_number(static_cast<double>(argument->value.integer));
+                break;
+            case ast::REAL:
+                append_number(argument->value.real);
+                break;
+            default:
+                throw code_generation_error("unsupported argument value");
+        }
+    }
+
+    /**
+        Write an argument's value as it is, without quoting strings.
+    */
+    void raw_value(const expression & input, std::size_t index)
+    {
+        const ast::node * argument = get_argument(input, index);
+        const string_value & value = m_values[input.values + index];
+        if(argument && argument->type == ast::INTEGER)
+            append_number(static_cast<double>(argument->value.integer));
+        else if(argument && argument->type == ast::REAL)
+            append_number(argument->value.real);
+        else if(argument && value.data)
+            m_output.append(value.data, value.length);
+        else throw code_generation_error("missing argument value");
+    }
+
+    /**
+        Write the code for an argument that holds Cubescript code.
+    */
+    void body_code(const expression & input, std::size_t index)
+    {
+        const string_value & value = m_values[input.values + index];
+        if(!get_argument(input, index) || !value.data)
+            throw code_generation_error("expected code string");
+        generate_code(value.data, value.data + value.length);
+    }
+
+    bool is_variable(const expression & input, std::size_t index)const
+    {
+        const ast::node * argument = get_argument(input, index);
+        return argument && argument->type == ast::SYMBOL;
+    }
+
+    void function_call(const expression & input)
+    {
+        argument_code(input, 0);
+        m_output += '(';
+        for(std::size_t i = 1; i < argument_count(input); i++)
+        {
+            if(i > 1) m_output += ',';
+            argument_code(input, i);
+        }
+        m_output += ')';
+    }
+
+    void define_variable(const expression & input)
+    {
+        if(input.parent || not_enough_args(input, 2))
+        {
+            function_call(input);
+            return;
+        }
+        m_output += "local ";
+        raw_value(input, 1);
+        m_output += '=';
+        argument_code(input, 2);
+        
+        const string_value & name = m_values[input.values + 1];
+        if(m_options.inline_constants && name.data)
+        {
+            constant value;
+            bool is_constant = constant_node(*input.tree, 
+                *get_argument(input, 2), value);
+            declare_variable(name.data, name.length, 
+                             is_constant ? &value : NULL);
+        }
+    }
+
+    void arithmetic_operation(const expression & input, const char * op)
+    {
+        if(not_enough_args(input, 2) || !input.parent)
+        {
+            function_call(input);
+            return;
+        }
+        m_output += '(';
+        argument_code(input, 1);
+        for(std::size_t i = 2; i < argument_count(input); i++)
+        {
+            append_operator(op);
+            argument_code(input, i);
+        }
+        m_output += ')';
+    }
+
+    void comparison_operation(const expression & input, const char * op)
+    {
+        if(not_enough_args(input, 2) || !input.parent)
+        {
+            function_call(input);
+            return;
+        }
+        m_output += '(';
+        argument_code(input, 1);
+        append_operator(op);
+        argument_code(input, 2);
+        for(std::size_t i = 3; i < argument_count(input); i++)
+        {
+            m_output += " and ";
+            argument_code(input, i);
+            append_operator(op);
+            argument_code(input, 1);
+        }
+        m_output += ')';
+    }
+
+    void logic_operation(const expression & input, const char * op)
+    {
+        if(not_enough_args(input, 2) || !input.parent)
+        {
+            function_call(input);
+            return;
+        }
+        argument_code(input, 1);
+        append_operator(op);
+        argument_code(input, 2);
+    }
+
+    void not_operation(const expression & input)
+    {
+        if(not_enough_args(input, 1) || !input.parent)
+        {
+            function_call(input);
+            return;
+        }
+        m_output += "not ";
+        argument_code(input, 1);
+    }
+
+    void return_statement(const expression & input)
+    {
+        if(input.parent)
+        {
+            m_output += "error(\"invalid return statement\")";
+            return;
+        }
+        m_output += "do return ";
+        if(get_argument(input, 1)) argument_code(input, 1);
+        m_output += " end";
+    }
+
+    void if_statement(const expression & input)
+    {
+        if(input.parent || not_enough_args(input, 2))
+        {
+            function_call(input);
+            return;
+        }
+        constant condition;
+        if(m_options.eliminate_dead_branches && 
+           constant_node(*input.tree, *get_argument(input, 1), condition))
+        {
+            dead_branch_if_statement(input, condition.is_true());
+            return;
+        }
+        
+        m_output += "if ";
+        argument_code(input, 1);
+        m_output += " then\n";
+        body_code(input, 2);
+        if(get_argument(input, 3))
+        {
+            m_output += "else\n";
+            body_code(input, 3);
+        }
+        m_output += "end";
+    }
+
+    void loop(const expression & input)
+    {
+        const ast::node * counter = get_argument(input, 1);
+        if(!counter || counter->type == ast::EXPRESSION || 
+           counter->type == ast::NIL || counter->type == ast::SYMBOL ||
+           (counter->type == ast::BOOLEAN && !counter->value.boolean))
+        {
+            function_call(input);
+            return;
+        }
+        m_output += "for ";
+        raw_value(input, 1);
+        m_output += " = 0, ";
+        raw_value(input, 2);
+        m_output += " do\n";
+        
+        begin_scope();
+        const string_value & counter_name = m_values[input.values + 1];
+        if(counter_name.data)
+            declare_variable(counter_name.data, counter_name.length, NULL);
+        body_code(input, 3);
+        end_scope();
+        
+        m_output += "end";
+    }
+
+    /**
+        Write only the branch of an if statement that runs. The branches 
+        must be code strings, as they must for the full statement.
+    */
+    void dead_branch_if_statement(const expression & input, bool condition)
+    {
+        for(std::size_t i = 2; i <= 3; i++)
+        {
+            if(get_argument(input, i) && !m_values[input.values + i].data)
+                throw code_generation_error("expected code string");
+        }
+        
+        std::size_t branch = condition ? 2 : 3;
+        if(!get_argument(input, branch)) return;
+        
+        m_output += "do\n";
+        body_code(input, branch);
+        m_output += "end";
+    }
+
+    void define_function(const expression & input)
+    {
+        if(not_enough_args(input, 2) || is_variable(input, 1))
+        {
+            function_call(input);
+            return;
+        }
+
+        const ast::node & parameters = *get_argument(input, 1);
+        const string_value & names = m_values[input.values + 1];
+        char number[32];
+        const char * names_begin = names.data;
+        const char * names_end = names.data + names.length;
+        if(parameters.type == ast::INTEGER || parameters.type == ast::REAL)
+        {
+            names_begin = number;
+            names_end = number + format_number(parameters.type == ast::REAL ? 
+                parameters.value.real : 
+                static_cast<double>(parameters.value.integer), number);
+        }
+        else if(!names.data)
+            throw code_generation_error("expected parameter names");
+
+        const string_value & body = m_values[input.values + 2];
+        if(!body.data) throw code_generation_error("expected code string");
+
+        generate_function(names_begin, names_end, body.data, 
+                          body.data + body.length);
+    }
+
+    void append_operator(const char * op)
+    {
+        m_output += ' ';
+        m_output += op;
+        m_output += ' ';
+    }
+
+    /**
+        Write a constant. Numbers are written the same way as number
+        literals when that reads back as the same value, and with enough 
+        digits to read back exactly otherwise.
+    */
+    void append_constant(const constant & value)
+    {
+        switch(value.type)
+        {
+            case constant::NUMBER:
+            {
+                char buffer[32];
+                int length = format_number(value.number, buffer);
+                if(std::strtod(buffer, NULL) != value.number)
+                    length = std::sprintf(buffer, "%.17g", value.number);
+                
+                // Brackets keep a minus sign from following another operator
+                bool negative = buffer[0] == '-';
+                if(negative) m_output += '(';
+                m_output.append(buffer, length);
+                if(negative) m_output += ')';
+                break;
+            }
+            case constant::STRING:
+                append_string_literal(value.string.data(), 
+                                      value.string.length());
+                break;
+            case constant::BOOLEAN:
+                m_output += value.boolean ? "true" : "false";
+                break;
+        }
+    }
+
+    /**
+        Evaluate a node that is an argument value, if its value is known.
+    */
+    bool constant_node(const ast & tree, const ast::node & node, 
+                       constant & value)const
+    {
+        switch(node.type)
+        {
+            case ast::INTEGER:
+                value.set_number(lua_number(
+                    static_cast<double>(node.value.integer)));
+                return true;
+            case ast::REAL:
+                value.set_number(lua_number(node.value.real));
+                return true;
+            case ast::STRING:
+                value.type = constant::STRING;
+                value.string.assign(tree.string(node), 
+                                    node.value.string.length);
+                return true;
+            case ast::SYMBOL:
+            {
+                if(!m_options.inline_constants) return false;
+                string_value name = symbol_name(tree, node);
+                const constant * known = find_constant(name.data, name.length);
+                if(!known) return false;
+                value = *known;
+                return true;
+            }
+            case ast::EXPRESSION:
+                return m_options.fold_constants && 
+                    constant_expression(tree, node, value);
+            default:
+                return false;
+        }
+    }
+
+    /**
+        Evaluate an expression used as a value that would be generated from
+        an operator template, if all the arguments it uses are constants.
+    */
+    bool constant_expression(const ast & tree, const ast::node & node,
+                             constant & value)const
+    {
+        std::size_t count = node.value.arguments.count;
+        if(count == 0) return false;
+        
+        const ast::node & function = tree.get_node(tree.argument(node, 0));
+        if(function.type != ast::SYMBOL) return false;
+        
+        string_value name = symbol_name(tree, function);
+        const builtin_name * code = 
+            get_builtin_table().find(name.data, name.length);
+        if(!code) return false;
+        
+        switch(code->kind)
+        {
+            case NATIVE_TRUE:
+                value.set_boolean(true);
+                return true;
+            case NATIVE_FALSE:
+                value.set_boolean(false);
+                return true;
+            case ARITHMETIC_OPERATION:
+                return count >= 3 && 
+                    fold_arithmetic(tree, node, *code->lua_operator, value);
+            case COMPARISON_OPERATION:
+                return count >= 3 && 
+                    fold_comparison(tree, node, code->lua_operator, value);
+            case LOGIC_OPERATION:
+            {
+                constant a, b;
+                if(count < 3 || 
+                   !constant_node(tree, argument_node(tree, node, 1), a) ||
+                   !constant_node(tree, argument_node(tree, node, 2), b))
+                    return false;
+                bool is_or = code->lua_operator[0] == 'o';
+                value = a.is_true() == is_or ? a : b;
+                return true;
+            }
+            case NOT_OPERATION:
+            {
+                constant a;
+                if(count < 2 || 
+                   !constant_node(tree, argument_node(tree, node, 1), a))
+                    return false;
+                value.set_boolean(!a.is_true());
+                return true;
+            }
+            default:
+                return false;
+        }
+    }
+
+    static const ast::node & argument_node(const ast & tree, 
+        const ast::node & node, std::size_t index)
+    {
+        return tree.get_node(tree.argument(node, index));
+    }
+
+    bool fold_arithmetic(const ast & tree, const ast::node & node, char op, 
+                         constant & value)const
+    {
+        double result = 0;
+        for(std::size_t i = 1; i < node.value.arguments.count; i++)
+        {
+            constant operand;
+            if(!constant_node(tree, argument_node(tree, node, i), operand) ||
+               operand.type != constant::NUMBER) return false;
+            
+            if(i == 1)
+            {
+                result = operand.number;
+                continue;
+            }
+            
+            switch(op)
+            {
+                case '+': result += operand.number; break;
+                case '-': result -= operand.number; break;
+                case '*': result *= operand.number; break;
+                default: result /= operand.number;
+            }
+        }
+        
+        // Infinity and NaN have no literal in Lua
+        if(!is_finite(result)) return false;
+        
+        value.set_number(result);
+        return true;
+    }
+
+    static bool compare(const constant & a, const constant & b, 
+                        const char * op, bool & result)
+    {
+        if(op[0] == '=' || op[0] == '~')
+        {
+            result = a.equals(b) == (op[0] == '=');
+            return true;
+        }
+        
+        if(a.type != constant::NUMBER || b.type != constant::NUMBER) 
+            return false;
+        
+        bool or_equal = op[1] == '=';
+        if(op[0] == '<') 
+            result = or_equal ? a.number <= b.number : a.number < b.number;
+        else result = or_equal ? a.number >= b.number : a.number > b.number;
+        return true;
+    }
+
+    /**
+        The comparison template compares the first two arguments, and each
+        further argument with the first one.
+    */
+    bool fold_comparison(const ast & tree, const ast::node & node, 
+                         const char * op, constant & value)const
+    {
+        constant first;
+        if(!constant_node(tree, argument_node(tree, node, 1), first))
+            return false;
+        
+        bool result = true;
+        for(std::size_t i = 2; i < node.value.arguments.count; i++)
+        {
+            constant operand;
+            if(!constant_node(tree, argument_node(tree, node, i), operand))
+                return false;
+            
+            bool operand_result;
+            if(i == 2)
+            {
+                if(!compare(first, operand, op, operand_result)) return false;
+            }
+            else if(!compare(operand, first, op, operand_result)) return false;
+            
+            result = result && operand_result;
+        }
+        
+        value.set_boolean(result);
+        return true;
+    }
+
+    /**
+        A local declared by def (with its value, if it's a constant), a loop
+        counter or a function parameter.
+    */
+    struct variable
+    {
+        std::string name;
+        bool is_constant;
+        constant value;
+    };
+
+    void begin_scope()
+    {
+        m_scopes.push_back(m_variables.size());
+    }
+
+    void end_scope()
+    {
+        m_variables.resize(m_scopes.back());
+        m_scopes.pop_back();
+    }
+
+    void declare_variable(const char * name, std::size_t length, 
+                          const constant * value)
+    {
+        if(!m_options.inline_constants) return;
+        m_variables.push_back(variable());
+        variable & declared = m_variables.back();
+        declared.name.assign(name, length);
+        declared.is_constant = value != NULL;
+        if(value) declared.value = *value;
+    }
+
+    void declare_names(const char * names_begin, const char * names_end)
+    {
+        const char * cursor = names_begin;
+        while(cursor != names_end)
+        {
+            if(!is_name_char(*cursor))
+            {
+                cursor++;
+                continue;
+            }
+            const char * name = cursor;
+            while(cursor != names_end && is_name_char(*cursor)) cursor++;
+            declare_variable(name, cursor - name, NULL);
+        }
+    }
+
+    const constant * find_constant(const char * name, 
+                                   std::size_t length)const
+    {
+        for(std::size_t i = m_variables.size(); i > 0; i--)
+        {
+            const variable & declared = m_variables[i - 1];
+            if(declared.name.length() == length && 
+               std::memcmp(declared.name.data(), name, length) == 0)
+                return declared.is_constant ? &declared.value : NULL;
+        }
+        return NULL;
+    }
+
+    /**
+        Number of calls to a global function in a function body, weighted
+        for calls in loops. Functions that may be assigned to by the body
+        are excluded.
+    */
+    struct function_calls
+    {
+        std::string name;
+        unsigned int count;
+        bool excluded;
+    };
+
+    static function_calls & find_calls(std::vector<function_calls> & calls,
+                                       const string_value & name)
+    {
+        for(std::size_t i = 0; i < calls.size(); i++)
+        {
+            if(calls[i].name.length() == name.length &&
+               std::memcmp(calls[i].name.data(), name.data, name.length) == 0)
+                return calls[i];
+        }
+        calls.push_back(function_calls());
+        function_calls & added = calls.back();
+        added.name.assign(name.data, name.length);
+        added.count = 0;
+        added.excluded = false;
+        return added;
+    }
+
+    static void exclude_name(std::vector<function_calls> & calls,
+                             const ast & tree, const ast::node & node)
+    {
+        if(node.type != ast::SYMBOL && node.type != ast::STRING) return;
+        string_value name;
+        name.data = tree.string(node);
+        name.length = node.value.string.length;
+        if(node.type == ast::SYMBOL) translate_name(name);
+        find_calls(calls, name).excluded = true;
+    }
+
+    static void count_code_calls(const ast & tree, const ast::node & node,
+                                 unsigned int weight,
+                                 std::vector<function_calls> & calls)
+    {
+        if(node.type != ast::STRING) return;
+        ast body;
+        const char * code = tree.string(node);
+        parse_code(code, code + node.value.string.length, body);
+        count_block_calls(body, weight, calls);
+    }
+
+    static void count_block_calls(const ast & tree, unsigned int weight,
+                                  std::vector<function_calls> & calls)
+    {
+        for(std::size_t i = 0; i < tree.root_count(); i++)
+        {
+            count_calls(tree, tree.get_node(tree.root(i)), true, weight, 
+                        calls);
+        }
+    }
+
+    static void count_calls(const ast & tree, const ast::node & node,
+                            bool statement, unsigned int weight,
+                            std::vector<function_calls> & calls)
+    {
+        std::size_t count = node.value.arguments.count;
+        if(count == 0) return;
+        
+        const ast::node & function = argument_node(tree, node, 0);
+        if(function.type == ast::SYMBOL)
+        {
+            string_value name = symbol_name(tree, function);
+            const builtin_name * code = 
+                get_builtin_table().find(name.data, name.length);
+            
+            switch(code ? code->kind : FUNCTION_CALL)
+            {
+                case FUNCTION_CALL:
+                    if(is_local_name(name.data, name.length))
+                        find_calls(calls, name).count += weight;
+                    break;
+                case DEFINE_VARIABLE:
+                    if(count > 1) 
+                        exclude_name(calls, tree, argument_node(tree, node, 1));
+                    break;
+                case IF_STATEMENT:
+                    if(!statement) break;
+                    for(std::size_t i = 2; i < count && i <= 3; i++)
+                    {
+                        count_code_calls(tree, argument_node(tree, node, i),
+                                         weight, calls);
+                    }
+                    break;
+                case LOOP:
+                    if(count > 1) 
+                        exclude_name(calls, tree, argument_node(tree, node, 1));
+                    if(count > 3)
+                    {
+                        count_code_calls(tree, argument_node(tree, node, 3),
+                                         weight * LOOP_CALL_WEIGHT, calls);
+                    }
+                    break;
+                case DEFINE_FUNCTION:
+                    // The function body is generated with its own locals
+                    return;
+                default:
+                    break;
+            }
+        }
+        
+        for(std::size_t i = 0; i < count; i++)
+        {
+            const ast::node & argument = argument_node(tree, node, i);
+            if(argument.type == ast::EXPRESSION)
+                count_calls(tree, argument, false, weight, calls);
+        }
+    }
+
+    /**
+        Declare locals, at the start of a function, for the global functions
+        called more than once in the function body.
+    */
+    void hoist_functions(const ast & tree, const char * parameters_begin,
+                         const char * parameters_end)
+    {
+        std::vector<function_calls> calls;
+        
+        const char * cursor = parameters_begin;
+        while(cursor != parameters_end)
+        {
+            if(!is_name_char(*cursor))
+            {
+                cursor++;
+                continue;
+            }
+            string_value name;
+            name.data = cursor;
+            while(cursor != parameters_end && is_name_char(*cursor)) cursor++;
+            name.length = cursor - name.data;
+            find_calls(calls, name).excluded = true;
+        }
+        
+        count_block_calls(tree, 1, calls);
+        
+        std::vector<const std::string *> hoisted;
+        for(std::size_t i = 0; i < calls.size() && 
+            hoisted.size() < MAX_HOISTED_FUNCTIONS; i++)
+        {
+            if(!calls[i].excluded && calls[i].count > 1)
+                hoisted.push_back(&calls[i].name);
+        }
+        
+        if(hoisted.empty()) return;
+        
+        m_output += "local ";
+        for(std::size_t i = 0; i < hoisted.size(); i++)
+        {
+            if(i) m_output += ',';
+            m_output += *hoisted[i];
+        }
+        m_output += '=';
+        for(std::size_t i = 0; i < hoisted.size(); i++)
+        {
+            if(i) m_output += ',';
+            m_output += *hoisted[i];
+        }
+        m_output += '\n';
+    }
+
+    std::string & m_output;
+    const lua_code_options & m_options;
+    std::vector<string_value> m_values;
+    std::vector<variable> m_variables;
+    std::vector<std::size_t> m_scopes;
+};
+
+void generate_lua_code(const char * source_begin, const char * source_end,
+                       std::string & output, const lua_code_options & options)
+{
+    lua_code_generator generator(output, options);
+    generator.generate_code(source_begin, source_end);
+}
+
+void generate_lua_function(const char * parameters_begin, 
+                           const char * parameters_end,
+                           const char * body_begin, 
+                           const char * body_end,
+                           std::string & output,
+                           const lua_code_options & options)
+{
+    lua_code_generator generator(output, options);
+    generator.generate_function(parameters_begin, parameters_end, 
+                                body_begin, body_end);
+}
+
+} //namespace cubescript
@@ -0,0 +1,110 @@
+/*
+  Copyright (c) 2010 Graham Daws <graham.daws@gmail.com>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+#ifndef CUBESCRIPT_TO_LUA_HPP
+#define CUBESCRIPT_TO_LUA_HPP
+
+#include <string>
+#include "cubescript.hpp"
+
+namespace cubescript{
+
+/**
+    Changes whenever the Lua code generated for the same input and options
+    changes, so that saved translations can be told apart from current ones.
+*/
+const int LUA_CODE_VERSION = 1;
+
+/**
+    Optimisations made by the code generator, each of which can be switched
+    on or off on its own. All of them are on by default except for
+    hoist_globals, which changes when global functions are looked up.
+*/
+struct lua_code_options
+{
+    lua_code_options();
+    
+    /**
+        Replace arithmetic, comparison and logic expressions that only have
+        constant arguments with their result.
+    */
+    bool fold_constants;
+    
+    /**
+        Generate only the branch that runs of an if statement with a constant
+        condition.
+    */
+    bool eliminate_dead_branches;
+    
+    /**
+        Copy the functions called more than once in a function body (or in a
+        loop) into locals at the start of the function. Calls made by the 
+        function see the global functions as they were when it started.
+    */
+    bool hoist_globals;
+    
+    /**
+        Replace references to a variable defined with def to a constant value
+        with the value, for the rest of the block that defines it.
+    */
+    bool inline_constants;
+};
+
+/**
+    Translate Cubescript code into Lua code, appending the Lua code to the 
+    output string. Each top-level expression becomes a Lua statement followed
+    by a new line. Calls to the built-in functions def, if, loop, func, 
+    return, the arithmetic, comparison and logic operators, true, false and 
+    nil are replaced by the equivalent Lua syntax where possible; every other
+    expression becomes a function call. Function names are converted to valid
+    Lua names in the same way as the compatible_name function of the runtime 
+    library.
+    
+    Parse errors are ignored; the expressions read up to the error are 
+    translated. Names that can't be used in Lua code, and values that can't
+    be translated, throw a code_generation_error exception.
+*/
+void generate_lua_code(const char * source_begin, const char * source_end,
+                       std::string & output, 
+                       const lua_code_options & = lua_code_options());
+
+/**
+    Translate a function definition, with the parameter names listed in 
+    the parameters string and the body in Cubescript code, into a Lua 
+    function expression. The output is the same as for the Cubescript code 
+    "func [parameters] [body]".
+*/
+void generate_lua_function(const char * parameters_begin, 
+                           const char * parameters_end,
+                           const char * body_begin, 
+                           const char * body_end,
+                           std::string & output,
+                           const lua_code_options & = lua_code_options());
+
+class code_generation_error:public eval_error
+{
+public:
+    code_generation_error(const std::string &);
+};
+
+} //namespace cubescript
+
+#endif